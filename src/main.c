@@ -2,11 +2,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "diag/diag.h"
 #include "helpers.h"
 #include "lut.h"
 
+#include "utils/arena.h"
 #include "utils/darray.h"
 #include "utils/utf8.h"
 
@@ -15,114 +17,172 @@
 #include "parser/analyser.h"
 
 #include "vm/objects/errorobject.h"
+#include "vm/alloc.h"
 #include "vm/co.h"
+#include "vm/mec.h"
 #include "vm/vm.h"
 
-int main(int argc, char *argv[]) {
-// #ifndef ME_DEBUG
-//     // COMMAND LINE HANDLING WILL BE DONE IN SEPERATE FILE LASTLY DO NOT ADD THINGS LIKE THAT HERE.
-//     if (argc < 2) {
-//         fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
-//         return 1;
-//     }
-
-//     const char* filename = argv[1];
-// #else
-//     const char* filename = "deneme.me"; // For now let's assume "filename" is both utf-8 and null terminated string
-// #endif
-
-    // NEVERMIND I AM TIRED, NO COMPLEX COMMAND LINE HANDLING
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
-        return 1;
-    }
-
-    const char* filename = argv[1];
-
-    char* src = read_file_binary(filename, NULL);
-    if (!src) {
-        fprintf(stderr, "Failed to read source file: %s\n", filename);
-        return 1;
-    }
-    
-    // Some editors add BOM at the beginning of the files with UTF-8 encoding
-    if (src[0] == '\xEF' && src[1] == '\xBB' && src[2] == '\xBF')
-        src += 3; // Skip BOM
-
+// Front-end plus compiler, NULL (with the diagnostics already printed) if the source has errors
+static MECodeObject* compile_source(const char* filename, const char* src) {
     if (!utf8_isvalid(src)) {
         fprintf(stderr, "Invalid UTF-8 encoding\n");
-        free(src);
-        return 1;
+        return NULL;
     }
 
     diags_init();
-    lut_init();
 
-    Token** tokens = lex(filename, src);
+    // Tokens, AST nodes and their darrays all live here and die together once the code is compiled
+    Arena* front_arena = arena_new();
+
+    Token** tokens = lex(filename, src, front_arena);
 #ifdef ME_DEBUG
     printf("Tokens:\n");
     darray_for(tokens) token_dump(tokens[__i]);
     printf("--------------------\n");
 #endif
 
-    Stmt** stmts = parse(filename, tokens);
+    Stmt** stmts = parse(filename, tokens, front_arena);
 #ifdef ME_DEBUG
     printf("Statements:\n");
     darray_for(stmts) stmt_dump(stmts[__i]);
     printf("--------------------\n");
 #endif
-    analyse(filename, stmts);
+    uint32_t nglobals = analyse(filename, stmts);
 
     if (diags_errs_size() > 0) {
         
         diags_dump();
         diags_free();
-        lut_free();
         
-        darray_for(tokens) free(tokens[__i]);
-        darray_free(tokens);
-
-        darray_for(stmts) free(stmts[__i]);
-        darray_free(stmts);
-
-        free(src);
+        arena_free(front_arena);
 
         fprintf(stderr, "Compilation failed due to errors.\n");
 
-        return 1;
+        return NULL;
     }
 
-    MECodeObject* co = co_new(filename, stmts);
+    MECodeObject* co = co_new(filename, stmts, nglobals);
 #ifdef ME_DEBUG
-    co_disasm(co);
+    arena_dump_stats(front_arena, "front-end");
 #endif
-    
-    darray_for(tokens) free(tokens[__i]);
-    darray_free(tokens);
-    
-    darray_for(stmts) free(stmts[__i]);
-    darray_free(stmts);
+
+    arena_free(front_arena);
 
     diags_dump();
     diags_free();
+
+    // Only a compiler bug gets here, register code has no stack to verify
+    if (!co->co_register && !co_verify(co)) {
+        fprintf(stderr, "Internal error: %s\n", me_get_error_msg());
+        co_free(co);
+        return NULL;
+    }
+
+    return co;
+}
+
+int main(int argc, char *argv[]) {
+// #ifndef ME_DEBUG
+//     // COMMAND LINE HANDLING WILL BE DONE IN SEPERATE FILE LASTLY DO NOT ADD THINGS LIKE THAT HERE.
+//     if (argc < 2) {
+//         fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
+//         return 1;
+//     }
+
+//     const char* filename = argv[1];
+// #else
+//     const char* filename = "deneme.me"; // For now let's assume "filename" is both utf-8 and null terminated string
+// #endif
+
+    // NEVERMIND I AM TIRED, NO COMPLEX COMMAND LINE HANDLING
+    const char* filename = NULL;
+    int bad_flag = 0;
+    int use_cache = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-fold") == 0)
+            co_options.fold = 0;
+        else if (strcmp(argv[i], "--no-peephole") == 0)
+            co_options.peephole = 0;
+        else if (strcmp(argv[i], "--no-cache") == 0)
+            use_cache = 0;
+        else if (strcmp(argv[i], "--registers") == 0)
+            co_options.registers = 1;
+        else if (strncmp(argv[i], "--", 2) == 0)
+            bad_flag = 1;
+        else
+            filename = argv[i];
+    }
+
+    if (!filename || bad_flag) {
+        fprintf(stderr, "Usage: %s [--no-fold] [--no-peephole] [--no-cache] [--registers] <source_file>\n", argv[0]);
+        return 1;
+    }
+
+    size_t src_size;
+    char* src = read_file_binary(filename, &src_size);
+    if (!src) {
+        fprintf(stderr, "Failed to read source file: %s\n", filename);
+        return 1;
+    }
+
+    lut_init();
+
+    // An unchanged script compiled by this same VM skips the whole front-end
+    uint64_t src_hash = mec_hash(src, src_size);
+    // .mec files only hold stack bytecode
+    char* cache_path = use_cache && !co_options.registers ? mec_path(filename) : NULL;
+    MECodeObject* co = cache_path ? mec_load(cache_path, src_hash) : NULL;
+
+    if (!co) {
+        // Some editors add BOM at the beginning of the files with UTF-8 encoding
+        const char* text = src;
+        if (src_size >= 3 && text[0] == '\xEF' && text[1] == '\xBB' && text[2] == '\xBF')
+            text += 3; // Skip BOM
+
+        co = compile_source(filename, text);
+        if (!co) {
+            free(cache_path);
+            free(src);
+            lut_free();
+            return 1;
+        }
+
+        if (cache_path)
+            mec_save(cache_path, co, src_hash);
+    }
+
+    free(cache_path);
     free(src);
 
+#ifdef ME_DEBUG
+    co_disasm(co);
+#endif
+
     MEVM* vm = me_vm_new(co);
     MEVMExitCode res = me_vm_run(vm);
     if (res != MEVM_EXIT_OK) {
         const char* msg = me_get_error_msg();
-        fprintf(stderr, "Runtime error: %s\n", msg);
+        fprintf(stderr, "%s:%u: Runtime error: %s\n", filename, vm->error_line, msg);
         me_vm_free(vm);
+        me_alloc_free_all();
         lut_free();
         return 1;
     }
 
 #ifdef ME_DEBUG
     printf("Execution fin.\n");
+    if (vm->dispatches)
+        printf("Dispatches: %llu\n", (unsigned long long)vm->dispatches);
+#if ME_COUNT_REFCOUNTS
+    printf("Refcount writes: %llu increfs, %llu decrefs\n", (unsigned long long)me_refcount_stats.increfs, (unsigned long long)me_refcount_stats.decrefs);
+#endif
+    co_dump_cache_stats(vm->co);
+    me_alloc_dump_stats();
 #endif
 
 
     me_vm_free(vm);
+    me_alloc_free_all();
     lut_free();
 
     return 0;
@@ -77,6 +77,8 @@ static void analyser_init(Analyser* analyser, const char* filename, Stmt** stmts
     analyser->current_scope = NULL;
     analyser->inside_loop = 0;
     analyser->inside_function = 0;
+    analyser->nglobals = 0;
+    analyser->nlocals = 0;
     
     scope_enter(analyser);
 }
@@ -129,9 +131,17 @@ Symbol* symbol_new(StringView name, int is_const, int line, int col) {
     symbol->is_initialized = 0;
     symbol->line = line;
     symbol->col = col;
+    symbol->scope = SYMBOL_UNRESOLVED;
+    symbol->slot = 0;
     return symbol;
 }
 
+// Gives a freshly defined symbol its slot, the compiler emits loads and stores straight from it
+void analyser_bind(Analyser* analyser, Symbol* symbol, int local) {
+    symbol->scope = local ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
+    symbol->slot = local ? analyser->nlocals++ : analyser->nglobals++;
+}
+
 void symbol_free(Symbol* symbol) {
     free(symbol);
 }
@@ -186,7 +196,12 @@ static void analyse_decl(Analyser* analyser, Stmt* stmt) {
             "Variable '%.*s' already defined in this scope", 
             (int)stmt->decl_stmt->name.byte_len, stmt->decl_stmt->name.data);
         symbol_free(symbol);
+        return;
     }
+
+    analyser_bind(analyser, symbol, analyser->inside_function);
+    stmt->decl_stmt->scope = symbol->scope;
+    stmt->decl_stmt->slot = symbol->slot;
 }
 
 static void analyse_expr_stmt(Analyser* analyser, Stmt* stmt) {
@@ -230,6 +245,10 @@ static void analyse_function_decl(Analyser* analyser, Stmt* stmt) {
             "Function prototype for '%.*s' already defined", 
             (int)stmt->function_decl->name.byte_len, stmt->function_decl->name.data,
             existing->nargs);
+    } else if (existing) {
+        // Redefinition with a different arity replaces the function in the same slot
+        stmt->function_decl->scope = existing->scope;
+        stmt->function_decl->slot = existing->slot;
     } else {
         Symbol* func_symbol = symbol_new(
             stmt->function_decl->name, 
@@ -240,8 +259,15 @@ static void analyse_function_decl(Analyser* analyser, Stmt* stmt) {
         func_symbol->nargs = darray_size(stmt->function_decl->params);
         func_symbol->is_initialized = 1;  // Functions are always initialized
         scope_define(analyser->current_scope->parent, func_symbol);
+
+        analyser_bind(analyser, func_symbol, analyser->inside_function > 1);
+        stmt->function_decl->scope = func_symbol->scope;
+        stmt->function_decl->slot = func_symbol->slot;
     }
     
+    // Parameters take the first local slots, in order
+    uint32_t outer_nlocals = analyser->nlocals;
+    analyser->nlocals = 0;
 
     for (int i = 0; i < darray_size(stmt->function_decl->params); i++) {
         Expr* param = stmt->function_decl->params[i];
@@ -255,13 +281,20 @@ static void analyse_function_decl(Analyser* analyser, Stmt* stmt) {
                     "Parameter '%.*s' already defined", 
                     (int)param->variable->name.byte_len, param->variable->name.data);
                 symbol_free(symbol);
+                continue;
             }
+
+            analyser_bind(analyser, symbol, 1);
+            param->variable->scope = symbol->scope;
+            param->variable->slot = symbol->slot;
         }
     }
 
     for (int i = 0; i < darray_size(stmt->function_decl->body); i++)
         analyse_stmt(analyser, stmt->function_decl->body[i]);
 
+    stmt->function_decl->nlocals = analyser->nlocals;
+    analyser->nlocals = outer_nlocals;
     
     analyser->inside_function--;
     scope_exit(analyser);
@@ -330,7 +363,13 @@ static void analyse_expr(Analyser* analyser, Expr* expr, int check_init) {
                     expr->line, expr->col,
                     "Undefined variable '%.*s'", 
                     (int)expr->variable->name.byte_len, expr->variable->name.data);
-            } else if (check_init && !symbol->is_initialized) {
+                break;
+            }
+
+            expr->variable->scope = symbol->scope;
+            expr->variable->slot = symbol->slot;
+
+            if (check_init && !symbol->is_initialized) {
                 diags_new_diag(DIAG_SEMANTIC, DIAG_ERROR, analyser->filename, 
                     expr->line, expr->col,
                     "Variable '%.*s' used before initialization", 
@@ -350,7 +389,13 @@ static void analyse_expr(Analyser* analyser, Expr* expr, int check_init) {
                     expr->line, expr->col,
                     "Undefined function '%.*s'", 
                     (int)expr->call->name.byte_len, expr->call->name.data);
-            } else if (symbol->nargs != darray_size(expr->call->args) && symbol->nargs != -1) {
+                break;
+            }
+
+            expr->call->scope = symbol->scope;
+            expr->call->slot = symbol->slot;
+
+            if (symbol->nargs != darray_size(expr->call->args) && symbol->nargs != -1) {
                 diags_new_diag(DIAG_SEMANTIC, DIAG_ERROR, analyser->filename, 
                     expr->line, expr->col,
                     "Function '%.*s' expects %d arguments but got %zu", 
@@ -403,7 +448,8 @@ static void analyse_expr(Analyser* analyser, Expr* expr, int check_init) {
     }
 }
 
-void analyse(const char* filename, Stmt** stmts) {
+// Returns the number of global slots the module needs
+uint32_t analyse(const char* filename, Stmt** stmts) {
     Analyser analyser;
     analyser_init(&analyser, filename, stmts);
 
@@ -414,4 +460,6 @@ void analyse(const char* filename, Stmt** stmts) {
     darray_for(stmts) analyse_stmt(&analyser, stmts[__i]);
     
     scope_exit(&analyser);
+
+    return analyser.nglobals;
 }
\ No newline at end of file
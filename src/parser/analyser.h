@@ -12,6 +12,8 @@ typedef struct Symbol {
     int nargs;
     int line;
     int col;
+    SymbolScope scope;
+    uint32_t slot;
 } Symbol;
 
 typedef struct Scope {
@@ -28,9 +30,13 @@ typedef struct Analyser {
     Scope* current_scope;
     int inside_loop;
     int inside_function;
+
+    uint32_t nglobals; // Global slots handed out so far, builtins first
+    uint32_t nlocals;  // Local slots of the function being analysed
 } Analyser;
 
-void analyse(const char* filename, Stmt** stmts);
+uint32_t analyse(const char* filename, Stmt** stmts);
+void analyser_bind(Analyser* analyser, Symbol* symbol, int local);
 
 Symbol* symbol_new(StringView name, int is_const, int line, int col);
 void symbol_free(Symbol* symbol);
@@ -16,10 +16,12 @@ typedef struct _Lexer {
     size_t c_len; // length of char as bytes
     int line;
     int col;
+    Arena* arena; // Owns the tokens and the token darray
 } Lexer;
 
-static void lexer_init(Lexer* lexer, const char* filename, const char* src) {
+static void lexer_init(Lexer* lexer, const char* filename, const char* src, Arena* arena) {
     lexer->filename = filename;
+    lexer->arena = arena;
     lexer->src = src;
     lexer->line = 1;
     lexer->col = 1;
@@ -67,9 +69,9 @@ static Token* get_identifier(Lexer* lexer) {
     uintptr_t idx = 0;
     hashmap_get(lut_kw_to_token, sv.data, sv.byte_len, &idx);
     if (idx)
-        return token_new((TokenType)idx, sv, lexer->line, lexer->col - sv.len);
+        return token_new(lexer->arena, (TokenType)idx, sv, lexer->line, lexer->col - sv.len);
 
-    return token_new(TOKEN_IDENTIFIER, sv, lexer->line, lexer->col - sv.len);
+    return token_new(lexer->arena, TOKEN_IDENTIFIER, sv, lexer->line, lexer->col - sv.len);
 }
 
 static Token* get_number(Lexer* lexer) {
@@ -95,10 +97,10 @@ static Token* get_number(Lexer* lexer) {
             advance(lexer);
         }
 
-        return token_new(TOKEN_LIT_FLOAT, sv, lexer->line, lexer->col - sv.len);
+        return token_new(lexer->arena, TOKEN_LIT_FLOAT, sv, lexer->line, lexer->col - sv.len);
     }
 
-    return token_new(TOKEN_LIT_INTEGER, sv, lexer->line, lexer->col - sv.len);
+    return token_new(lexer->arena, TOKEN_LIT_INTEGER, sv, lexer->line, lexer->col - sv.len);
 }
 
 static Token* get_string(Lexer* lexer) {
@@ -118,11 +120,11 @@ static Token* get_string(Lexer* lexer) {
 
     if (*lexer->c != '"') {
         diags_new_diag(DIAG_LEXER, DIAG_ERROR, lexer->filename, lexer->line, lexer->col, "Unterminated string");
-        return token_new(TOKEN_EOF, EMPTY_STRV, lexer->line, lexer->col);
+        return token_new(lexer->arena, TOKEN_EOF, EMPTY_STRV, lexer->line, lexer->col);
     }
 
     advance(lexer);
-    return token_new(TOKEN_LIT_STRING, sv, lexer->line, lexer->col - sv.len - 1);
+    return token_new(lexer->arena, TOKEN_LIT_STRING, sv, lexer->line, lexer->col - sv.len - 1);
 }
 
 static Token* get_token(Lexer* lexer) {
@@ -130,12 +132,12 @@ static Token* get_token(Lexer* lexer) {
     if (*lexer->c == '\n') {
         int last_col = lexer->col;
         advance(lexer);
-        // return token_new(TOKEN_LF, EMPTY_STRV, lexer->line - 1, last_col);
+        // return token_new(lexer->arena, TOKEN_LF, EMPTY_STRV, lexer->line - 1, last_col);
         return NULL;
     }
 
     if (!*lexer->c)
-        return token_new(TOKEN_EOF, EMPTY_STRV, lexer->line, lexer->col);
+        return token_new(lexer->arena, TOKEN_EOF, EMPTY_STRV, lexer->line, lexer->col);
 
     if (utf8_isalpha(lexer->c) || *lexer->c == '_')
         return get_identifier(lexer);
@@ -145,17 +147,17 @@ static Token* get_token(Lexer* lexer) {
     switch (*lexer->c) {
         case '\n':
             advance(lexer);
-            // return token_new(TOKEN_LF, EMPTY_STRV, lexer->line - 1, lexer->col);
+            // return token_new(lexer->arena, TOKEN_LF, EMPTY_STRV, lexer->line - 1, lexer->col);
             return NULL;
         case '#':
             skipcomment(lexer);
             if (*lexer->c == '\0')
-                return token_new(TOKEN_EOF, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_EOF, EMPTY_STRV, lexer->line, lexer->col);
         
             if (*lexer->c == '\n') {
                 int last_col = lexer->col;
                 advance(lexer);
-                // return token_new(TOKEN_LF, EMPTY_STRV, lexer->line - 1, last_col);
+                // return token_new(lexer->arena, TOKEN_LF, EMPTY_STRV, lexer->line - 1, last_col);
                 return NULL;
             }
 
@@ -163,153 +165,153 @@ static Token* get_token(Lexer* lexer) {
             return get_token(lexer);
         case ';':
             advance(lexer);
-            return token_new(TOKEN_SEMI, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_SEMI, EMPTY_STRV, lexer->line, lexer->col);
         case ':':
             advance(lexer);
-            return token_new(TOKEN_COLON, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_COLON, EMPTY_STRV, lexer->line, lexer->col);
         case '.':
             advance(lexer);
-            return token_new(TOKEN_DOT, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_DOT, EMPTY_STRV, lexer->line, lexer->col);
         case ',':
             advance(lexer);
-            return token_new(TOKEN_COMMA, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_COMMA, EMPTY_STRV, lexer->line, lexer->col);
         case '(':
             advance(lexer);
-            return token_new(TOKEN_LPAREN, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_LPAREN, EMPTY_STRV, lexer->line, lexer->col);
         case ')':
             advance(lexer);
-            return token_new(TOKEN_RPAREN, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_RPAREN, EMPTY_STRV, lexer->line, lexer->col);
         case '{':
             advance(lexer);
-            return token_new(TOKEN_LBRACE, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_LBRACE, EMPTY_STRV, lexer->line, lexer->col);
         case '}':
             advance(lexer);
-            return token_new(TOKEN_RBRACE, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_RBRACE, EMPTY_STRV, lexer->line, lexer->col);
         case '[':
             advance(lexer);
-            return token_new(TOKEN_LBRACKET, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_LBRACKET, EMPTY_STRV, lexer->line, lexer->col);
         case ']':
             advance(lexer);
-            return token_new(TOKEN_RBRACKET, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_RBRACKET, EMPTY_STRV, lexer->line, lexer->col);
         case '+':
             advance(lexer);
             if (*lexer->c == '+') {
                 advance(lexer);
-                return token_new(TOKEN_UNARY_INC, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_UNARY_INC, EMPTY_STRV, lexer->line, lexer->col);
             }
 
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_ADD, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_ADD, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_OP_ADD, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_OP_ADD, EMPTY_STRV, lexer->line, lexer->col);
         case '-':
             advance(lexer);
             if (*lexer->c == '-') {
                 advance(lexer);
-                return token_new(TOKEN_UNARY_DEC, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_UNARY_DEC, EMPTY_STRV, lexer->line, lexer->col);
             }
 
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_SUB, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_SUB, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_OP_SUB, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_OP_SUB, EMPTY_STRV, lexer->line, lexer->col);
         case '*':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_MUL, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_MUL, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_OP_MUL, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_OP_MUL, EMPTY_STRV, lexer->line, lexer->col);
         case '/':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_DIV, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_DIV, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_OP_DIV, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_OP_DIV, EMPTY_STRV, lexer->line, lexer->col);
         case '%':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_MOD, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_MOD, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_OP_MOD, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_OP_MOD, EMPTY_STRV, lexer->line, lexer->col);
         case '=':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_COMP_EQ, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_COMP_EQ, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_ASSIGN, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_ASSIGN, EMPTY_STRV, lexer->line, lexer->col);
         case '!':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_COMP_NEQ, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_COMP_NEQ, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_UNARY_NOT, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_UNARY_NOT, EMPTY_STRV, lexer->line, lexer->col);
         case '<':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_COMP_LTE, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_COMP_LTE, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_COMP_LT, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_COMP_LT, EMPTY_STRV, lexer->line, lexer->col);
         case '>':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_COMP_GTE, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_COMP_GTE, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_COMP_GT, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_COMP_GT, EMPTY_STRV, lexer->line, lexer->col);
         case '&':
             advance(lexer);
             if (*lexer->c == '&') {
                 advance(lexer);
-                return token_new(TOKEN_LOGICAL_AND, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_LOGICAL_AND, EMPTY_STRV, lexer->line, lexer->col);
             }
 
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_BIT_AND, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_BIT_AND, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_BIT_AND, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_BIT_AND, EMPTY_STRV, lexer->line, lexer->col);
         case '|':
             advance(lexer);
             if (*lexer->c == '|') {
                 advance(lexer);
-                return token_new(TOKEN_LOGICAL_OR, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_LOGICAL_OR, EMPTY_STRV, lexer->line, lexer->col);
             }
 
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_BIT_OR, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_BIT_OR, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_BIT_OR, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_BIT_OR, EMPTY_STRV, lexer->line, lexer->col);
         case '^':
             advance(lexer);
             if (*lexer->c == '=') {
                 advance(lexer);
-                return token_new(TOKEN_ASSIGN_BIT_XOR, EMPTY_STRV, lexer->line, lexer->col);
+                return token_new(lexer->arena, TOKEN_ASSIGN_BIT_XOR, EMPTY_STRV, lexer->line, lexer->col);
             }
 
-            return token_new(TOKEN_BIT_XOR, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_BIT_XOR, EMPTY_STRV, lexer->line, lexer->col);
         case '~':
             advance(lexer);
-            return token_new(TOKEN_BIT_NOT, EMPTY_STRV, lexer->line, lexer->col);
+            return token_new(lexer->arena, TOKEN_BIT_NOT, EMPTY_STRV, lexer->line, lexer->col);
         case '"':
             return get_string(lexer);
         default:
@@ -319,11 +321,11 @@ static Token* get_token(Lexer* lexer) {
     }
 }
 
-Token** lex(const char* filename, const char* src) {
+Token** lex(const char* filename, const char* src, Arena* arena) {
     Lexer lexer;
-    lexer_init(&lexer, filename, src);
+    lexer_init(&lexer, filename, src, arena);
 
-    Token** tokens = (Token**)darray_new(Token*);
+    Token** tokens = (Token**)darray_new_arena(Token*, arena);
     while (1) {
         Token* token = get_token(&lexer);
         if (!token)
@@ -3,6 +3,6 @@
 
 #include "token.h"
 
-Token** lex(const char* filename, const char* src);
+Token** lex(const char* filename, const char* src, Arena* arena);
 
 #endif
\ No newline at end of file
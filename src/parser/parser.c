@@ -13,6 +13,7 @@ typedef struct _Parser {
     Token* c;
     int index;
     jmp_buf loop_jmp;
+    Arena* arena; // Owns every node and darray the parser creates
 } Parser;
 
 // Forward decls
@@ -99,8 +100,9 @@ static void parser_expect(Parser* parser, TokenType type, const char* msg) {
     }
 }
 
-static void parser_init(Parser* parser, const char* filename, Token** tokens) {
+static void parser_init(Parser* parser, const char* filename, Token** tokens, Arena* arena) {
     parser->filename = filename;
+    parser->arena = arena;
     parser->tokens = tokens;
     parser->index = 0;
     parser->c = tokens[0];
@@ -143,10 +145,10 @@ static Expr* parse_assignment(Parser* parser) {
         Expr* value = parse_assignment(parser);
         
         if (op->type == TOKEN_ASSIGN)
-            return expr_new_binary(BIN_ASSIGN, expr, value, expr->line, expr->col);
+            return expr_new_binary(parser->arena, BIN_ASSIGN, expr, value, expr->line, expr->col);
         
-        Expr* binary = expr_new_binary(lut_compound_to_binop[op->type], expr, value, expr->line, expr->col);
-        return expr_new_binary(BIN_ASSIGN, expr, binary, expr->line, expr->col);
+        Expr* binary = expr_new_binary(parser->arena, lut_compound_to_binop[op->type], expr, value, expr->line, expr->col);
+        return expr_new_binary(parser->arena, BIN_ASSIGN, expr, binary, expr->line, expr->col);
     }
     
     return expr;
@@ -157,7 +159,7 @@ static Expr* parse_logical_or(Parser* parser) {
     
     while (parser_match(parser, TOKEN_LOGICAL_OR)) {
         Expr* right = parse_logical_and(parser);
-        expr = expr_new_binary(BIN_OR, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, BIN_OR, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -168,7 +170,7 @@ static Expr* parse_logical_and(Parser* parser) {
     
     while (parser_match(parser, TOKEN_LOGICAL_AND)) {
         Expr* right = parse_bitwise_or(parser);
-        expr = expr_new_binary(BIN_AND, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, BIN_AND, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -179,7 +181,7 @@ static Expr* parse_bitwise_or(Parser* parser) {
     
     while (parser_match(parser, TOKEN_BIT_OR)) {
         Expr* right = parse_bitwise_xor(parser);
-        expr = expr_new_binary(BIN_BIT_OR, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, BIN_BIT_OR, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -190,7 +192,7 @@ static Expr* parse_bitwise_xor(Parser* parser) {
     
     while (parser_match(parser, TOKEN_BIT_XOR)) {
         Expr* right = parse_bitwise_and(parser);
-        expr = expr_new_binary(BIN_BIT_XOR, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, BIN_BIT_XOR, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -201,7 +203,7 @@ static Expr* parse_bitwise_and(Parser* parser) {
     
     while (parser_match(parser, TOKEN_BIT_AND)) {
         Expr* right = parse_equality(parser);
-        expr = expr_new_binary(BIN_BIT_AND, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, BIN_BIT_AND, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -215,7 +217,7 @@ static Expr* parse_equality(Parser* parser) {
         Expr* right = parse_comparison(parser);
         
         BinaryOp binop = (op->type == TOKEN_COMP_EQ) ? BIN_EQ : BIN_NEQ;
-        expr = expr_new_binary(binop, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, binop, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -253,7 +255,7 @@ static Expr* parse_comparison(Parser* parser) {
                 break;
         }
         
-        expr = expr_new_binary(binop, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, binop, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -268,7 +270,7 @@ static Expr* parse_bitshift(Parser* parser) {
         Expr* right = parse_term(parser);
         
         BinaryOp binop = (op->type == TOKEN_BIT_LSHIFT) ? BIN_BIT_LSHIFT : BIN_BIT_RSHIFT;
-        expr = expr_new_binary(binop, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, binop, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -283,7 +285,7 @@ static Expr* parse_term(Parser* parser) {
         Expr* right = parse_factor(parser);
         
         BinaryOp binop = (op->type == TOKEN_OP_ADD) ? BIN_ADD : BIN_SUB;
-        expr = expr_new_binary(binop, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, binop, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -314,7 +316,7 @@ static Expr* parse_factor(Parser* parser) {
                 break;
         }
         
-        expr = expr_new_binary(binop, expr, right, expr->line, expr->col);
+        expr = expr_new_binary(parser->arena, binop, expr, right, expr->line, expr->col);
     }
     
     return expr;
@@ -357,7 +359,7 @@ static Expr* parse_unary(Parser* parser) {
                 break;
         }
         
-        return expr_new_unary(unary_op, right, op->line, op->col);
+        return expr_new_unary(parser->arena, unary_op, right, op->line, op->col);
     }
     
     return parse_postfix(parser);
@@ -369,9 +371,9 @@ static Expr* parse_postfix(Parser* parser) {
     
     // Handle postfix operators
     if (parser_match(parser, TOKEN_UNARY_INC)) {
-        return expr_new_unary(UNARY_POST_INC, expr, expr->line, expr->col);
+        return expr_new_unary(parser->arena, UNARY_POST_INC, expr, expr->line, expr->col);
     } else if (parser_match(parser, TOKEN_UNARY_DEC)) {
-        return expr_new_unary(UNARY_POST_DEC, expr, expr->line, expr->col);
+        return expr_new_unary(parser->arena, UNARY_POST_DEC, expr, expr->line, expr->col);
     }
     
     return expr;
@@ -381,22 +383,22 @@ static Expr* parse_postfix(Parser* parser) {
 static Expr* parse_primary(Parser* parser) {
     if (parser_match(parser, TOKEN_LIT_STRING)) {
         Token* token = parser->tokens[parser->index - 1];
-        return expr_new_literal(LITERAL_STRING, token->value, token->line, token->col);
+        return expr_new_literal(parser->arena, LITERAL_STRING, token->value, token->line, token->col);
     }
     
     if (parser_match(parser, TOKEN_LIT_INTEGER)) {
         Token* token = parser->tokens[parser->index - 1];
-        return expr_new_literal(LITERAL_INT, token->value, token->line, token->col);
+        return expr_new_literal(parser->arena, LITERAL_INT, token->value, token->line, token->col);
     }
     
     if (parser_match(parser, TOKEN_LIT_FLOAT)) {
         Token* token = parser->tokens[parser->index - 1];
-        return expr_new_literal(LITERAL_FLOAT, token->value, token->line, token->col);
+        return expr_new_literal(parser->arena, LITERAL_FLOAT, token->value, token->line, token->col);
     }
 
     if (parser_match(parser, TOKEN_LIT_NONE)) {
         Token* token = parser->tokens[parser->index - 1];
-        return expr_new_literal(LITERAL_NONE, token->value, token->line, token->col);
+        return expr_new_literal(parser->arena, LITERAL_NONE, token->value, token->line, token->col);
     }
     
     // Parse variables and function calls
@@ -408,7 +410,7 @@ static Expr* parse_primary(Parser* parser) {
         
         // Check if this is a function call
         if (parser_match(parser, TOKEN_LPAREN)) {
-            Expr** args = (Expr**)darray_new(Expr*);
+            Expr** args = (Expr**)darray_new_arena(Expr*, parser->arena);
             
             // Parse arguments
             if (!parser_check(parser, TOKEN_RPAREN)) {
@@ -419,11 +421,11 @@ static Expr* parse_primary(Parser* parser) {
             }
             
             parser_expect(parser, TOKEN_RPAREN, "Expected ')' after function arguments");
-            return expr_new_call(name, args, line, col);
+            return expr_new_call(parser->arena, name, args, line, col);
         }
         
         // Otherwise, it's a variable
-        return expr_new_variable(name, line, col);
+        return expr_new_variable(parser->arena, name, line, col);
     }
     
     // Parse grouped expressions
@@ -445,7 +447,7 @@ static Expr* parse_primary(Parser* parser) {
 // ----------------------------------
 
 static Stmt** parse_helper_compound(Parser* parser) {
-    Stmt** stmts = (Stmt**)darray_new(Stmt*);
+    Stmt** stmts = (Stmt**)darray_new_arena(Stmt*, parser->arena);
     parser_expect(parser, TOKEN_LBRACE, "Expected '{' at the beginning of compound statement");
     while (parser->c && parser->c->type != TOKEN_RBRACE) {
         Stmt* stmt = parse_stmt(parser);
@@ -462,7 +464,7 @@ static Stmt** parse_helper_compound(Parser* parser) {
 
 static Stmt* parse_compound(Parser* parser) {
     Stmt** stmts = parse_helper_compound(parser);
-    return stmt_new_compound(stmts, parser->c->line, parser->c->col);
+    return stmt_new_compound(parser->arena, stmts, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_decl(Parser* parser) {
@@ -473,13 +475,13 @@ static Stmt* parse_decl(Parser* parser) {
     parser_expect(parser, TOKEN_IDENTIFIER, "Expected identifier after 'let' or 'const'"); 
 
     if (parser_match(parser, TOKEN_SEMI))
-        return stmt_new_decl(name, NULL, type == TOKEN_KW_CONST, parser->c->line, parser->c->col);
+        return stmt_new_decl(parser->arena, name, NULL, type == TOKEN_KW_CONST, parser->c->line, parser->c->col);
 
     parser_expect(parser, TOKEN_ASSIGN, "Expected '=' after identifier");
     Expr* initializer = parse_expr(parser);
 
     parser_expect(parser, TOKEN_SEMI, "Expected ';' after declaration");
-    return stmt_new_decl(name, initializer, type == TOKEN_KW_CONST, parser->c->line, parser->c->col);
+    return stmt_new_decl(parser->arena, name, initializer, type == TOKEN_KW_CONST, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_while(Parser* parser) {
@@ -490,7 +492,7 @@ static Stmt* parse_while(Parser* parser) {
     parser_expect(parser, TOKEN_RPAREN, "Expected ')' after condition");
 
     Stmt** body = parse_helper_compound(parser);
-    return stmt_new_while(condition, body, parser->c->line, parser->c->col);
+    return stmt_new_while(parser->arena, condition, body, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_if(Parser* parser) {
@@ -508,7 +510,7 @@ static Stmt* parse_if(Parser* parser) {
     else if (parser_match(parser, TOKEN_KW_IF))
         else_branch = parse_if(parser);
 
-    return stmt_new_if(condition, then_branch, else_branch, parser->c->line, parser->c->col);
+    return stmt_new_if(parser->arena, condition, then_branch, else_branch, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_function_decl(Parser* parser) {
@@ -518,10 +520,10 @@ static Stmt* parse_function_decl(Parser* parser) {
     parser_expect(parser, TOKEN_IDENTIFIER, "Expected identifier after 'method'");
 
     parser_expect(parser, TOKEN_LPAREN, "Expected '(' after method name");
-    Expr** params = (Expr**)darray_new(Expr*);
+    Expr** params = (Expr**)darray_new_arena(Expr*, parser->arena);
     while (parser->c && parser->c->type != TOKEN_EOF && parser->c->type != TOKEN_RPAREN) {
         if (parser->c->type == TOKEN_IDENTIFIER) {
-            Expr* param = expr_new_variable(parser->c->value, parser->c->line, parser->c->col);
+            Expr* param = expr_new_variable(parser->arena, parser->c->value, parser->c->line, parser->c->col);
             darray_push(params, param);
             parser_advance(parser);
         } else {
@@ -532,7 +534,7 @@ static Stmt* parse_function_decl(Parser* parser) {
     parser_expect(parser, TOKEN_RPAREN, "Expected ')' after parameter list");
     Stmt** body = parse_helper_compound(parser);
 
-    return stmt_new_function_decl(name, params, body, parser->c->line, parser->c->col);
+    return stmt_new_function_decl(parser->arena, name, params, body, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_return(Parser* parser) {
@@ -543,19 +545,19 @@ static Stmt* parse_return(Parser* parser) {
         value = parse_expr(parser);
 
     parser_expect(parser, TOKEN_SEMI, "Expected ';' after return statement");
-    return stmt_new_return(value, parser->c->line, parser->c->col);
+    return stmt_new_return(parser->arena, value, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_break(Parser* parser) {
     parser_advance(parser);
     parser_expect(parser, TOKEN_SEMI, "Expected ';' after break statement");
-    return stmt_new_break(parser->c->line, parser->c->col);
+    return stmt_new_break(parser->arena, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_continue(Parser* parser) {
     parser_advance(parser);
     parser_expect(parser, TOKEN_SEMI, "Expected ';' after continue statement");
-    return stmt_new_continue(parser->c->line, parser->c->col);
+    return stmt_new_continue(parser->arena, parser->c->line, parser->c->col);
 }
 
 static Stmt* parse_stmt(Parser* parser) {
@@ -585,7 +587,7 @@ static Stmt* parse_stmt(Parser* parser) {
             Expr* expr = parse_expr(parser);
             if (expr) {
                 parser_expect(parser, TOKEN_SEMI, "Expected ';' after expression");
-                return stmt_new_expr(expr, parser->c->line, parser->c->col);
+                return stmt_new_expr(parser->arena, expr, parser->c->line, parser->c->col);
             }
 
             parser_advance(parser);
@@ -597,11 +599,11 @@ static Stmt* parse_stmt(Parser* parser) {
     return NULL;
 }
 
-Stmt** parse(const char* filename, Token** tokens) {
+Stmt** parse(const char* filename, Token** tokens, Arena* arena) {
     Parser parser;
-    parser_init(&parser, filename, tokens);
+    parser_init(&parser, filename, tokens, arena);
 
-    Stmt** stmts = (Stmt**)darray_new(Stmt*);
+    Stmt** stmts = (Stmt**)darray_new_arena(Stmt*, arena);
 
     setjmp(parser.loop_jmp);
     while(parser.c && parser.c->type != TOKEN_EOF) {
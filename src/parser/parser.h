@@ -4,6 +4,6 @@
 #include "token.h"
 #include "stmt.h"
 
-Stmt** parse(const char* filename, Token** tokens);
+Stmt** parse(const char* filename, Token** tokens, Arena* arena);
 
 #endif
\ No newline at end of file
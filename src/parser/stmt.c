@@ -6,8 +6,8 @@
 
 #include "../utils/darray.h"
 
-Stmt* stmt_new(StmtKind kind, int line, int col) {
-    Stmt* s = malloc(sizeof(Stmt));
+Stmt* stmt_new(Arena* arena, StmtKind kind, int line, int col) {
+    Stmt* s = arena_alloc(arena, sizeof(Stmt));
     if (!s)
         return NULL;
 
@@ -18,42 +18,40 @@ Stmt* stmt_new(StmtKind kind, int line, int col) {
     return s;
 }
 
-Stmt* stmt_new_compound(Stmt** stmts, int line, int col) {
-    Stmt* s = stmt_new(STMT_COMPOUND, line, col);
+Stmt* stmt_new_compound(Arena* arena, Stmt** stmts, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_COMPOUND, line, col);
     if (!s)
         return NULL;
 
-    s->compound = malloc(sizeof(CompoundStmt));
-    if (!s->compound) {
-        free(s);
+    s->compound = arena_alloc(arena, sizeof(CompoundStmt));
+    if (!s->compound)
         return NULL;
-    }
 
     s->compound->stmts = stmts;
 
     return s;
 }
 
-Stmt* stmt_new_decl(StringView name, Expr* initializer, int is_const, int line, int col) {
-    Stmt* s = stmt_new(STMT_DECL, line, col);
+Stmt* stmt_new_decl(Arena* arena, StringView name, Expr* initializer, int is_const, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_DECL, line, col);
     if (!s)
         return NULL;
 
-    s->decl_stmt = malloc(sizeof(DeclStmt));
-    if (!s->decl_stmt) {
-        free(s);
+    s->decl_stmt = arena_alloc(arena, sizeof(DeclStmt));
+    if (!s->decl_stmt)
         return NULL;
-    }
 
     s->decl_stmt->name = name;
     s->decl_stmt->initializer = initializer;
     s->decl_stmt->is_const = is_const;
+    s->decl_stmt->scope = SYMBOL_UNRESOLVED;
+    s->decl_stmt->slot = 0;
 
     return s;
 }
 
-Stmt* stmt_new_expr(Expr* expr, int line, int col) {
-    Stmt* s = stmt_new(STMT_EXPR, line, col);
+Stmt* stmt_new_expr(Arena* arena, Expr* expr, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_EXPR, line, col);
     if (!s)
         return NULL;
 
@@ -62,16 +60,14 @@ Stmt* stmt_new_expr(Expr* expr, int line, int col) {
     return s;
 }
 
-Stmt* stmt_new_while(Expr* condition, Stmt** body, int line, int col) {
-    Stmt* s = stmt_new(STMT_WHILE, line, col);
+Stmt* stmt_new_while(Arena* arena, Expr* condition, Stmt** body, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_WHILE, line, col);
     if (!s)
         return NULL;
 
-    s->while_stmt = malloc(sizeof(WhileStmt));
-    if (!s->while_stmt) {
-        free(s);
+    s->while_stmt = arena_alloc(arena, sizeof(WhileStmt));
+    if (!s->while_stmt)
         return NULL;
-    }
 
     s->while_stmt->condition = condition;
     s->while_stmt->body = body;
@@ -79,16 +75,14 @@ Stmt* stmt_new_while(Expr* condition, Stmt** body, int line, int col) {
     return s;
 }
 
-Stmt* stmt_new_if(Expr* condition, Stmt** then_branch, Stmt* else_branch, int line, int col) {
-    Stmt* s = stmt_new(STMT_IF, line, col);
+Stmt* stmt_new_if(Arena* arena, Expr* condition, Stmt** then_branch, Stmt* else_branch, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_IF, line, col);
     if (!s)
         return NULL;
 
-    s->if_stmt = malloc(sizeof(IfStmt));
-    if (!s->if_stmt) {
-        free(s);
+    s->if_stmt = arena_alloc(arena, sizeof(IfStmt));
+    if (!s->if_stmt)
         return NULL;
-    }
 
     s->if_stmt->condition = condition;
     s->if_stmt->then_branch = then_branch;
@@ -97,43 +91,42 @@ Stmt* stmt_new_if(Expr* condition, Stmt** then_branch, Stmt* else_branch, int li
     return s;
 }
 
-Stmt* stmt_new_function_decl(StringView name, Expr** params, Stmt** body, int line, int col) {
-    Stmt* s = stmt_new(STMT_FUNCTION_DECL, line, col);
+Stmt* stmt_new_function_decl(Arena* arena, StringView name, Expr** params, Stmt** body, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_FUNCTION_DECL, line, col);
     if (!s)
         return NULL;
 
-    s->function_decl = malloc(sizeof(FunctionDeclStmt));
-    if (!s->function_decl) {
-        free(s);
+    s->function_decl = arena_alloc(arena, sizeof(FunctionDeclStmt));
+    if (!s->function_decl)
         return NULL;
-    }
 
     s->function_decl->name = name;
     s->function_decl->params = params;
     s->function_decl->body = body;
+    s->function_decl->scope = SYMBOL_UNRESOLVED;
+    s->function_decl->slot = 0;
+    s->function_decl->nlocals = 0;
 
     return s;
 }
 
 
-Stmt* stmt_new_return(Expr* value, int line, int col) {
-    Stmt* s = stmt_new(STMT_RETURN, line, col);
+Stmt* stmt_new_return(Arena* arena, Expr* value, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_RETURN, line, col);
     if (!s)
         return NULL;
 
-    s->return_stmt = malloc(sizeof(ReturnStmt));
-    if (!s->return_stmt) {
-        free(s);
+    s->return_stmt = arena_alloc(arena, sizeof(ReturnStmt));
+    if (!s->return_stmt)
         return NULL;
-    }
 
     s->return_stmt->value = value;
 
     return s;
 }
 
-Stmt* stmt_new_break(int line, int col) {
-    Stmt* s = stmt_new(STMT_BREAK, line, col);
+Stmt* stmt_new_break(Arena* arena, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_BREAK, line, col);
     if (!s)
         return NULL;
 
@@ -142,8 +135,8 @@ Stmt* stmt_new_break(int line, int col) {
     return s;
 }
 
-Stmt* stmt_new_continue(int line, int col) {
-    Stmt* s = stmt_new(STMT_CONTINUE, line, col);
+Stmt* stmt_new_continue(Arena* arena, int line, int col) {
+    Stmt* s = stmt_new(arena, STMT_CONTINUE, line, col);
     if (!s)
         return NULL;
 
@@ -152,55 +145,6 @@ Stmt* stmt_new_continue(int line, int col) {
     return s;
 }
 
-void stmt_free(Stmt* s) {
-    if (!s)
-        return;
-
-    switch (s->kind) {
-        case STMT_COMPOUND:
-            darray_for(s->compound->stmts) stmt_free(s->compound->stmts[__i]);
-            darray_free(s->compound->stmts);
-            free(s->compound);
-            break;
-        case STMT_DECL:
-            expr_free(s->decl_stmt->initializer);
-            free(s->decl_stmt);
-            break;
-        case STMT_EXPR:
-            expr_free(s->expr_stmt);
-            break;
-        case STMT_WHILE:
-            expr_free(s->while_stmt->condition);
-            darray_for(s->while_stmt->body) stmt_free(s->while_stmt->body[__i]);
-            darray_free(s->while_stmt->body);
-            free(s->while_stmt);
-            break;
-        case STMT_IF:
-            expr_free(s->if_stmt->condition);
-            darray_for(s->if_stmt->then_branch) stmt_free(s->if_stmt->then_branch[__i]);
-            darray_free(s->if_stmt->then_branch);
-            stmt_free(s->if_stmt->else_branch);
-            free(s->if_stmt);
-            break;
-        case STMT_FUNCTION_DECL:
-            darray_for(s->function_decl->params) expr_free(s->function_decl->params[__i]);
-            darray_free(s->function_decl->params);
-            darray_for(s->function_decl->body) stmt_free(s->function_decl->body[__i]);
-            darray_free(s->function_decl->body);
-            free(s->function_decl);
-            break;
-        case STMT_RETURN:
-            expr_free(s->return_stmt->value);
-            free(s->return_stmt);
-            break;
-        case STMT_BREAK:
-        case STMT_CONTINUE:
-            break;
-    }
-
-    free(s);
-}
-
 void stmt_dump(Stmt* s) {
     if (!s)
         return;
@@ -278,8 +222,8 @@ void stmt_dump(Stmt* s) {
     }
 }
 
-Expr* expr_new(ExprKind kind, int line, int col) {
-    Expr* e = malloc(sizeof(Expr));
+Expr* expr_new(Arena* arena, ExprKind kind, int line, int col) {
+    Expr* e = arena_alloc(arena, sizeof(Expr));
     if (!e)
         return NULL;
 
@@ -290,49 +234,46 @@ Expr* expr_new(ExprKind kind, int line, int col) {
     return e;
 }
 
-Expr* expr_new_literal(LiteralType type, StringView value, int line, int col) {
-    Expr* e = expr_new(EXPR_LITERAL, line, col);
+Expr* expr_new_literal(Arena* arena, LiteralType type, StringView value, int line, int col) {
+    Expr* e = expr_new(arena, EXPR_LITERAL, line, col);
     if (!e)
         return NULL;
 
-    e->literal = malloc(sizeof(LiteralExpr));
-    if (!e->literal) {
-        free(e);
+    e->literal = arena_alloc(arena, sizeof(LiteralExpr));
+    if (!e->literal)
         return NULL;
-    }
 
     e->literal->type = type;
     e->literal->value = value;
+    e->literal->object = NULL;
 
     return e;
 }
 
-Expr* expr_new_variable(StringView name, int line, int col) {
-    Expr* e = expr_new(EXPR_VARIABLE, line, col);
+Expr* expr_new_variable(Arena* arena, StringView name, int line, int col) {
+    Expr* e = expr_new(arena, EXPR_VARIABLE, line, col);
     if (!e)
         return NULL;
 
-    e->variable = malloc(sizeof(VariableExpr));
-    if (!e->variable) {
-        free(e);
+    e->variable = arena_alloc(arena, sizeof(VariableExpr));
+    if (!e->variable)
         return NULL;
-    }
 
     e->variable->name = name;
+    e->variable->scope = SYMBOL_UNRESOLVED;
+    e->variable->slot = 0;
 
     return e;
 }
 
-Expr* expr_new_unary(UnaryOp op, Expr* operand, int line, int col) {
-    Expr* e = expr_new(EXPR_UNARY, line, col);
+Expr* expr_new_unary(Arena* arena, UnaryOp op, Expr* operand, int line, int col) {
+    Expr* e = expr_new(arena, EXPR_UNARY, line, col);
     if (!e)
         return NULL;
 
-    e->unary = malloc(sizeof(UnaryExpr));
-    if (!e->unary) {
-        free(e);
+    e->unary = arena_alloc(arena, sizeof(UnaryExpr));
+    if (!e->unary)
         return NULL;
-    }
 
     e->unary->op = op;
     e->unary->operand = operand;
@@ -340,16 +281,14 @@ Expr* expr_new_unary(UnaryOp op, Expr* operand, int line, int col) {
     return e;
 }
 
-Expr* expr_new_binary(BinaryOp op, Expr* lhs, Expr* rhs, int line, int col) {
-    Expr* e = expr_new(EXPR_BINARY, line, col);
+Expr* expr_new_binary(Arena* arena, BinaryOp op, Expr* lhs, Expr* rhs, int line, int col) {
+    Expr* e = expr_new(arena, EXPR_BINARY, line, col);
     if (!e)
         return NULL;
 
-    e->binary = malloc(sizeof(BinaryExpr));
-    if (!e->binary) {
-        free(e);
+    e->binary = arena_alloc(arena, sizeof(BinaryExpr));
+    if (!e->binary)
         return NULL;
-    }
 
     e->binary->lhs = lhs;
     e->binary->rhs = rhs;
@@ -358,53 +297,23 @@ Expr* expr_new_binary(BinaryOp op, Expr* lhs, Expr* rhs, int line, int col) {
     return e;
 }
 
-Expr* expr_new_call(StringView name, Expr** args, int line, int col) {
-    Expr* e = expr_new(EXPR_CALL, line, col);
+Expr* expr_new_call(Arena* arena, StringView name, Expr** args, int line, int col) {
+    Expr* e = expr_new(arena, EXPR_CALL, line, col);
     if (!e)
         return NULL;
 
-    e->call = malloc(sizeof(CallExpr));
-    if (!e->call) {
-        free(e);
+    e->call = arena_alloc(arena, sizeof(CallExpr));
+    if (!e->call)
         return NULL;
-    }
 
     e->call->name = name;
     e->call->args = args;
+    e->call->scope = SYMBOL_UNRESOLVED;
+    e->call->slot = 0;
 
     return e;
 }
 
-void expr_free(Expr* e) {
-    if (!e)
-        return;
-
-    switch (e->kind) {
-        case EXPR_LITERAL:
-            free(e->literal);
-            break;
-        case EXPR_VARIABLE:
-            free(e->variable);
-            break;
-        case EXPR_UNARY:
-            expr_free(e->unary->operand);
-            free(e->unary);
-            break;
-        case EXPR_BINARY:
-            expr_free(e->binary->lhs);
-            expr_free(e->binary->rhs);
-            free(e->binary);
-            break;
-        case EXPR_CALL:
-            darray_for(e->call->args) expr_free(e->call->args[__i]);
-            darray_free(e->call->args);
-            free(e->call);
-            break;
-    }
-
-    free(e);
-}
-
 void expr_dump(Expr* e) {
     if (!e)
         return;
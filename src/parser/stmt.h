@@ -1,7 +1,10 @@
 #ifndef __NODE_H
 #define __NODE_H
 
+#include <stdint.h>
+
 #include "../utils/str.h"
+#include "../utils/arena.h"
 
 // NOTE TO MYSELF: ADD STMT_EXPR FOR EXPRESSIONS DONT DO ANYTHING BUT JUST EXISTS
 typedef enum {
@@ -53,6 +56,13 @@ typedef enum {
     UNARY_POST_DEC,
 } UnaryOp;
 
+// Where the analyser placed a name, globals live in the module's co_globals and locals in the frame
+typedef enum {
+    SYMBOL_UNRESOLVED,
+    SYMBOL_GLOBAL,
+    SYMBOL_LOCAL,
+} SymbolScope;
+
 typedef enum {
     EXPR_LITERAL,
     EXPR_VARIABLE,
@@ -81,15 +91,19 @@ typedef enum LiteralType {
     LITERAL_FLOAT,
     LITERAL_INT,
     LITERAL_NONE,
+    LITERAL_FOLDED, // Computed by the compiler's constant folding, "object" holds the value
 } LiteralType;
 
 typedef struct LiteralExpr {
     LiteralType type;
     StringView value;
+    struct MEObject* object;
 } LiteralExpr;
 
 typedef struct VariableExpr {
     StringView name;
+    SymbolScope scope; // Resolved by the analyser
+    uint32_t slot;
 } VariableExpr;
 
 typedef struct BinaryExpr {
@@ -101,6 +115,8 @@ typedef struct BinaryExpr {
 typedef struct CallExpr {
     StringView name; // Name of calle
     Expr** args; // Darray
+    SymbolScope scope; // Of the callee, resolved by the analyser
+    uint32_t slot;
 } CallExpr;
 
 typedef struct UnaryExpr {
@@ -134,6 +150,8 @@ typedef struct DeclStmt {
     StringView name;
     Expr* initializer;
     int is_const;
+    SymbolScope scope; // Resolved by the analyser
+    uint32_t slot;
 } DeclStmt;
 
 typedef struct WhileStmt {
@@ -151,32 +169,33 @@ typedef struct FunctionDeclStmt {
     StringView name;
     Expr** params;
     Stmt** body;
+    SymbolScope scope; // Of the function name, resolved by the analyser
+    uint32_t slot;
+    uint32_t nlocals; // Parameters and every local declared in the body
 } FunctionDeclStmt;
 
 typedef struct ReturnStmt {
     Expr* value;
 } ReturnStmt;
 
-Stmt* stmt_new(StmtKind kind, int line, int col);
-Stmt* stmt_new_compound(Stmt** stmts, int line, int col);
-Stmt* stmt_new_decl(StringView name, Expr* initializer, int is_const, int line, int col);
-Stmt* stmt_new_expr(Expr* expr, int line, int col);
-Stmt* stmt_new_while(Expr* condition, Stmt** body, int line, int col);
-Stmt* stmt_new_if(Expr* condition, Stmt** then_branch, Stmt* else_branch, int line, int col);
-Stmt* stmt_new_function_decl(StringView name, Expr** args, Stmt** body, int line, int col);
-Stmt* stmt_new_return(Expr* value, int line, int col);
-Stmt* stmt_new_break(int line, int col);
-Stmt* stmt_new_continue(int line, int col);
-void stmt_free(Stmt* s);
+Stmt* stmt_new(Arena* arena, StmtKind kind, int line, int col);
+Stmt* stmt_new_compound(Arena* arena, Stmt** stmts, int line, int col);
+Stmt* stmt_new_decl(Arena* arena, StringView name, Expr* initializer, int is_const, int line, int col);
+Stmt* stmt_new_expr(Arena* arena, Expr* expr, int line, int col);
+Stmt* stmt_new_while(Arena* arena, Expr* condition, Stmt** body, int line, int col);
+Stmt* stmt_new_if(Arena* arena, Expr* condition, Stmt** then_branch, Stmt* else_branch, int line, int col);
+Stmt* stmt_new_function_decl(Arena* arena, StringView name, Expr** args, Stmt** body, int line, int col);
+Stmt* stmt_new_return(Arena* arena, Expr* value, int line, int col);
+Stmt* stmt_new_break(Arena* arena, int line, int col);
+Stmt* stmt_new_continue(Arena* arena, int line, int col);
 void stmt_dump(Stmt* s);
 
-Expr* expr_new(ExprKind kind, int line, int col);
-Expr* expr_new_literal(LiteralType type, StringView value, int line, int col);
-Expr* expr_new_variable(StringView name, int line, int col);
-Expr* expr_new_binary(BinaryOp op, Expr* lhs, Expr* rhs, int line, int col);
-Expr* expr_new_call(StringView name, Expr** args, int line, int col);
-Expr* expr_new_unary(UnaryOp op, Expr* operand, int line, int col);
-void expr_free(Expr* e);
+Expr* expr_new(Arena* arena, ExprKind kind, int line, int col);
+Expr* expr_new_literal(Arena* arena, LiteralType type, StringView value, int line, int col);
+Expr* expr_new_variable(Arena* arena, StringView name, int line, int col);
+Expr* expr_new_binary(Arena* arena, BinaryOp op, Expr* lhs, Expr* rhs, int line, int col);
+Expr* expr_new_call(Arena* arena, StringView name, Expr** args, int line, int col);
+Expr* expr_new_unary(Arena* arena, UnaryOp op, Expr* operand, int line, int col);
 void expr_dump(Expr* e);
 
 #endif
\ No newline at end of file
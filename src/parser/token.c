@@ -5,8 +5,8 @@
 
 #include "../lut.h"
 
-Token* token_new(TokenType type, StringView value, int line, int col) {
-    Token* token = (Token*)malloc(sizeof(Token));
+Token* token_new(Arena* arena, TokenType type, StringView value, int line, int col) {
+    Token* token = (Token*)arena_alloc(arena, sizeof(Token));
     token->value = value;
     token->type = type;
     token->line = line;
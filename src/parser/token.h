@@ -2,6 +2,7 @@
 #define __TOKEN_H
 
 #include "../utils/str.h"
+#include "../utils/arena.h"
 
 typedef enum {
     TOKEN_EOF,
@@ -90,7 +91,7 @@ typedef struct {
     int col;
 } Token;
 
-Token* token_new(TokenType type, StringView value, int line, int col);
+Token* token_new(Arena* arena, TokenType type, StringView value, int line, int col);
 void token_dump(Token* token);
 
 #endif
\ No newline at end of file
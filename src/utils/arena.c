@@ -0,0 +1,79 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+// Front-end structs hold nothing wider than a pointer, malloc would round them up to 16
+#define ARENA_ALIGNMENT 8
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+// Chunks are chained through their header so they can be released in one go
+struct ArenaChunk {
+    ArenaChunk* next;
+    size_t size;
+};
+
+#define ARENA_CHUNK_HEADER ARENA_ALIGN(sizeof(ArenaChunk))
+
+Arena* arena_new() {
+    Arena* arena = (Arena*)calloc(1, sizeof(Arena));
+    return arena;
+}
+
+static int arena_new_chunk(Arena* arena, size_t min_size) {
+    size_t size = ARENA_CHUNK_SIZE;
+    if (min_size + ARENA_CHUNK_HEADER > size)
+        size = min_size + ARENA_CHUNK_HEADER;
+
+    ArenaChunk* chunk = (ArenaChunk*)malloc(size);
+    if (!chunk)
+        return 0;
+
+    chunk->next = arena->head;
+    chunk->size = size;
+    arena->head = chunk;
+
+    arena->bump = (char*)chunk + ARENA_CHUNK_HEADER;
+    arena->bump_end = (char*)chunk + size;
+    arena->stats.reserved += size;
+    arena->stats.chunks++;
+
+    return 1;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = ARENA_ALIGN(size);
+
+    if ((size_t)(arena->bump_end - arena->bump) < size && !arena_new_chunk(arena, size))
+        return NULL;
+
+    void* ptr = arena->bump;
+    arena->bump += size;
+    arena->stats.allocs++;
+    arena->stats.used += size;
+
+    return ptr;
+}
+
+void arena_free(Arena* arena) {
+    if (!arena)
+        return;
+
+    ArenaChunk* chunk = arena->head;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(arena);
+}
+
+void arena_dump_stats(Arena* arena, const char* name) {
+    ArenaStats* s = &arena->stats;
+    printf("Arena stats (%s):\n", name);
+    printf("  %zu allocations in %zu chunks (%zu mallocs saved)\n", s->allocs, s->chunks, s->allocs - s->chunks);
+    printf("  %zu bytes used, %zu bytes reserved\n", s->used, s->reserved);
+}
@@ -0,0 +1,31 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+// Bump pointer arena for things that die together, like the tokens and the AST. Memory is handed
+// out from big chunks and there is no per-allocation free, everything goes away with arena_free.
+
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    size_t allocs;      // Calls to arena_alloc, each one used to be a malloc
+    size_t used;        // Bytes handed out
+    size_t reserved;    // Bytes malloc'ed for chunks
+    size_t chunks;
+} ArenaStats;
+
+typedef struct {
+    ArenaChunk* head;
+    char* bump;
+    char* bump_end;
+    ArenaStats stats;
+} Arena;
+
+Arena* arena_new();
+void* arena_alloc(Arena* arena, size_t size);
+void arena_free(Arena* arena);
+
+void arena_dump_stats(Arena* arena, const char* name);
+
+#endif
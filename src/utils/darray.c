@@ -7,6 +7,7 @@ typedef struct _DArrayHeader {
     size_t size;
     size_t capacity;
     size_t stride;
+    Arena* arena; // NULL for malloc'ed darrays
 } DArrayHeader;
 
 #define DARRAY_MAX_LOAD 0.75f
@@ -22,6 +23,17 @@ void* __darray_new(size_t stride) {
     header->size = 0;
     header->capacity = DARRAY_INITIAL_CAPACITY;
     header->stride = stride;
+    header->arena = NULL;
+
+    return header + 1;
+}
+
+void* __darray_new_arena(size_t stride, Arena* arena) {
+    DArrayHeader* header = (DArrayHeader*)arena_alloc(arena, sizeof(DArrayHeader) + stride * DARRAY_INITIAL_CAPACITY);
+    header->size = 0;
+    header->capacity = DARRAY_INITIAL_CAPACITY;
+    header->stride = stride;
+    header->arena = arena;
 
     return header + 1;
 }
@@ -30,7 +42,13 @@ void __darray_push(void** da, void* value) {
     DArrayHeader* header = (DArrayHeader*)((char*)*da - sizeof(DArrayHeader));
     if ((float)header->size / header->capacity >= DARRAY_MAX_LOAD) {
         header->capacity *= DARRAY_GROWTH_FACTOR;
-        header = (DArrayHeader*)realloc(header, sizeof(DArrayHeader) + header->stride * header->capacity);
+        if (header->arena) {
+            DArrayHeader* grown = (DArrayHeader*)arena_alloc(header->arena, sizeof(DArrayHeader) + header->stride * header->capacity);
+            memcpy(grown, header, sizeof(DArrayHeader) + header->stride * header->size);
+            header = grown;
+        } else {
+            header = (DArrayHeader*)realloc(header, sizeof(DArrayHeader) + header->stride * header->capacity);
+        }
         *da = header + 1;
     }
 
@@ -44,7 +62,7 @@ void __darray_pop(void** da) {
     if (header->size == 0)
         return;
 
-    if ((float)header->size / header->capacity <= DARRAY_MIN_LOAD && header->capacity > DARRAY_INITIAL_CAPACITY) {
+    if (!header->arena && (float)header->size / header->capacity <= DARRAY_MIN_LOAD && header->capacity > DARRAY_INITIAL_CAPACITY) {
         header->capacity *= DARRAY_SHRINK_FACTOR;
         header = (DArrayHeader*)realloc(header, sizeof(DArrayHeader) + header->stride * header->capacity);
         *da = header + 1;
@@ -71,5 +89,9 @@ void __darray_set_member(void* da, size_t index, size_t value) {
 }
 
 void __darray_free(void* da) {
-    free((char*)da - sizeof(DArrayHeader));
+    DArrayHeader* header = (DArrayHeader*)((char*)da - sizeof(DArrayHeader));
+    if (header->arena)
+        return; // Released with its arena
+
+    free(header);
 }
\ No newline at end of file
@@ -3,12 +3,16 @@
 
 #include <stddef.h>
 
+#include "arena.h"
+
 typedef void (*darray_callback_t)(void* value, size_t index, void* usr);
 
 #define darray_for(arr) for (size_t __i = 0; __i < darray_size(arr); ++__i)
 // #define darray_foreach(arr, type, var)
 
 #define darray_new(type) __darray_new(sizeof(type))
+// Arena backed darrays grow by copying into a fresh arena block and are never freed on their own
+#define darray_new_arena(type, arena) __darray_new_arena(sizeof(type), (arena))
 #define darray_free(da) __darray_free((void*)(da))
 #define darray_iterate(da, callback, usr) __darray_iterate((void*)(da), callback, (usr))
 #define darray_push(da, value) __darray_push((void**)&(da), &(value))
@@ -27,6 +31,7 @@ typedef void (*darray_callback_t)(void* value, size_t index, void* usr);
 #define darray_set_stride(da, value) __darray_set_member(da, 2, value)
 
 void* __darray_new(size_t stride);
+void* __darray_new_arena(size_t stride, Arena* arena);
 void __darray_push(void** da, void* value);
 void __darray_iterate(void* da, darray_callback_t callback, void* usr);
 void __darray_free(void* da);
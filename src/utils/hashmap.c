@@ -20,22 +20,34 @@ typedef struct _HashMap {
     HashEntry* entries;
 } HashMap;
 
+// MurmurHash3 x86_32
 static uint32_t murmurhash3(const void* key, size_t len) {
+    const uint8_t* data = (const uint8_t*)key;
     uint32_t h = 0xc6a4a793;
     uint32_t k;
-    const uint8_t* data = (const uint8_t*)key;
-    while (len >= 4) {
+    size_t n = len;
+
+    while (n >= 4) {
         memcpy(&k, data, 4);
-        k *= h; k ^= k >> 16; k *= h;
-        h ^= k; h *= h;
-        data += 4; len -= 4;
+        k *= 0xcc9e2d51; k = (k << 15) | (k >> 17); k *= 0x1b873593;
+        h ^= k; h = (h << 13) | (h >> 19); h = h * 5 + 0xe6546b64;
+        data += 4; n -= 4;
     }
 
-    while (len--) {
-        h ^= (uint32_t)(*data++);
-        h *= 0x5bd1e995;
+    k = 0;
+    switch (n) {
+        case 3: k ^= (uint32_t)data[2] << 16; // fallthrough
+        case 2: k ^= (uint32_t)data[1] << 8;  // fallthrough
+        case 1: k ^= data[0];
+            k *= 0xcc9e2d51; k = (k << 15) | (k >> 17); k *= 0x1b873593;
+            h ^= k;
     }
 
+    h ^= (uint32_t)len;
+    h ^= h >> 16; h *= 0x85ebca6b;
+    h ^= h >> 13; h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
     return h;
 }
 
@@ -58,6 +70,7 @@ static void hashmap_resize(HashMap* map) {
         }
     }
 
+    free(map->entries);
     map->entries = new_entries;
     map->capacity = new_capacity;
 }
@@ -0,0 +1,146 @@
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define ME_ALLOC_GRANULARITY 16
+#define ME_ALLOC_MAX_SIZE 128
+#define ME_ALLOC_CLASSES (ME_ALLOC_MAX_SIZE / ME_ALLOC_GRANULARITY)
+
+#define ME_ALLOC_CACHE_LINE 64
+#define ME_ALLOC_SLAB_SIZE (16 * 1024)
+
+#define ME_ALLOC_CLASS(size) (((size) + ME_ALLOC_GRANULARITY - 1) / ME_ALLOC_GRANULARITY - 1)
+#define ME_ALLOC_CLASS_SIZE(cls) (((cls) + 1) * ME_ALLOC_GRANULARITY)
+
+typedef struct MEFreeBlock {
+    struct MEFreeBlock* next;
+} MEFreeBlock;
+
+// Slabs are chained through their first cache line so they can be released at exit
+typedef struct MESlab {
+    struct MESlab* next;
+} MESlab;
+
+typedef struct {
+    MEFreeBlock* free_list;
+    char* bump;
+    char* bump_end;
+    MEAllocStats stats;
+} MEPool;
+
+static MEPool pools[ME_ALLOC_CLASSES];
+static MEAllocStats large_stats; // Objects bigger than ME_ALLOC_MAX_SIZE
+static MESlab* slabs = NULL;
+
+static int pool_new_slab(MEPool* pool) {
+    MESlab* slab = aligned_alloc(ME_ALLOC_CACHE_LINE, ME_ALLOC_SLAB_SIZE);
+    if (!slab)
+        return 0;
+
+    slab->next = slabs;
+    slabs = slab;
+
+    pool->bump = (char*)slab + ME_ALLOC_CACHE_LINE;
+    pool->bump_end = (char*)slab + ME_ALLOC_SLAB_SIZE;
+    pool->stats.slabs++;
+
+    return 1;
+}
+
+MEObject* me_object_alloc(METypeObject* type) {
+    MEObject* obj;
+
+#ifndef ME_ALLOC_USE_MALLOC
+    if (type->tp_sizeof <= ME_ALLOC_MAX_SIZE) {
+        MEPool* pool = &pools[ME_ALLOC_CLASS(type->tp_sizeof)];
+        size_t block_size = ME_ALLOC_CLASS_SIZE(ME_ALLOC_CLASS(type->tp_sizeof));
+
+        if (pool->free_list) {
+            obj = (MEObject*)pool->free_list;
+            pool->free_list = pool->free_list->next;
+            pool->stats.hits++;
+        } else {
+            if ((size_t)(pool->bump_end - pool->bump) < block_size && !pool_new_slab(pool))
+                return NULL;
+
+            obj = (MEObject*)pool->bump;
+            pool->bump += block_size;
+            pool->stats.misses++;
+        }
+    } else
+#endif
+    {
+        obj = malloc(type->tp_sizeof);
+        if (!obj)
+            return NULL;
+
+        large_stats.misses++;
+    }
+
+    obj->ob_type = type;
+    obj->ob_refcount = 1;
+
+    return obj;
+}
+
+void me_object_free(MEObject* obj) {
+    size_t size = ME_TYPE(obj)->tp_sizeof;
+
+#ifndef ME_ALLOC_USE_MALLOC
+    if (size <= ME_ALLOC_MAX_SIZE) {
+        MEPool* pool = &pools[ME_ALLOC_CLASS(size)];
+        MEFreeBlock* block = (MEFreeBlock*)obj;
+        block->next = pool->free_list;
+        pool->free_list = block;
+        pool->stats.frees++;
+        return;
+    }
+#endif
+
+    free(obj);
+    large_stats.frees++;
+}
+
+MEAllocStats me_alloc_stats() {
+    MEAllocStats total = large_stats;
+    for (size_t i = 0; i < ME_ALLOC_CLASSES; i++) {
+        total.hits += pools[i].stats.hits;
+        total.misses += pools[i].stats.misses;
+        total.frees += pools[i].stats.frees;
+        total.slabs += pools[i].stats.slabs;
+    }
+
+    return total;
+}
+
+void me_alloc_dump_stats() {
+    printf("Allocator:\n");
+    for (size_t i = 0; i < ME_ALLOC_CLASSES; i++) {
+        MEAllocStats* s = &pools[i].stats;
+        if (!s->hits && !s->misses)
+            continue;
+
+        printf("  %4zu bytes: hits %zu, misses %zu, frees %zu, slabs %zu\n", (size_t)ME_ALLOC_CLASS_SIZE(i), s->hits, s->misses, s->frees, s->slabs);
+    }
+
+    if (large_stats.misses)
+        printf("  large: allocs %zu, frees %zu\n", large_stats.misses, large_stats.frees);
+
+    MEAllocStats total = me_alloc_stats();
+    printf("  total: hits %zu, misses %zu, frees %zu, slabs %zu\n", total.hits, total.misses, total.frees, total.slabs);
+}
+
+void me_alloc_free_all() {
+    while (slabs) {
+        MESlab* next = slabs->next;
+        free(slabs);
+        slabs = next;
+    }
+
+    for (size_t i = 0; i < ME_ALLOC_CLASSES; i++) {
+        pools[i].free_list = NULL;
+        pools[i].bump = NULL;
+        pools[i].bump_end = NULL;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef __ALLOC_H
+#define __ALLOC_H
+
+#include <stddef.h>
+
+#include "object.h"
+
+// Objects are carved from cache line aligned slabs and recycled through free lists, one list per
+// size class. The class of an object is picked from its type's tp_sizeof, so every constructor
+// and tp_dealloc goes through me_object_alloc/me_object_free instead of malloc/free.
+// Build with -DME_ALLOC_USE_MALLOC to fall back to plain malloc/free, handy for sanitizers.
+
+typedef struct {
+    size_t hits;    // Served from a free list
+    size_t misses;  // Carved from a slab or malloc'ed
+    size_t frees;
+    size_t slabs;
+} MEAllocStats;
+
+MEObject* me_object_alloc(METypeObject* type);
+void me_object_free(MEObject* obj);
+
+MEAllocStats me_alloc_stats();
+void me_alloc_dump_stats();
+void me_alloc_free_all();
+
+#endif
@@ -5,7 +5,6 @@
 
 #include "../objects/builtinfnobject.h"
 
-#include "../../utils/hashmap.h"
 #include "../../utils/darray.h"
 #include "../../utils/str.h"
 
@@ -22,9 +21,8 @@
 #define ME_BUILTIN_CAST_STR      "cümle"
 #define ME_BUILTIN_CAST_BOOL     "doğruluk"
 
+// Builtins take the first global slots, both lists below must register them in the same order
 #define REGISTER_BUILTIN_CO(co, name, func) do { \
-    uintptr_t idx = darray_size((co)->co_globals); \
-    hashmap_set((co)->co_h_globals, hashmap_lit_str(name), (uintptr_t)idx); \
     darray_pushd((co)->co_globals, me_builtinfn_new(name, func)); \
 } while(0)
 
@@ -33,6 +31,7 @@
     sym->nargs = num_args; \
     sym->is_initialized = 1; \
     scope_define((analyser)->current_scope, sym); \
+    analyser_bind((analyser), sym, 0); \
 } while(0)
 
 StringView strv_from_cstr(const char* str) {
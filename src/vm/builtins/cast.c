@@ -10,10 +10,8 @@
 #include "../objects/noneobject.h"
 #include "../objects/strobject.h"
 
-#include "../../utils/darray.h"
-
-MEObject* me_typecast_int(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_typecast_int(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "int() expects one argument");
         return NULL;
     }
@@ -21,6 +19,7 @@ MEObject* me_typecast_int(MEObject* self, MEObject** args) {
     MEObject* obj = args[0];
 
     if (me_long_check(obj)) {
+        ME_INCREF(obj);
         return obj;
     }
     
@@ -60,8 +59,8 @@ MEObject* me_typecast_int(MEObject* self, MEObject** args) {
     return NULL;
 }
 
-MEObject* me_typecast_float(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_typecast_float(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "float() expects one argument");
         return NULL;
     }
@@ -69,12 +68,12 @@ MEObject* me_typecast_float(MEObject* self, MEObject** args) {
     MEObject* obj = args[0];
 
     if (me_float_check(obj)) {
+        ME_INCREF(obj);
         return obj;
     }
     
     if (me_long_check(obj)) {
-        MELongObject* long_obj = (MELongObject*)obj;
-        return me_float_from_double((double)long_obj->ob_value);
+        return me_float_from_double((double)me_long_value(obj));
     }
     
     if (me_str_check(obj)) {
@@ -107,16 +106,18 @@ MEObject* me_typecast_float(MEObject* self, MEObject** args) {
     return NULL;
 }
 
-MEObject* me_typecast_str(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_typecast_str(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "str() expects one argument");
         return NULL;
     }
 
     MEObject* obj = args[0];
 
-    if (me_str_check(obj))
+    if (me_str_check(obj)) {
+        ME_INCREF(obj);
         return obj;
+    }
     
     if (ME_TYPE(obj)->tp_str)
         return ME_TYPE(obj)->tp_str(obj);
@@ -125,16 +126,18 @@ MEObject* me_typecast_str(MEObject* self, MEObject** args) {
     return NULL;
 }
 
-MEObject* me_typecast_bool(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_typecast_bool(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "bool() expects one argument");
         return NULL;
     }
 
     MEObject* obj = args[0];
 
-    if (me_bool_check(obj))
+    if (me_bool_check(obj)) {
+        ME_INCREF(obj);
         return obj;
+    }
     
     if (ME_TYPE(obj)->tp_bool)
         return ME_TYPE(obj)->tp_bool(obj);
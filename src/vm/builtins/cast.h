@@ -3,9 +3,9 @@
 
 #include "../object.h"
 
-MEObject* me_typecast_int(MEObject* self, MEObject** args);
-MEObject* me_typecast_float(MEObject* self, MEObject** args);
-MEObject* me_typecast_str(MEObject* self, MEObject** args);
-MEObject* me_typecast_bool(MEObject* self, MEObject** args);
+MEObject* me_typecast_int(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_typecast_float(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_typecast_str(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_typecast_bool(MEObject* self, MEObject** args, size_t nargs);
 
 #endif
\ No newline at end of file
@@ -4,7 +4,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#include "../../utils/darray.h"
 
 #include "../objects/errorobject.h"
 #include "../objects/strobject.h"
@@ -12,8 +11,8 @@
 #include "../objects/fileobject.h"
 #include "../objects/longobject.h"
 
-MEObject* me_io_print(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_io_print(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "print() expects one argument");
         return NULL;
     }
@@ -22,6 +21,7 @@ MEObject* me_io_print(MEObject* self, MEObject** args) {
         if (ME_TYPE(args[0])->tp_str) {
             MEStrObject* str_obj = (MEStrObject*)ME_TYPE(args[0])->tp_str(args[0]);
             printf("%.*s\n", (int)str_obj->ob_bytelength, str_obj->ob_value);
+            ME_DECREF((MEObject*)str_obj);
             return me_none;
         } else {
             me_set_error(me_error_typemismatch, "print() expects a string argument");
@@ -35,18 +35,18 @@ MEObject* me_io_print(MEObject* self, MEObject** args) {
     return me_none;
 }
 
-MEObject* me_io_input(MEObject* self, MEObject** args) {
-    if (args && darray_size(args) > 1) {
+MEObject* me_io_input(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs > 1) {
         me_set_error(me_error_typemismatch, "input() does take zero or one argument");
         return NULL;
     }
 
-    if (args && darray_size(args) == 1 && !me_str_check(args[0])) {
+    if (nargs == 1 && !me_str_check(args[0])) {
         me_set_error(me_error_typemismatch, "input() expects a string argument");
         return NULL;
     }
     
-    if (args && darray_size(args) == 1) {
+    if (nargs == 1) {
         MEStrObject* prompt_obj = (MEStrObject*)args[0];
         printf("%.*s", (int)prompt_obj->ob_bytelength, prompt_obj->ob_value);
     }
@@ -79,8 +79,8 @@ MEObject* me_io_input(MEObject* self, MEObject** args) {
     return result;
 }
 
-MEObject* me_io_open(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 2) {
+MEObject* me_io_open(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 2) {
         me_set_error(me_error_typemismatch, "open() expects a filename and mode");
         return NULL;
     }
@@ -117,8 +117,8 @@ MEObject* me_io_open(MEObject* self, MEObject** args) {
     return file_obj;
 }
 
-MEObject* me_io_close(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_io_close(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "close() expects a file object");
         return NULL;
     }
@@ -147,8 +147,8 @@ MEObject* me_io_close(MEObject* self, MEObject** args) {
     return me_none;
 }
 
-MEObject* me_io_read(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 2) {
+MEObject* me_io_read(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 2) {
         me_set_error(me_error_typemismatch, "read() expects a file object and size");
         return NULL;
     }
@@ -159,7 +159,7 @@ MEObject* me_io_read(MEObject* self, MEObject** args) {
     }
 
     MEFileObject* file_obj = (MEFileObject*)args[0];
-    long size = ((MELongObject*)args[1])->ob_value;
+    long size = me_long_value(args[1]);
     
     if (file_obj->ob_closed || !file_obj->ob_file) {
         me_set_error(me_error_generic, "File is closed");
@@ -194,8 +194,8 @@ MEObject* me_io_read(MEObject* self, MEObject** args) {
     return result;
 }
 
-MEObject* me_io_write(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 2) {
+MEObject* me_io_write(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 2) {
         me_set_error(me_error_typemismatch, "write() expects a file object and string");
         return NULL;
     }
@@ -218,8 +218,8 @@ MEObject* me_io_write(MEObject* self, MEObject** args) {
     return me_long_from_long(bytes_written);
 }
 
-MEObject* me_io_flush(MEObject* self, MEObject** args) {
-    if (!args || darray_size(args) != 1) {
+MEObject* me_io_flush(MEObject* self, MEObject** args, size_t nargs) {
+    if (nargs != 1) {
         me_set_error(me_error_typemismatch, "flush() expects a file object");
         return NULL;
     }
@@ -3,12 +3,12 @@
 
 #include "../object.h"
 
-MEObject* me_io_print(MEObject* self, MEObject** args);
-MEObject* me_io_input(MEObject* self, MEObject** args);
-MEObject* me_io_open(MEObject* self, MEObject** args);
-MEObject* me_io_close(MEObject* self, MEObject** args);
-MEObject* me_io_read(MEObject* self, MEObject** args);
-MEObject* me_io_write(MEObject* self, MEObject** args);
-MEObject* me_io_flush(MEObject* self, MEObject** args);
+MEObject* me_io_print(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_io_input(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_io_open(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_io_close(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_io_read(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_io_write(MEObject* self, MEObject** args, size_t nargs);
+MEObject* me_io_flush(MEObject* self, MEObject** args, size_t nargs);
 
 #endif
\ No newline at end of file
@@ -3,11 +3,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/mman.h>
 
+#include "../utils/arena.h"
 #include "../utils/hashmap.h"
 #include "../utils/darray.h"
 #include "../utils/utf8.h"
 
+#include "objects/boolobject.h"
 #include "objects/functionobject.h"
 #include "objects/floatobject.h"
 #include "objects/longobject.h"
@@ -16,44 +19,292 @@
 
 #include "builtins/builtin.h"
 
+#include "reg.h"
+
 #define ME_CO_INITIAL_CAPACITY 256
 
-// NOTE: MOVING THIS IN OP/OPERAND CREATOR FUNCTIONS MAY BE BETTER
-static void lnotab_forward(MECodeObject* co, uint8_t offset, int line) {
-    static int last_line = 0;
-    darray_pushd(co->co_lnotab, offset);
+// A new entry only when the line changes, straight line code of one statement shares a single entry
+void co_line_mark(MECodeObject* co) {
+    if (co->co_nlines > 0 && co->co_lines[co->co_nlines - 1].line == (uint32_t)co->co_line)
+        return;
 
-    int line_delta = darray_size(co->co_lnotab) > 1 ? line - last_line : line;
-    if (line_delta > 255) {
-        darray_pushd(co->co_lnotab, 255);
-        line_delta -= 255;
+    MECodeLine entry = { .offset = co->co_size, .line = co->co_line };
+    darray_push(co->co_lines, entry);
+    co->co_nlines++;
+}
 
-        while (line_delta > 255) {
-            darray_pushd(co->co_lnotab, 0);
-            darray_pushd(co->co_lnotab, 255);
-            line_delta -= 255;
-        }
-    } else {
-        darray_pushd(co->co_lnotab, line_delta);
+uint32_t co_line_from_offset(MECodeObject* co, uint32_t offset) {
+    // Last entry starting at or before offset
+    uint32_t lo = 0;
+    uint32_t hi = co->co_nlines;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (co->co_lines[mid].offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    last_line = line;
+    return lo > 0 ? co->co_lines[lo - 1].line : 0;
 }
 
-int lnotab_get_line_from_ip(uint8_t* lnotab, uint32_t ip) {
-    int offset = 0;
-    int line = 1;
-    int i = 0;
-    while (offset < ip) {
-        offset += lnotab[i];
-        line += lnotab[i + 1];
-        i += 2;
-    }
-
-    return line;
+MECoOptions co_options = {
+    .fold = 1,
+    .peephole = 1,
+    .registers = 0,
+};
+
+// Net stack effect of every opcode, the calls also take their argument count off, see co_stack_effect
+const int8_t co_op_stack_effect[CO_OP_COUNT] = {
+    [CO_OP_NOP] = 0,
+    [CO_OP_LOAD_CONST] = 1,
+    [CO_OP_LOAD_GLOBAL] = 1,
+    [CO_OP_LOAD_VARIABLE] = 1,
+    [CO_OP_STORE_GLOBAL] = -1,
+    [CO_OP_STORE_VARIABLE] = -1,
+    [CO_OP_BINARY_OP] = -1,
+    [CO_OP_UNARY_OP] = 0,
+    [CO_OP_CALL_FUNCTION] = 0,
+    [CO_OP_RETURN] = -1,
+    [CO_OP_DUP] = 1,
+    [CO_OP_POP] = -1,
+    [CO_OP_JUMP_REL] = 0,
+    [CO_OP_JUMP_IF_FALSE] = -1,
+    [CO_OP_JUMP_IF_FALSE_OR_POP] = -1, // When falling through, the jump keeps the value as the result
+    [CO_OP_JUMP_IF_TRUE_OR_POP] = -1,
+    [CO_OP_COMPARE_JUMP_IF_FALSE] = -2,
+    [CO_OP_INC_LOCAL] = 0,
+    [CO_OP_INC_GLOBAL] = 0,
+    [CO_OP_BINARY_OP_INPLACE_LOCAL] = -1,
+    [CO_OP_BINARY_OP_INPLACE_GLOBAL] = -1,
+    [CO_OP_EXTENDED_ARG] = 0,
+    [CO_OP_TAIL_CALL] = -1,
+    [CO_OP_BINARY_ADD ... CO_OP_COMPARE_GTE_FLOAT] = -1,
+    [CO_OP_CALL_EXACT_ARGS] = 0,
+    [CO_OP_CALL_BUILTIN] = 0,
+};
+
+// Values taken off the stack, calls take their argument count on top of the function
+const uint8_t co_op_pops[CO_OP_COUNT] = {
+    [CO_OP_NOP] = 0,
+    [CO_OP_LOAD_CONST] = 0,
+    [CO_OP_LOAD_GLOBAL] = 0,
+    [CO_OP_LOAD_VARIABLE] = 0,
+    [CO_OP_STORE_GLOBAL] = 1,
+    [CO_OP_STORE_VARIABLE] = 1,
+    [CO_OP_BINARY_OP] = 2,
+    [CO_OP_UNARY_OP] = 1,
+    [CO_OP_CALL_FUNCTION] = 1,
+    [CO_OP_RETURN] = 1,
+    [CO_OP_DUP] = 1,
+    [CO_OP_POP] = 1,
+    [CO_OP_JUMP_REL] = 0,
+    [CO_OP_JUMP_IF_FALSE] = 1,
+    [CO_OP_JUMP_IF_FALSE_OR_POP] = 1,
+    [CO_OP_JUMP_IF_TRUE_OR_POP] = 1,
+    [CO_OP_COMPARE_JUMP_IF_FALSE] = 2,
+    [CO_OP_INC_LOCAL] = 0,
+    [CO_OP_INC_GLOBAL] = 0,
+    [CO_OP_BINARY_OP_INPLACE_LOCAL] = 1,
+    [CO_OP_BINARY_OP_INPLACE_GLOBAL] = 1,
+    [CO_OP_EXTENDED_ARG] = 0,
+    [CO_OP_TAIL_CALL] = 1,
+    [CO_OP_BINARY_ADD ... CO_OP_COMPARE_GTE_FLOAT] = 2,
+    [CO_OP_CALL_EXACT_ARGS] = 1,
+    [CO_OP_CALL_BUILTIN] = 1,
+};
+
+// Opcode plus operands, in bytes. Superinstructions and borrowed loads have none, they only exist in decoded code.
+const uint8_t co_op_size[CO_OP_COUNT] = {
+    [CO_OP_NOP] = 1,
+    [CO_OP_LOAD_CONST] = 3,
+    [CO_OP_LOAD_GLOBAL] = 3,
+    [CO_OP_LOAD_VARIABLE] = 3,
+    [CO_OP_STORE_GLOBAL] = 3,
+    [CO_OP_STORE_VARIABLE] = 3,
+    [CO_OP_BINARY_OP] = 2,
+    [CO_OP_UNARY_OP] = 2,
+    [CO_OP_CALL_FUNCTION] = 4,
+    [CO_OP_RETURN] = 1,
+    [CO_OP_DUP] = 1,
+    [CO_OP_POP] = 1,
+    [CO_OP_JUMP_REL] = 3,
+    [CO_OP_JUMP_IF_FALSE] = 3,
+    [CO_OP_JUMP_IF_FALSE_OR_POP] = 3,
+    [CO_OP_JUMP_IF_TRUE_OR_POP] = 3,
+    [CO_OP_COMPARE_JUMP_IF_FALSE] = 4,
+    [CO_OP_INC_LOCAL] = 4,
+    [CO_OP_INC_GLOBAL] = 4,
+    [CO_OP_BINARY_OP_INPLACE_LOCAL] = 4,
+    [CO_OP_BINARY_OP_INPLACE_GLOBAL] = 4,
+    [CO_OP_EXTENDED_ARG] = 3,
+    [CO_OP_TAIL_CALL] = 2,
+    [CO_OP_BINARY_ADD ... CO_OP_BINARY_MOD] = 3,
+    [CO_OP_BINARY_BIT_AND ... CO_OP_BINARY_RSHIFT] = 1,
+    [CO_OP_COMPARE_EQ ... CO_OP_COMPARE_GTE_FLOAT] = 3,
+    [CO_OP_CALL_EXACT_ARGS] = 4,
+    [CO_OP_CALL_BUILTIN] = 4,
+};
+
+// Binary ops with a dedicated opcode, assignment stays on CO_OP_BINARY_OP and the logical ops are jumps
+static const uint8_t co_binop_to_op[] = {
+    [BIN_ADD] = CO_OP_BINARY_ADD,
+    [BIN_SUB] = CO_OP_BINARY_SUB,
+    [BIN_MUL] = CO_OP_BINARY_MUL,
+    [BIN_DIV] = CO_OP_BINARY_DIV,
+    [BIN_MOD] = CO_OP_BINARY_MOD,
+    [BIN_BIT_AND] = CO_OP_BINARY_BIT_AND,
+    [BIN_BIT_OR] = CO_OP_BINARY_BIT_OR,
+    [BIN_BIT_XOR] = CO_OP_BINARY_BIT_XOR,
+    [BIN_BIT_LSHIFT] = CO_OP_BINARY_LSHIFT,
+    [BIN_BIT_RSHIFT] = CO_OP_BINARY_RSHIFT,
+    [BIN_EQ] = CO_OP_COMPARE_EQ,
+    [BIN_NEQ] = CO_OP_COMPARE_NEQ,
+    [BIN_LT] = CO_OP_COMPARE_LT,
+    [BIN_LTE] = CO_OP_COMPARE_LTE,
+    [BIN_GT] = CO_OP_COMPARE_GT,
+    [BIN_GTE] = CO_OP_COMPARE_GTE,
+};
+
+const char* co_op_names[CO_OP_COUNT] = {
+    [CO_OP_NOP] = "NOP",
+    [CO_OP_LOAD_CONST] = "LOAD_CONST",
+    [CO_OP_LOAD_GLOBAL] = "LOAD_GLOBAL",
+    [CO_OP_LOAD_VARIABLE] = "LOAD_VARIABLE",
+    [CO_OP_STORE_GLOBAL] = "STORE_GLOBAL",
+    [CO_OP_STORE_VARIABLE] = "STORE_VARIABLE",
+    [CO_OP_BINARY_OP] = "BINARY_OP",
+    [CO_OP_UNARY_OP] = "UNARY_OP",
+    [CO_OP_CALL_FUNCTION] = "CALL_FUNCTION",
+    [CO_OP_RETURN] = "RETURN",
+    [CO_OP_DUP] = "DUP",
+    [CO_OP_POP] = "POP",
+    [CO_OP_JUMP_REL] = "JUMP_REL",
+    [CO_OP_JUMP_IF_FALSE] = "JUMP_IF_FALSE",
+    [CO_OP_JUMP_IF_FALSE_OR_POP] = "JUMP_IF_FALSE_OR_POP",
+    [CO_OP_JUMP_IF_TRUE_OR_POP] = "JUMP_IF_TRUE_OR_POP",
+    [CO_OP_COMPARE_JUMP_IF_FALSE] = "COMPARE_JUMP_IF_FALSE",
+    [CO_OP_INC_LOCAL] = "INC_LOCAL",
+    [CO_OP_INC_GLOBAL] = "INC_GLOBAL",
+    [CO_OP_BINARY_OP_INPLACE_LOCAL] = "BINARY_OP_INPLACE_LOCAL",
+    [CO_OP_BINARY_OP_INPLACE_GLOBAL] = "BINARY_OP_INPLACE_GLOBAL",
+    [CO_OP_EXTENDED_ARG] = "EXTENDED_ARG",
+    [CO_OP_TAIL_CALL] = "TAIL_CALL",
+    [CO_OP_BINARY_ADD] = "BINARY_ADD",
+    [CO_OP_BINARY_SUB] = "BINARY_SUB",
+    [CO_OP_BINARY_MUL] = "BINARY_MUL",
+    [CO_OP_BINARY_DIV] = "BINARY_DIV",
+    [CO_OP_BINARY_MOD] = "BINARY_MOD",
+    [CO_OP_BINARY_BIT_AND] = "BINARY_BIT_AND",
+    [CO_OP_BINARY_BIT_OR] = "BINARY_BIT_OR",
+    [CO_OP_BINARY_BIT_XOR] = "BINARY_BIT_XOR",
+    [CO_OP_BINARY_LSHIFT] = "BINARY_LSHIFT",
+    [CO_OP_BINARY_RSHIFT] = "BINARY_RSHIFT",
+    [CO_OP_COMPARE_EQ] = "COMPARE_EQ",
+    [CO_OP_COMPARE_NEQ] = "COMPARE_NEQ",
+    [CO_OP_COMPARE_LT] = "COMPARE_LT",
+    [CO_OP_COMPARE_LTE] = "COMPARE_LTE",
+    [CO_OP_COMPARE_GT] = "COMPARE_GT",
+    [CO_OP_COMPARE_GTE] = "COMPARE_GTE",
+    [CO_OP_BINARY_ADD_LONG] = "BINARY_ADD_LONG",
+    [CO_OP_BINARY_SUB_LONG] = "BINARY_SUB_LONG",
+    [CO_OP_BINARY_MUL_LONG] = "BINARY_MUL_LONG",
+    [CO_OP_BINARY_DIV_LONG] = "BINARY_DIV_LONG",
+    [CO_OP_BINARY_MOD_LONG] = "BINARY_MOD_LONG",
+    [CO_OP_BINARY_ADD_FLOAT] = "BINARY_ADD_FLOAT",
+    [CO_OP_BINARY_SUB_FLOAT] = "BINARY_SUB_FLOAT",
+    [CO_OP_BINARY_MUL_FLOAT] = "BINARY_MUL_FLOAT",
+    [CO_OP_BINARY_DIV_FLOAT] = "BINARY_DIV_FLOAT",
+    [CO_OP_COMPARE_EQ_LONG] = "COMPARE_EQ_LONG",
+    [CO_OP_COMPARE_NEQ_LONG] = "COMPARE_NEQ_LONG",
+    [CO_OP_COMPARE_LT_LONG] = "COMPARE_LT_LONG",
+    [CO_OP_COMPARE_LTE_LONG] = "COMPARE_LTE_LONG",
+    [CO_OP_COMPARE_GT_LONG] = "COMPARE_GT_LONG",
+    [CO_OP_COMPARE_GTE_LONG] = "COMPARE_GTE_LONG",
+    [CO_OP_COMPARE_EQ_FLOAT] = "COMPARE_EQ_FLOAT",
+    [CO_OP_COMPARE_NEQ_FLOAT] = "COMPARE_NEQ_FLOAT",
+    [CO_OP_COMPARE_LT_FLOAT] = "COMPARE_LT_FLOAT",
+    [CO_OP_COMPARE_LTE_FLOAT] = "COMPARE_LTE_FLOAT",
+    [CO_OP_COMPARE_GT_FLOAT] = "COMPARE_GT_FLOAT",
+    [CO_OP_COMPARE_GTE_FLOAT] = "COMPARE_GTE_FLOAT",
+    [CO_OP_CALL_EXACT_ARGS] = "CALL_EXACT_ARGS",
+    [CO_OP_CALL_BUILTIN] = "CALL_BUILTIN",
+    [CO_OP_LOAD_VARIABLE_VARIABLE] = "LOAD_VARIABLE_VARIABLE",
+    [CO_OP_LOAD_GLOBAL_VARIABLE] = "LOAD_GLOBAL_VARIABLE",
+    [CO_OP_LOAD_GLOBAL_GLOBAL] = "LOAD_GLOBAL_GLOBAL",
+    [CO_OP_LOAD_VARIABLE_STORE_VARIABLE] = "LOAD_VARIABLE_STORE_VARIABLE",
+    [CO_OP_LOAD_GLOBAL_STORE_GLOBAL] = "LOAD_GLOBAL_STORE_GLOBAL",
+    [CO_OP_LOAD_VARIABLE_INPLACE_LOCAL] = "LOAD_VARIABLE_INPLACE_LOCAL",
+    [CO_OP_LOAD_GLOBAL_INPLACE_GLOBAL] = "LOAD_GLOBAL_INPLACE_GLOBAL",
+    [CO_OP_LOAD_VARIABLE_CONST_ADD] = "LOAD_VARIABLE_CONST_ADD",
+    [CO_OP_LOAD_VARIABLE_CONST_SUB] = "LOAD_VARIABLE_CONST_SUB",
+    [CO_OP_LOAD_VARIABLE_CONST_COMPARE_JUMP] = "LOAD_VARIABLE_CONST_COMPARE_JUMP",
+    [CO_OP_LOAD_GLOBAL_CONST_COMPARE_JUMP] = "LOAD_GLOBAL_CONST_COMPARE_JUMP",
+    [CO_OP_LOAD_CONST_BORROWED] = "LOAD_CONST_BORROWED",
+    [CO_OP_LOAD_GLOBAL_BORROWED] = "LOAD_GLOBAL_BORROWED",
+    [CO_OP_LOAD_VARIABLE_BORROWED] = "LOAD_VARIABLE_BORROWED",
+};
+
+// Adaptive instruction every quickened form falls back to
+const uint8_t co_op_deopt[CO_OP_COUNT] = {
+    [CO_OP_BINARY_ADD_LONG] = CO_OP_BINARY_ADD,
+    [CO_OP_BINARY_SUB_LONG] = CO_OP_BINARY_SUB,
+    [CO_OP_BINARY_MUL_LONG] = CO_OP_BINARY_MUL,
+    [CO_OP_BINARY_DIV_LONG] = CO_OP_BINARY_DIV,
+    [CO_OP_BINARY_MOD_LONG] = CO_OP_BINARY_MOD,
+    [CO_OP_BINARY_ADD_FLOAT] = CO_OP_BINARY_ADD,
+    [CO_OP_BINARY_SUB_FLOAT] = CO_OP_BINARY_SUB,
+    [CO_OP_BINARY_MUL_FLOAT] = CO_OP_BINARY_MUL,
+    [CO_OP_BINARY_DIV_FLOAT] = CO_OP_BINARY_DIV,
+    [CO_OP_COMPARE_EQ_LONG] = CO_OP_COMPARE_EQ,
+    [CO_OP_COMPARE_NEQ_LONG] = CO_OP_COMPARE_NEQ,
+    [CO_OP_COMPARE_LT_LONG] = CO_OP_COMPARE_LT,
+    [CO_OP_COMPARE_LTE_LONG] = CO_OP_COMPARE_LTE,
+    [CO_OP_COMPARE_GT_LONG] = CO_OP_COMPARE_GT,
+    [CO_OP_COMPARE_GTE_LONG] = CO_OP_COMPARE_GTE,
+    [CO_OP_COMPARE_EQ_FLOAT] = CO_OP_COMPARE_EQ,
+    [CO_OP_COMPARE_NEQ_FLOAT] = CO_OP_COMPARE_NEQ,
+    [CO_OP_COMPARE_LT_FLOAT] = CO_OP_COMPARE_LT,
+    [CO_OP_COMPARE_LTE_FLOAT] = CO_OP_COMPARE_LTE,
+    [CO_OP_COMPARE_GT_FLOAT] = CO_OP_COMPARE_GT,
+    [CO_OP_COMPARE_GTE_FLOAT] = CO_OP_COMPARE_GTE,
+    [CO_OP_CALL_EXACT_ARGS] = CO_OP_CALL_FUNCTION,
+    [CO_OP_CALL_BUILTIN] = CO_OP_CALL_FUNCTION,
+};
+
+// Run of instructions every superinstruction replaces, CO_OP_NOP past the end of shorter ones. The
+// head of the run gets the superinstruction, the rest stay as they are for their operands and for
+// the handler to fall back on. Adding a fusion takes an opcode, a row here and a handler.
+const uint8_t co_op_fuses[CO_OP_COUNT][CO_FUSE_MAX] = {
+    [CO_OP_LOAD_VARIABLE_VARIABLE] = { CO_OP_LOAD_VARIABLE, CO_OP_LOAD_VARIABLE },
+    [CO_OP_LOAD_GLOBAL_VARIABLE] = { CO_OP_LOAD_GLOBAL, CO_OP_LOAD_VARIABLE },
+    [CO_OP_LOAD_GLOBAL_GLOBAL] = { CO_OP_LOAD_GLOBAL, CO_OP_LOAD_GLOBAL },
+    [CO_OP_LOAD_VARIABLE_STORE_VARIABLE] = { CO_OP_LOAD_VARIABLE, CO_OP_STORE_VARIABLE },
+    [CO_OP_LOAD_GLOBAL_STORE_GLOBAL] = { CO_OP_LOAD_GLOBAL, CO_OP_STORE_GLOBAL },
+    [CO_OP_LOAD_VARIABLE_INPLACE_LOCAL] = { CO_OP_LOAD_VARIABLE, CO_OP_BINARY_OP_INPLACE_LOCAL },
+    [CO_OP_LOAD_GLOBAL_INPLACE_GLOBAL] = { CO_OP_LOAD_GLOBAL, CO_OP_BINARY_OP_INPLACE_GLOBAL },
+    [CO_OP_LOAD_VARIABLE_CONST_ADD] = { CO_OP_LOAD_VARIABLE, CO_OP_LOAD_CONST, CO_OP_BINARY_ADD },
+    [CO_OP_LOAD_VARIABLE_CONST_SUB] = { CO_OP_LOAD_VARIABLE, CO_OP_LOAD_CONST, CO_OP_BINARY_SUB },
+    [CO_OP_LOAD_VARIABLE_CONST_COMPARE_JUMP] = { CO_OP_LOAD_VARIABLE, CO_OP_LOAD_CONST, CO_OP_COMPARE_JUMP_IF_FALSE },
+    [CO_OP_LOAD_GLOBAL_CONST_COMPARE_JUMP] = { CO_OP_LOAD_GLOBAL, CO_OP_LOAD_CONST, CO_OP_COMPARE_JUMP_IF_FALSE },
+};
+
+// Every jump lands where the stack is as deep as on the path falling through to it, the short-circuit
+// jumps in the middle of an expression included as the value they keep stands in for the rhs. So
+// following the bytecode linearly is enough to find the deepest point the stack can reach.
+static void co_stack_effect(MECodeObject* co, uint8_t op, uint32_t operand) {
+    if (op == CO_OP_CALL_FUNCTION || op == CO_OP_CALL_EXACT_ARGS || op == CO_OP_CALL_BUILTIN || op == CO_OP_TAIL_CALL)
+        co->stack_depth += co_op_stack_effect[op] - (int)operand; // Pops function and arguments, a call pushes the result
+    else
+        co->stack_depth += co_op_stack_effect[op];
+
+    if (co->stack_depth > (int)co->co_stacksize)
+        co->co_stacksize = co->stack_depth;
 }
 
 static void co_bc_op(MECodeObject* co, uint8_t op) {
+    co_line_mark(co);
+    co_stack_effect(co, op, 0);
     if (co->co_size + 1 > co->co_capacity) {
         co->co_capacity *= 2;
         co->co_bytecode = (uint8_t*)realloc(co->co_bytecode, co->co_capacity);
@@ -62,8 +313,97 @@ static void co_bc_op(MECodeObject* co, uint8_t op) {
     co->co_bytecode[co->co_size++] = op;
 }
 
+static void co_bc_emit(MECodeObject* co, uint8_t op, uint32_t operand, uint16_t operand_size) {
+    co_line_mark(co);
+    co_stack_effect(co, op, operand);
+    if (co->co_size + 1 + operand_size > co->co_capacity) {
+        co->co_capacity *= 2;
+        co->co_bytecode = (uint8_t*)realloc(co->co_bytecode, co->co_capacity);
+    }
+
+    co->co_bytecode[co->co_size++] = op;
+    memcpy(&co->co_bytecode[co->co_size], &operand, operand_size);
+    co->co_size += operand_size;
+}
+
+// u16 operands that do not fit get an EXTENDED_ARG prefix with the high half
 static void co_bc_opoperand(MECodeObject* co, uint8_t op, uint32_t operand, uint16_t operand_size) {
-    if (co->co_size + 3 > co->co_capacity) {
+    if (operand_size == 2 && !co_arg_fits(op, operand))
+        co_bc_emit(co, CO_OP_EXTENDED_ARG, co_arg_high(op, operand), 2);
+
+    co_bc_emit(co, op, operand, operand_size);
+}
+
+// Jump to a target that is not compiled yet, returns the position of the jump for co_bc_patch_jump.
+// Its distance is unknown so it always gets a prefix, co_narrow drops the ones that were not needed.
+// "operand" goes in front of the offset for jumps that have one.
+static uint32_t co_bc_jump_forward(MECodeObject* co, uint8_t op, uint8_t operand) {
+    co_bc_emit(co, CO_OP_EXTENDED_ARG, 0, 2);
+    uint32_t pos = co->co_size;
+    co_bc_emit(co, op, operand, co_op_size[op] - 1);
+    return pos;
+}
+
+static void co_bc_patch_jump(MECodeObject* co, uint32_t pos, uint32_t target) {
+    uint8_t size = co_op_size[co->co_bytecode[pos]];
+    uint32_t offset = target - (pos + size);
+    uint16_t high = co_arg_high(co->co_bytecode[pos], offset);
+    uint16_t low = offset & 0xFFFF;
+    memcpy(&co->co_bytecode[pos - 2], &high, 2);
+    memcpy(&co->co_bytecode[pos + size - 2], &low, 2);
+}
+
+// Jump to code that is already emitted
+static void co_bc_jump_to(MECodeObject* co, uint8_t op, uint32_t target) {
+    uint32_t offset = target - (co->co_size + 3);
+    if (!co_arg_fits(op, offset))
+        offset -= 3; // The prefix comes first and moves the end of the jump
+
+    co_bc_opoperand(co, op, offset, 2);
+}
+
+// Loads and stores of a name go straight to the slot the analyser gave it
+static void co_bc_load(MECodeObject* co, SymbolScope scope, uint32_t slot) {
+    co_bc_opoperand(co, scope == SYMBOL_LOCAL ? CO_OP_LOAD_VARIABLE : CO_OP_LOAD_GLOBAL, slot, 2);
+}
+
+static void co_bc_store(MECodeObject* co, SymbolScope scope, uint32_t slot) {
+    co_bc_opoperand(co, scope == SYMBOL_LOCAL ? CO_OP_STORE_VARIABLE : CO_OP_STORE_GLOBAL, slot, 2);
+}
+
+// In-place update of a slot, "arg" comes first and the slot takes the u16 operand
+static void co_bc_update(MECodeObject* co, SymbolScope scope, uint8_t local_op, uint8_t global_op, uint8_t arg, uint32_t slot) {
+    uint8_t op = scope == SYMBOL_LOCAL ? local_op : global_op;
+    if (!co_arg_fits(op, slot))
+        co_bc_emit(co, CO_OP_EXTENDED_ARG, co_arg_high(op, slot), 2);
+
+    co_bc_emit(co, op, arg | (slot & 0xFFFF) << 8, 3);
+}
+
+// Arithmetic, comparisons and calls are quickened at runtime and carry an inline cache index
+static int co_op_has_cache(uint8_t op) {
+    return (op >= CO_OP_BINARY_ADD && op <= CO_OP_BINARY_MOD)
+        || (op >= CO_OP_COMPARE_EQ && op <= CO_OP_CALL_BUILTIN)
+        || op == CO_OP_CALL_FUNCTION;
+}
+
+// Emits a quickenable instruction, its operand (if any) is followed by the u16 index of a fresh cache
+static void co_bc_cached(MECodeObject* co, uint8_t op, uint32_t operand, uint16_t operand_size) {
+    uint32_t idx = darray_size(co->co_caches);
+    if (idx > UINT16_MAX)
+        co_bc_emit(co, CO_OP_EXTENDED_ARG, idx >> 16, 2);
+
+    MECodeCache cache = {
+        .offset = co->co_size,
+        .counter = 0, // Specialize on the first execution
+        .cached = NULL,
+    };
+
+    darray_push(co->co_caches, cache);
+
+    co_line_mark(co);
+    co_stack_effect(co, op, operand);
+    if (co->co_size + 1 + operand_size + 2 > co->co_capacity) {
         co->co_capacity *= 2;
         co->co_bytecode = (uint8_t*)realloc(co->co_bytecode, co->co_capacity);
     }
@@ -71,9 +411,12 @@ static void co_bc_opoperand(MECodeObject* co, uint8_t op, uint32_t operand, uint
     co->co_bytecode[co->co_size++] = op;
     memcpy(&co->co_bytecode[co->co_size], &operand, operand_size);
     co->co_size += operand_size;
+    memcpy(&co->co_bytecode[co->co_size], &idx, 2);
+    co->co_size += 2;
 }
 
-static uint16_t co_add_literal(MECodeObject* co, LiteralExpr* literal) {
+// New reference to the value of a literal, NULL if it can not be created
+MEObject* co_literal_object(LiteralExpr* literal) {
     MEObject* obj = NULL;
     
     switch (literal->type) {
@@ -83,21 +426,15 @@ static uint16_t co_add_literal(MECodeObject* co, LiteralExpr* literal) {
             temp[literal->value.byte_len] = '\0';
             obj = me_str_from_str(temp);
             free(temp);
-            if (obj == NULL)
-                return 0;
-
             break;
         }
         case LITERAL_INT: {
             char* temp = malloc(literal->value.len + 1);
             memcpy(temp, literal->value.data, literal->value.len);
             temp[literal->value.len] = '\0';
-            int value = atoi(temp);
+            long value = strtol(temp, NULL, 10);
             free(temp);
             obj = me_long_from_long(value);
-            if (obj == NULL)
-                return 0;
-
             break;
         }
         case LITERAL_FLOAT: {
@@ -112,67 +449,282 @@ static uint16_t co_add_literal(MECodeObject* co, LiteralExpr* literal) {
         case LITERAL_NONE:
             obj = me_none;
             break;
+        case LITERAL_FOLDED:
+            obj = literal->object;
+            ME_INCREF(obj);
+            break;
     }
-    
-    if (obj == NULL)
+
+    return obj;
+}
+
+// Interning key of a constant, a type tag followed by its value. Returns the key size, 0 (and no key)
+// for objects that are never interned or when the key cannot be allocated.
+static size_t co_const_key(MEObject* obj, uint8_t** key) {
+    const void* value;
+    size_t value_size;
+    long long_value;
+    uint8_t bool_value;
+    uint8_t tag;
+
+    if (obj == me_none) {
+        tag = 'n';
+        value = NULL;
+        value_size = 0;
+    } else if (obj == me_true || obj == me_false) {
+        tag = 'b';
+        bool_value = obj == me_true;
+        value = &bool_value;
+        value_size = 1;
+    } else if (me_long_check(obj)) {
+        tag = 'l';
+        long_value = me_long_value(obj);
+        value = &long_value;
+        value_size = sizeof(long_value);
+    } else if (me_float_check(obj)) {
+        tag = 'f';
+        value = &((MEFloatObject*)obj)->ob_value; // Bitwise, 0.0 and -0.0 stay apart
+        value_size = sizeof(double);
+    } else if (me_str_check(obj)) {
+        tag = 's';
+        value = ((MEStrObject*)obj)->ob_value;
+        value_size = ((MEStrObject*)obj)->ob_bytelength;
+    } else {
         return 0;
-    
-    uint16_t idx = darray_size(co->co_consts);
+    }
+
+    *key = malloc(1 + value_size);
+    if (!*key)
+        return 0; // Still added, only without sharing its slot
+
+    (*key)[0] = tag;
+    if (value_size)
+        memcpy(*key + 1, value, value_size);
+    return 1 + value_size;
+}
+
+// Keys are borrowed by the hashmaps, copies live in the arena until the module is compiled
+static const uint8_t* co_const_key_copy(MECodeObject* co, const uint8_t* key, size_t key_size) {
+    uint8_t* copy = arena_alloc(co->co_const_arena, key_size);
+    memcpy(copy, key, key_size);
+    return copy;
+}
+
+// Takes over "obj" and returns its index in co_consts. Equal constants share one slot per code object
+// and one object per module, they are immutable so the functions can use the module's objects.
+uint32_t co_add_const(MECodeObject* co, MEObject* obj) {
+    uint8_t* key = NULL;
+    size_t key_size = co_const_key(obj, &key);
+
+    uintptr_t idx;
+    if (key_size && hashmap_get(co->co_h_consts, key, key_size, &idx)) {
+        free(key);
+        ME_DECREF(obj);
+        return idx;
+    }
+
+    // Tagged ints and the static singletons are not allocations, there is nothing to share
+    if (key_size && !ME_IS_TAGGED_INT(obj) && key[0] != 'n' && key[0] != 'b') {
+        uintptr_t interned;
+        if (hashmap_get(co->co_h_interned, key, key_size, &interned)) {
+            ME_DECREF(obj);
+            obj = (MEObject*)interned;
+            ME_INCREF(obj);
+        } else {
+            hashmap_set(co->co_h_interned, co_const_key_copy(co, key, key_size), key_size, (uintptr_t)obj);
+        }
+    }
+
+    idx = darray_size(co->co_consts);
     darray_pushd(co->co_consts, obj);
+
+    if (key_size)
+        hashmap_set(co->co_h_consts, co_const_key_copy(co, key, key_size), key_size, idx);
+
+    free(key);
     return idx;
 }
 
-static void co_compile_expr(MECodeObject* co, Expr* expr) {
-    if (!expr)
-        return;
+uint32_t co_add_literal(MECodeObject* co, LiteralExpr* literal) {
+    MEObject* obj = co_literal_object(literal);
+    if (obj == NULL)
+        return 0;
+    
+    return co_add_const(co, obj);
+}
+
+// Interning tables are shared with "parent" (the module), NULL for the module itself
+void co_init_consts(MECodeObject* co, MECodeObject* parent) {
+    co->co_h_consts = hashmap_new();
+    co->co_h_interned = parent ? parent->co_h_interned : hashmap_new();
+    co->co_const_arena = parent ? parent->co_const_arena : arena_new();
+
+    // IDX 0 IS RESERVED FOR NONE OBJECT, IDX 1 IS RESERVED FOR INT 1 OBJECT
+    co_add_const(co, me_none);
+    co_add_const(co, me_long_from_long(1));
+}
+
+// The interning tables are only needed while compiling
+void co_drop_consts(MECodeObject* co, int owner) {
+    hashmap_free(co->co_h_consts);
+    co->co_h_consts = NULL;
+
+    if (owner) {
+        hashmap_free(co->co_h_interned);
+        arena_free(co->co_const_arena);
+    }
+
+    co->co_h_interned = NULL;
+    co->co_const_arena = NULL;
+}
+
+// Globals are left to the caller, function code objects share them with the module
+MECodeObject* co_alloc(const char* name, size_t name_size, size_t capacity) {
+    MECodeObject* co = malloc(sizeof(MECodeObject));
+    co->co_name = malloc(name_size + 1);
+    memcpy(co->co_name, name, name_size);
+    co->co_name[name_size] = '\0';
+
+    co->co_consts = darray_new(MEObject*);
+    co->co_globals = NULL;
+
+    co->co_h_consts = NULL;
+    co->co_h_interned = NULL;
+    co->co_const_arena = NULL;
+    co->co_lines = darray_new(MECodeLine);
+    co->co_nlines = 0;
+    co->co_line = 0;
+    co->co_caches = darray_new(MECodeCache);
+    co->co_capacity = capacity;
+    co->co_bytecode = (uint8_t*)malloc(co->co_capacity);
+    memset(co->co_bytecode, 0, co->co_capacity);
+    co->co_mapped = 0;
+    co->co_image = NULL;
+    co->co_image_size = 0;
+    co->co_instrs = NULL;
+    co->co_ninstrs = 0;
+    co->co_register = 0;
+    co->co_nregs = 0;
+    co->co_size = 0;
+    co->co_nlocals = 0;
+    co->co_stacksize = 0;
+    co->in_function = 0;
+    co->stack_depth = 0;
+    co->loop_start = 0;
+    co->loop_end_jump = 0;
+    co->loop_end_pos = 0;
+    co->break_patches = darray_new(uint32_t);
+
+    return co;
+}
+
+static void co_compile_expr(MECodeObject* co, Expr* expr);
+static void co_compile_stmt(MECodeObject* co, Stmt* stmt);
+
+// No calls and no writes, evaluating it can not change a variable
+static int co_expr_is_pure(Expr* expr) {
+    switch (expr->kind) {
+        case EXPR_LITERAL:
+        case EXPR_VARIABLE:
+            return 1;
+        case EXPR_UNARY: {
+            UnaryOp op = expr->unary->op;
+            if (op == UNARY_PRE_INC || op == UNARY_PRE_DEC || op == UNARY_POST_INC || op == UNARY_POST_DEC)
+                return 0;
+
+            return co_expr_is_pure(expr->unary->operand);
+        }
+        case EXPR_BINARY:
+            return expr->binary->op != BIN_ASSIGN && co_expr_is_pure(expr->binary->lhs) && co_expr_is_pure(expr->binary->rhs);
+        default:
+            return 0;
+    }
+}
+
+// "x = x op rhs" (compound assignments included) updates the slot of x in place, a small int added
+// or subtracted becomes an increment. The rhs runs before x is read here, so it must not write to x.
+static int co_compile_inplace(MECodeObject* co, BinaryExpr* assign) {
+    Expr* value = assign->rhs;
+    if (value->kind != EXPR_BINARY || value->binary->lhs->kind != EXPR_VARIABLE)
+        return 0;
+
+    BinaryOp op = value->binary->op;
+    if (!(op >= BIN_ADD && op <= BIN_MOD) && !(op >= BIN_BIT_AND && op <= BIN_BIT_RSHIFT))
+        return 0;
 
+    VariableExpr* var = assign->lhs->variable;
+    VariableExpr* operand = value->binary->lhs->variable;
+    if (var->scope != operand->scope || var->slot != operand->slot || !co_expr_is_pure(value->binary->rhs))
+        return 0;
+
+    Expr* rhs = value->binary->rhs;
+    long delta = 0;
+    if ((op == BIN_ADD || op == BIN_SUB) && rhs->kind == EXPR_LITERAL) {
+        MEObject* obj = co_literal_object(rhs->literal);
+        if (obj && ME_IS_TAGGED_INT(obj) && ME_TAGGED_INT_VALUE(obj) > 0 && ME_TAGGED_INT_VALUE(obj) <= INT8_MAX)
+            delta = op == BIN_ADD ? ME_TAGGED_INT_VALUE(obj) : -ME_TAGGED_INT_VALUE(obj);
+
+        if (obj)
+            ME_DECREF(obj);
+    }
+
+    if (delta) {
+        co_bc_update(co, var->scope, CO_OP_INC_LOCAL, CO_OP_INC_GLOBAL, (uint8_t)(int8_t)delta, var->slot);
+    } else {
+        co_compile_expr(co, rhs);
+        co_bc_update(co, var->scope, CO_OP_BINARY_OP_INPLACE_LOCAL, CO_OP_BINARY_OP_INPLACE_GLOBAL, op, var->slot);
+    }
+
+    return 1;
+}
+
+// Arguments are pushed left to right so they already sit in parameter order right above the
+// function object, the callee's locals window starts at the first one
+static void co_compile_call_operands(MECodeObject* co, CallExpr* call) {
+    co_bc_load(co, call->scope, call->slot);
+    for (size_t i = 0; i < darray_size(call->args); i++)
+        co_compile_expr(co, call->args[i]);
+}
+
+static void co_compile_expr_kind(MECodeObject* co, Expr* expr) {
     uintptr_t idx = 0;
     switch (expr->kind) {
         case EXPR_LITERAL: {
             idx = co_add_literal(co, expr->literal);
             co_bc_opoperand(co, CO_OP_LOAD_CONST, idx, 2);
-            lnotab_forward(co, 3, expr->line);
             break;
         }
         case EXPR_VARIABLE: {
-            StringView var_name = expr->variable->name;
-            
-            if (!co->in_function) {
-                if (hashmap_get(co->co_h_globals, expr->variable->name.data, expr->variable->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_globals, expr->variable->name.data, expr->variable->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_LOAD_GLOBAL, idx, 2);
-                } else if (hashmap_get(co->co_h_locals, expr->variable->name.data, expr->variable->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_locals, expr->variable->name.data, expr->variable->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_LOAD_VARIABLE, idx, 2);
-                }
-            } else {
-                if (hashmap_get(co->co_h_locals, expr->variable->name.data, expr->variable->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_locals, expr->variable->name.data, expr->variable->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_LOAD_VARIABLE, idx, 2);
-                } else if (hashmap_get(co->co_h_globals, expr->variable->name.data, expr->variable->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_globals, expr->variable->name.data, expr->variable->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_LOAD_GLOBAL, idx, 2);
-                }
-            }
-            lnotab_forward(co, 3, expr->line);
+            co_bc_load(co, expr->variable->scope, expr->variable->slot);
             break;
         }
         case EXPR_BINARY: {
+                if (expr->binary->op == BIN_ASSIGN && co_compile_inplace(co, expr->binary))
+                    break;
+
+                if (expr->binary->op == BIN_AND || expr->binary->op == BIN_OR) {
+                    // The rhs only runs when the lhs doesn't decide the result, either operand is the value
+                    co_compile_expr(co, expr->binary->lhs);
+                    uint32_t jump = co_bc_jump_forward(co, expr->binary->op == BIN_AND ? CO_OP_JUMP_IF_FALSE_OR_POP : CO_OP_JUMP_IF_TRUE_OR_POP, 0);
+                    co_compile_expr(co, expr->binary->rhs);
+                    co_bc_patch_jump(co, jump, co->co_size);
+                    break;
+                }
+
                 co_compile_expr(co, expr->binary->lhs);
                 co_compile_expr(co, expr->binary->rhs);
                 
-                co_bc_opoperand(co, CO_OP_BINARY_OP, expr->binary->op, 1);
-                lnotab_forward(co, 2, expr->line);
-                
-                if (expr->binary->op == BIN_ASSIGN) {
-                    if (hashmap_get(co->co_h_locals, expr->binary->lhs->variable->name.data, expr->binary->lhs->variable->name.byte_len, NULL)) {
-                        hashmap_get(co->co_h_locals, expr->binary->lhs->variable->name.data, expr->binary->lhs->variable->name.byte_len, (uintptr_t*)&idx);
-                        co_bc_opoperand(co, CO_OP_STORE_VARIABLE, idx, 2);
-                    } else if (hashmap_get(co->co_h_globals, expr->binary->lhs->variable->name.data, expr->binary->lhs->variable->name.byte_len, NULL)) {
-                        hashmap_get(co->co_h_globals, expr->binary->lhs->variable->name.data, expr->binary->lhs->variable->name.byte_len, (uintptr_t*)&idx);
-                        co_bc_opoperand(co, CO_OP_STORE_GLOBAL, idx, 2);
-                    }
+                uint8_t op = co_binop_to_op[expr->binary->op];
+                if (op && co_op_has_cache(op)) {
+                    co_bc_cached(co, op, 0, 0);
+                } else if (op) {
+                    co_bc_op(co, op);
+                } else {
+                    co_bc_opoperand(co, CO_OP_BINARY_OP, expr->binary->op, 1);
                 }
+                
+                if (expr->binary->op == BIN_ASSIGN)
+                    co_bc_store(co, expr->binary->lhs->variable->scope, expr->binary->lhs->variable->slot);
 
             break;
         }
@@ -180,71 +732,64 @@ static void co_compile_expr(MECodeObject* co, Expr* expr) {
             UnaryOp op = expr->unary->op;
 
             if (op == UNARY_PRE_INC || op == UNARY_PRE_DEC || op == UNARY_POST_INC || op == UNARY_POST_DEC) {
-                co_compile_expr(co, expr->unary->operand);
-        
+                VariableExpr* var = expr->unary->operand->variable;
+                int8_t delta = op == UNARY_PRE_INC || op == UNARY_POST_INC ? 1 : -1;
+
+                // The value is the variable before or after the update
                 if (op == UNARY_POST_INC || op == UNARY_POST_DEC)
-                    co_bc_op(co, CO_OP_DUP);
+                    co_bc_load(co, var->scope, var->slot);
 
-                co_bc_opoperand(co, CO_OP_LOAD_CONST, 1, 2);
-                if (op == UNARY_PRE_INC || op == UNARY_POST_INC)
-                    co_bc_opoperand(co, CO_OP_BINARY_OP, BIN_ADD, 1);
-                else
-                    co_bc_opoperand(co, CO_OP_BINARY_OP, BIN_SUB, 1);
+                co_bc_update(co, var->scope, CO_OP_INC_LOCAL, CO_OP_INC_GLOBAL, (uint8_t)delta, var->slot);
 
                 if (op == UNARY_PRE_INC || op == UNARY_PRE_DEC)
-                        co_bc_op(co, CO_OP_DUP);
-
-                uintptr_t idx = 0;
-                if (hashmap_get(co->co_h_locals, expr->unary->operand->variable->name.data, expr->unary->operand->variable->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_locals, expr->unary->operand->variable->name.data, expr->unary->operand->variable->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_STORE_VARIABLE, idx, 2);
-                } else if (hashmap_get(co->co_h_globals, expr->unary->operand->variable->name.data, expr->unary->operand->variable->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_globals, expr->unary->operand->variable->name.data, expr->unary->operand->variable->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_STORE_GLOBAL, idx, 2);
-                }
-                
-                lnotab_forward(co, 7, expr->line);
+                    co_bc_load(co, var->scope, var->slot);
             } else {
                 co_compile_expr(co, expr->unary->operand);
                 co_bc_opoperand(co, CO_OP_UNARY_OP, op, 1);
-                lnotab_forward(co, 2, expr->line);
             }
             break;
         }
         case EXPR_CALL: {
-            if (hashmap_get(co->co_h_globals, expr->call->name.data, expr->call->name.byte_len, NULL)) {
-                hashmap_get(co->co_h_globals, expr->call->name.data, expr->call->name.byte_len, (uintptr_t*)&idx);
-                co_bc_opoperand(co, CO_OP_LOAD_GLOBAL, idx, 2);
-            } else if (hashmap_get(co->co_h_locals, expr->call->name.data, expr->call->name.byte_len, NULL)) {
-                hashmap_get(co->co_h_locals, expr->call->name.data, expr->call->name.byte_len, (uintptr_t*)&idx);
-                co_bc_opoperand(co, CO_OP_LOAD_VARIABLE, idx, 2);
-            }
-
-            lnotab_forward(co, 3, expr->line);
-
-            for (int i = darray_size(expr->call->args) - 1; i >= 0; i--)
-                co_compile_expr(co, expr->call->args[i]);
-
-            co_bc_opoperand(co, CO_OP_CALL_FUNCTION, darray_size(expr->call->args), 1);
-            lnotab_forward(co, 2, expr->line);
+            co_compile_call_operands(co, expr->call);
+            co_bc_cached(co, CO_OP_CALL_FUNCTION, darray_size(expr->call->args), 1);
             break;
         }
     }
 }
 
-static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
-    if (!stmt)
-        return;
-    
-    uintptr_t idx = 0;
+// Condition of a şayet or madem plus the jump taken when it is false, returns the jump for
+// co_bc_patch_jump. A comparison fuses with the jump, no bool object is made for it.
+static uint32_t co_compile_condition(MECodeObject* co, Expr* condition) {
+    if (condition->kind != EXPR_BINARY || condition->binary->op < BIN_EQ || condition->binary->op > BIN_GTE) {
+        co_compile_expr(co, condition);
+        return co_bc_jump_forward(co, CO_OP_JUMP_IF_FALSE, 0);
+    }
+
+    co_compile_expr(co, condition->binary->lhs);
+    co_compile_expr(co, condition->binary->rhs);
+
+    int line = co->co_line;
+    co->co_line = condition->line; // Of the comparison, it can still fail
+    uint32_t jump = co_bc_jump_forward(co, CO_OP_COMPARE_JUMP_IF_FALSE, condition->binary->op);
+    co->co_line = line;
+    return jump;
+}
+
+static void co_compile_stmt_kind(MECodeObject* co, Stmt* stmt) {
 
     switch (stmt->kind) {
         case STMT_EXPR:
+            // A dropped post increment is a pre increment, whose load the peephole pass can take with the POP
+            if (stmt->expr_stmt->kind == EXPR_UNARY && stmt->expr_stmt->unary->op == UNARY_POST_INC)
+                stmt->expr_stmt->unary->op = UNARY_PRE_INC;
+            else if (stmt->expr_stmt->kind == EXPR_UNARY && stmt->expr_stmt->unary->op == UNARY_POST_DEC)
+                stmt->expr_stmt->unary->op = UNARY_PRE_DEC;
+
             co_compile_expr(co, stmt->expr_stmt);
-            if (stmt->expr_stmt->binary->op != BIN_ASSIGN)
+            // Assignments already consume their value with the store, anything else leaves one behind
+            if (stmt->expr_stmt->kind != EXPR_BINARY || stmt->expr_stmt->binary->op != BIN_ASSIGN)
                 co_bc_op(co, CO_OP_POP);
 
-            lnotab_forward(co, 1, stmt->line);
             break;
         case STMT_DECL: {
             if (stmt->decl_stmt->initializer)
@@ -252,28 +797,7 @@ static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
             else
                 co_bc_opoperand(co, CO_OP_LOAD_CONST, 0, 2);
 
-            if (!co->in_function) {
-                if (hashmap_get(co->co_h_globals, stmt->decl_stmt->name.data, stmt->decl_stmt->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_globals, stmt->decl_stmt->name.data, stmt->decl_stmt->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_STORE_GLOBAL, idx, 2);
-                } else {
-                    idx = darray_size(co->co_globals);
-                    hashmap_set(co->co_h_globals, stmt->decl_stmt->name.data, stmt->decl_stmt->name.byte_len, (uintptr_t)idx);
-                    darray_pushd(co->co_globals, me_none);
-                    co_bc_opoperand(co, CO_OP_STORE_GLOBAL, idx, 2);
-                }
-            } else {
-                if (hashmap_get(co->co_h_locals, stmt->decl_stmt->name.data, stmt->decl_stmt->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_locals, stmt->decl_stmt->name.data, stmt->decl_stmt->name.byte_len, (uintptr_t*)&idx);
-                    co_bc_opoperand(co, CO_OP_STORE_VARIABLE, idx, 2);
-                } else {
-                    idx = darray_size(co->co_locals);
-                    hashmap_set(co->co_h_locals, stmt->decl_stmt->name.data, stmt->decl_stmt->name.byte_len, (uintptr_t)idx);
-                    darray_pushd(co->co_locals, me_none);
-                    co_bc_opoperand(co, CO_OP_STORE_VARIABLE, idx, 2);
-                }
-            }
-
+            co_bc_store(co, stmt->decl_stmt->scope, stmt->decl_stmt->slot);
             break;
         }
         case STMT_COMPOUND: {
@@ -283,135 +807,85 @@ static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
             break;
         }
         case STMT_RETURN: {
-            if (stmt->return_stmt->value)
-                co_compile_expr(co, stmt->return_stmt->value);
+            // Nothing is left to do in this frame after a returned call, the callee runs in it instead
+            Expr* value = stmt->return_stmt->value;
+            if (co->in_function && value && value->kind == EXPR_CALL) {
+                co_compile_call_operands(co, value->call);
+                co_bc_emit(co, CO_OP_TAIL_CALL, darray_size(value->call->args), 1);
+                break;
+            }
+
+            if (value)
+                co_compile_expr(co, value);
             else
                 co_bc_opoperand(co, CO_OP_LOAD_CONST, 0, 2);
 
             co_bc_op(co, CO_OP_RETURN);
-            lnotab_forward(co, 1, stmt->line);
             break;
         }
         case STMT_IF: {
-            co_compile_expr(co, stmt->if_stmt->condition);
-            
-            // Save position for the conditional jump
-            uint16_t then_branch_start = co->co_size;
-            co_bc_opoperand(co, CO_OP_JUMP_IF_FALSE, 0, 2);
-            lnotab_forward(co, 3, stmt->line);
+            uint32_t then_jump = co_compile_condition(co, stmt->if_stmt->condition);
 
             // Compile the "then" branch
             for (size_t i = 0; i < darray_size(stmt->if_stmt->then_branch); i++) {
                 co_compile_stmt(co, stmt->if_stmt->then_branch[i]);
             }
 
-            uint16_t else_branch_start = 0;
-            if (stmt->if_stmt->else_branch) {
-                // If there's an else branch, add a jump to skip it after "then"
-                else_branch_start = co->co_size;
-                co_bc_opoperand(co, CO_OP_JUMP_REL, 0, 2);
-                lnotab_forward(co, 3, stmt->line);
-            }
+            // If there's an else branch, add a jump to skip it after "then"
+            uint32_t else_jump = 0;
+            if (stmt->if_stmt->else_branch)
+                else_jump = co_bc_jump_forward(co, CO_OP_JUMP_REL, 0);
 
-            uint16_t else_pos = co->co_size;
-            uint16_t if_offset = else_pos - then_branch_start - 3;
-            memcpy(&co->co_bytecode[then_branch_start + 1], &if_offset, 2);
+            co_bc_patch_jump(co, then_jump, co->co_size);
 
             if (stmt->if_stmt->else_branch) {
                 co_compile_stmt(co, stmt->if_stmt->else_branch);
-                
-                uint16_t end_pos = co->co_size;
-                uint16_t else_offset = end_pos - else_branch_start - 3;
-                memcpy(&co->co_bytecode[else_branch_start + 1], &else_offset, 2);
+                co_bc_patch_jump(co, else_jump, co->co_size);
             }
 
             break;
         }
         case STMT_FUNCTION_DECL: {
-            MECodeObject* func_co = malloc(sizeof(MECodeObject));
-            func_co->co_name = malloc(stmt->function_decl->name.byte_len + 1);
-            memcpy(func_co->co_name, stmt->function_decl->name.data, stmt->function_decl->name.byte_len);
-            func_co->co_name[stmt->function_decl->name.byte_len] = '\0';
-            func_co->co_h_globals = co->co_h_globals;
-            func_co->co_h_locals = hashmap_new();
-            func_co->co_consts = darray_new(MEObject*);
+            MECodeObject* func_co = co_alloc(stmt->function_decl->name.data, stmt->function_decl->name.byte_len, 128);
             func_co->co_globals = co->co_globals;
-            func_co->co_locals = darray_new(MEObject*);
-            darray_pushd(func_co->co_consts, me_none);
-            darray_pushd(func_co->co_consts, me_long_from_long(1));
-            func_co->co_lnotab = darray_new(uint8_t);
-            func_co->co_capacity = 128;
-            func_co->co_bytecode = (uint8_t*)malloc(func_co->co_capacity);
-            memset(func_co->co_bytecode, 0, func_co->co_capacity);
-            func_co->co_size = 0;
+            func_co->co_nlocals = stmt->function_decl->nlocals; // Parameters first, in order
             func_co->in_function = 1;
+            func_co->co_line = stmt->line; // Of the implicit RETURN NONE
+            co_init_consts(func_co, co);
 
-            uintptr_t name_idx;
-            if (!co->in_function) {
-                if (hashmap_get(co->co_h_globals, stmt->function_decl->name.data, stmt->function_decl->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_globals, stmt->function_decl->name.data, stmt->function_decl->name.byte_len, (uintptr_t*)&name_idx);
-                } else {
-                    name_idx = darray_size(co->co_globals);
-                    hashmap_set(co->co_h_globals, stmt->function_decl->name.data, stmt->function_decl->name.byte_len, (uintptr_t)name_idx);
-                    darray_pushd(co->co_globals, me_none);
-                }
-            }
-            
-            for (size_t i = 0; i < darray_size(stmt->function_decl->params); i++) {
-                Expr* param = stmt->function_decl->params[i];
-                if (param->kind == EXPR_VARIABLE) {
-                    uint16_t param_idx = darray_size(func_co->co_locals);
-                    hashmap_set(func_co->co_h_locals, param->variable->name.data, param->variable->name.byte_len, (uintptr_t)param_idx);
-                    darray_pushd(func_co->co_locals, me_none);
-                }
-            }
-            
             for (size_t i = 0; i < darray_size(stmt->function_decl->body); i++)
                 co_compile_stmt(func_co, stmt->function_decl->body[i]);
             
-            // RETURN NONE ALWAYS IF THERE IS NO RETURN STMT
-            if (func_co->co_size == 0 || func_co->co_bytecode[func_co->co_size - 1] != CO_OP_RETURN) {
-                co_bc_opoperand(func_co, CO_OP_LOAD_CONST, 0, 2);
-                co_bc_op(func_co, CO_OP_RETURN);
-                lnotab_forward(func_co, 4, stmt->line);
-            }
+            // RETURN NONE ALWAYS, a branch may still fall through to the end even if the last stmt is a return.
+            // The threaded VM has no end of bytecode check so every code object must end with a RETURN.
+            co_bc_opoperand(func_co, CO_OP_LOAD_CONST, 0, 2);
+            co_bc_op(func_co, CO_OP_RETURN);
+
+            if (co_options.peephole)
+                co_peephole(func_co);
+            else
+                co_narrow(func_co);
+
+            co_drop_consts(func_co, 0);
             
             MEObject* func_obj = me_function_new(func_co, darray_size(stmt->function_decl->params));
-            uint16_t func_idx = darray_size(co->co_consts);
-            darray_pushd(co->co_consts, func_obj);
+            uint32_t func_idx = co_add_const(co, func_obj);
             
             co_bc_opoperand(co, CO_OP_LOAD_CONST, func_idx, 2);
-            lnotab_forward(co, 3, stmt->line);
         
-            // Fix: Remove the duplicate variable declaration and reuse name_idx
-            if (!co->in_function) {
-                co_bc_opoperand(co, CO_OP_STORE_GLOBAL, name_idx, 2);
-            } else {
-                if (hashmap_get(co->co_h_locals, stmt->function_decl->name.data, stmt->function_decl->name.byte_len, NULL)) {
-                    hashmap_get(co->co_h_locals, stmt->function_decl->name.data, stmt->function_decl->name.byte_len, (uintptr_t*)&name_idx);
-                } else {
-                    name_idx = darray_size(co->co_locals);
-                    hashmap_set(co->co_h_locals, stmt->function_decl->name.data, stmt->function_decl->name.byte_len, (uintptr_t)name_idx);
-                    darray_pushd(co->co_locals, me_none);
-                }
-                co_bc_opoperand(co, CO_OP_STORE_VARIABLE, name_idx, 2);
-            }
-            lnotab_forward(co, 3, stmt->line);
+            co_bc_store(co, stmt->function_decl->scope, stmt->function_decl->slot);
             
             break;
         }
         case STMT_WHILE: {
             uint32_t loop_start = co->co_size;
 
-            co_compile_expr(co, stmt->while_stmt->condition);
-            
-            uint32_t jump_out_pos = co->co_size;
-            co_bc_opoperand(co, CO_OP_JUMP_IF_FALSE, 0, 2); // Placeholder
-            lnotab_forward(co, 3, stmt->line);
+            uint32_t jump_out_pos = co_compile_condition(co, stmt->while_stmt->condition);
             
             int old_loop_start = co->loop_start;
             int old_loop_end_jump = co->loop_end_jump;
             int old_loop_end_pos = co->loop_end_pos;
+            size_t old_break_count = darray_size(co->break_patches); // Breaks of the enclosing loops stay untouched
 
             co->loop_start = loop_start;
             co->loop_end_jump = jump_out_pos;
@@ -419,21 +893,16 @@ static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
             for (size_t i = 0; i < darray_size(stmt->while_stmt->body); i++)
                 co_compile_stmt(co, stmt->while_stmt->body[i]);
 
-            co_bc_opoperand(co, CO_OP_JUMP_REL, loop_start - co->co_size - 3, 2);
-            lnotab_forward(co, 3, stmt->line);
+            co_bc_jump_to(co, CO_OP_JUMP_REL, loop_start);
             
             co->loop_end_pos = co->co_size;
+            co_bc_patch_jump(co, jump_out_pos, co->loop_end_pos);
 
-            uint16_t jump_out_offset = co->loop_end_pos - jump_out_pos - 3;
-            memcpy(&co->co_bytecode[jump_out_pos + 1], &jump_out_offset, 2);
-
-            for (size_t i = 0; i < darray_size(co->break_patches); i++) {
-                uint32_t break_pos = co->break_patches[i];
-                int16_t break_offset = co->loop_end_pos - break_pos - 3;
-                memcpy(&co->co_bytecode[break_pos + 1], &break_offset, 2);
-            }
+            for (size_t i = old_break_count; i < darray_size(co->break_patches); i++)
+                co_bc_patch_jump(co, co->break_patches[i], co->loop_end_pos);
             
             // printf("Loop start: %u, end jump: %u, end pos: %u\n", co->loop_start, co->loop_end_jump, co->loop_end_pos);
+            darray_set_size(co->break_patches, old_break_count);
             co->loop_start = old_loop_start;
             co->loop_end_jump = old_loop_end_jump;
             co->loop_end_pos = old_loop_end_pos;
@@ -442,14 +911,11 @@ static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
             break;
         }
         case STMT_BREAK: {            
-            darray_push(co->break_patches, co->co_size);
-            co_bc_opoperand(co, CO_OP_JUMP_REL, 0xFFFF, 2); // 0 is not valid, if there is a loop in if statement it will be problematic
-            lnotab_forward(co, 3, stmt->line);
+            darray_pushd(co->break_patches, co_bc_jump_forward(co, CO_OP_JUMP_REL, 0));
             break;
         }
         case STMT_CONTINUE: {
-            co_bc_opoperand(co, CO_OP_JUMP_REL, co->loop_start - co->co_size - 3, 2);
-            lnotab_forward(co, 3, stmt->line);
+            co_bc_jump_to(co, CO_OP_JUMP_REL, co->loop_start);
             break;
         }
         default:
@@ -457,10 +923,37 @@ static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
     }
 }
 
+// Everything emitted while compiling a node is attributed to its line, the parent's line is back in
+// effect for whatever the parent emits after it
+static void co_compile_expr(MECodeObject* co, Expr* expr) {
+    if (!expr)
+        return;
+
+    int line = co->co_line;
+    co->co_line = expr->line;
+    co_compile_expr_kind(co, expr);
+    co->co_line = line;
+}
+
+static void co_compile_stmt(MECodeObject* co, Stmt* stmt) {
+    if (!stmt)
+        return;
+
+    int line = co->co_line;
+    co->co_line = stmt->line;
+    co_compile_stmt_kind(co, stmt);
+    co->co_line = line;
+}
+
 void co_disasm(MECodeObject* co) {
     if (!co)
         return;
 
+    if (co->co_register) {
+        co_reg_disasm(co);
+        return;
+    }
+
     uint32_t ip = 0;
     while (ip < co->co_size)
     {
@@ -470,60 +963,88 @@ void co_disasm(MECodeObject* co) {
         switch (op) {
             case CO_OP_LOAD_CONST: {
                 printf("LOAD_CONST ");
-                uint16_t idx = *(uint16_t*)(co->co_bytecode + ip + 1);
+                uint16_t idx = co_read_u16(co->co_bytecode + ip + 1);
                 printf("%u\n", idx);
                 ip += 2;
                 break;
             }
             case CO_OP_LOAD_VARIABLE: {
                 printf("LOAD_VARIABLE ");
-                uint16_t idx = *(uint16_t*)(co->co_bytecode + ip + 1);
+                uint16_t idx = co_read_u16(co->co_bytecode + ip + 1);
                 printf("%u\n", idx);
                 ip += 2;
                 break;
             }
             case CO_OP_STORE_VARIABLE: {
                 printf("STORE_VARIABLE ");
-                uint16_t idx = *(uint16_t*)(co->co_bytecode + ip + 1);
+                uint16_t idx = co_read_u16(co->co_bytecode + ip + 1);
                 printf("%u\n", idx);
                 ip += 2;
                 break;
             }
             case CO_OP_STORE_GLOBAL: {
                 printf("STORE_GLOBAL ");
-                uint16_t idx = *(uint16_t*)(co->co_bytecode + ip + 1);
+                uint16_t idx = co_read_u16(co->co_bytecode + ip + 1);
                 printf("%u\n", idx);
                 ip += 2;
                 break;
             }
             case CO_OP_LOAD_GLOBAL: {
                 printf("LOAD_GLOBAL ");
-                uint16_t idx = *(uint16_t*)(co->co_bytecode + ip + 1);
+                uint16_t idx = co_read_u16(co->co_bytecode + ip + 1);
                 printf("%u\n", idx);
                 ip += 2;
                 break;
             }
             case CO_OP_CALL_FUNCTION:
-                printf("CALL_FUNCTION ");
+            case CO_OP_CALL_EXACT_ARGS:
+            case CO_OP_CALL_BUILTIN:
+                printf("%s ", co_op_names[op]);
                 uint8_t arg_count = co->co_bytecode[ip + 1];
-                printf("%u\n", arg_count);
-                ip++;
+                uint16_t call_cache = co_read_u16(co->co_bytecode + ip + 2);
+                printf("%u (cache %u)\n", arg_count, call_cache);
+                ip += 3;
                 break;
             case CO_OP_RETURN:
                 printf("RETURN\n");
                 break;
+            case CO_OP_TAIL_CALL:
+                printf("TAIL_CALL %u\n", co->co_bytecode[ip + 1]);
+                ip += 1;
+                break;
             case CO_OP_JUMP_IF_FALSE:
-                printf("JUMP_IF_FALSE ");
-                uint16_t jump_if_false_offset = *(uint16_t*)(co->co_bytecode + ip + 1);
+            case CO_OP_JUMP_IF_FALSE_OR_POP:
+            case CO_OP_JUMP_IF_TRUE_OR_POP:
+                printf("%s ", co_op_names[op]);
+                uint16_t jump_if_false_offset = co_read_u16(co->co_bytecode + ip + 1);
                 printf("%u\n", jump_if_false_offset);
                 ip += 2;
                 break;
+            case CO_OP_COMPARE_JUMP_IF_FALSE:
+                printf("COMPARE_JUMP_IF_FALSE ");
+                printf("%u %u\n", co->co_bytecode[ip + 1], co_read_u16(co->co_bytecode + ip + 2));
+                ip += 3;
+                break;
+            case CO_OP_INC_LOCAL:
+            case CO_OP_INC_GLOBAL:
+                printf("%s %d %u\n", co_op_names[op], (int8_t)co->co_bytecode[ip + 1], co_read_u16(co->co_bytecode + ip + 2));
+                ip += 3;
+                break;
+            case CO_OP_BINARY_OP_INPLACE_LOCAL:
+            case CO_OP_BINARY_OP_INPLACE_GLOBAL:
+                printf("%s %u %u\n", co_op_names[op], co->co_bytecode[ip + 1], co_read_u16(co->co_bytecode + ip + 2));
+                ip += 3;
+                break;
             case CO_OP_JUMP_REL:
                 printf("JUMP_REL ");
-                int16_t jump_offset = *(int16_t*)(co->co_bytecode + ip + 1);
+                int16_t jump_offset = (int16_t)co_read_u16(co->co_bytecode + ip + 1);
                 printf("%d\n", jump_offset);
                 ip += 2;
                 break;
+            case CO_OP_EXTENDED_ARG:
+                printf("EXTENDED_ARG %u\n", co_read_u16(co->co_bytecode + ip + 1));
+                ip += 2;
+                break;
             case CO_OP_UNARY_OP:
                 printf("UNARY_OP ");
                 uint8_t unary_op = co->co_bytecode[ip + 1];
@@ -542,6 +1063,14 @@ void co_disasm(MECodeObject* co) {
             case CO_OP_DUP:
                 printf("DUP\n");
                 break;
+            case CO_OP_BINARY_ADD ... CO_OP_COMPARE_GTE_FLOAT:
+                if (co_op_has_cache(op)) {
+                    printf("%s (cache %u)\n", co_op_names[op], co_read_u16(co->co_bytecode + ip + 1));
+                    ip += 2;
+                } else {
+                    printf("%s\n", co_op_names[op]);
+                }
+                break;
             default:
                 printf("UNKNOWN OP %u\n", op);
                 break;
@@ -556,42 +1085,86 @@ void co_disasm(MECodeObject* co) {
 
         MEFunctionObject* func = (MEFunctionObject*)co->co_consts[i];
         printf("--------------------\n");
-        printf("Function: %.*s, nargs: %zu\n", (int)utf8_strsize(func->co->co_name), func->co->co_name, func->nargs);
+        printf("Function: %.*s, nargs: %zu, nlocals: %u, stacksize: %u\n", (int)utf8_strsize(func->co->co_name), func->co->co_name, func->nargs, func->co->co_nlocals, func->co->co_stacksize);
         co_disasm(func->co);
         printf("--------------------\n");
     }
 }
 
-MECodeObject* co_new(const char* filename, Stmt** stmts) {
-    MECodeObject* co = malloc(sizeof(MECodeObject));
-    size_t filename_size = utf8_strsize(filename) + 1; 
-    co->co_name = malloc(filename_size);
-    memcpy(co->co_name, filename, filename_size);
-    
-    co->co_h_globals = hashmap_new();
-    co->co_h_locals = hashmap_new();
-    co->co_consts = darray_new(MEObject*);
-    co->co_globals = darray_new(MEObject*);
-    co->co_locals = darray_new(MEObject*);
+void co_dump_cache_stats(MECodeObject* co) {
+    if (!co)
+        return;
 
-    // IDX 0 IS RESERVED FOR NONE OBJECT, IDX 1 IS RESERVED FOR INT 1 OBJECT
-    darray_pushd(co->co_consts, me_none);
-    darray_pushd(co->co_consts, me_long_from_long(1)); 
-    co->co_lnotab = darray_new(uint8_t);
-    co->co_capacity = ME_CO_INITIAL_CAPACITY;
-    co->co_bytecode = (uint8_t*)malloc(co->co_capacity);
-    memset(co->co_bytecode, 0, co->co_capacity);
-    co->co_size = 0;
-    co->in_function = 0;
-    co->loop_start = 0;
-    co->loop_end_jump = 0;
-    co->loop_end_pos = 0;
-    co->break_patches = darray_new(uint32_t);
+    printf("Inline caches of %s:\n", co->co_name);
+    for (size_t i = 0; i < darray_size(co->co_caches); i++) {
+        MECodeCache* cache = &co->co_caches[i];
+        uint64_t total = cache->hits + cache->misses + cache->generic;
+        if (total == 0)
+            continue;
+
+        // The VM quickens the decoded instructions, co_bytecode keeps the adaptive form
+        uint8_t op = co->co_bytecode[cache->offset];
+        for (uint32_t j = 0; j < co->co_ninstrs; j++) {
+            if (co_op_has_cache(co->co_instrs[j].op) && co->co_instrs[j].cache == cache)
+                op = co->co_instrs[j].op;
+        }
+
+        printf("  %04u %-18s hits: %-10llu misses: %-6llu generic: %-10llu hit rate: %.1f%%\n",
+            cache->offset, co_op_names[op],
+            (unsigned long long)cache->hits, (unsigned long long)cache->misses, (unsigned long long)cache->generic,
+            100.0 * cache->hits / total);
+    }
+
+    for (size_t i = 0; i < darray_size(co->co_consts); i++) {
+        if (me_function_check(co->co_consts[i]))
+            co_dump_cache_stats(((MEFunctionObject*)co->co_consts[i])->co);
+    }
+}
+
+MECodeObject* co_new(const char* filename, Stmt** stmts, uint32_t nglobals) {
+    MECodeObject* co = co_alloc(filename, utf8_strsize(filename), ME_CO_INITIAL_CAPACITY);
+    co->co_globals = darray_new(MEObject*);
+    co_init_consts(co, NULL);
 
+    // Builtins fill the first slots, the rest start out as none
     me_register_builtins_co(co);
+    while (darray_size(co->co_globals) < nglobals)
+        darray_pushd(co->co_globals, me_none);
+
+    // Folded nodes live in fold_arena, the AST must not be used once the module is compiled
+    Arena* fold_arena = NULL;
+    MEObject** folded = NULL;
+    if (co_options.fold) {
+        fold_arena = arena_new();
+        folded = co_fold(stmts, fold_arena);
+    }
+
+    if (co_options.registers) {
+        co_reg_compile(co, stmts);
+    } else {
+        for (size_t i = 0; i < darray_size(stmts); i++)
+            co_compile_stmt(co, stmts[i]);
+
+        // Module code ends with an implicit RETURN NONE too, it stops the VM without an end of bytecode check
+        co_bc_opoperand(co, CO_OP_LOAD_CONST, 0, 2);
+        co_bc_op(co, CO_OP_RETURN);
+    }
+
+    if (folded) {
+        darray_for(folded) ME_DECREF(folded[__i]);
+        darray_free(folded);
+        arena_free(fold_arena);
+    }
+
+    co_drop_consts(co, 1);
 
-    for (size_t i = 0; i < darray_size(stmts); i++)
-        co_compile_stmt(co, stmts[i]);
+    if (co->co_register)
+        return co;
+
+    if (co_options.peephole)
+        co_peephole(co);
+    else
+        co_narrow(co);
 
     return co;
 }
@@ -602,25 +1175,32 @@ void co_free(MECodeObject* co) {
 
     free(co->co_name);
 
-    hashmap_free(co->co_h_globals);
-    hashmap_free(co->co_h_locals);
-
     darray_for(co->co_consts) ME_XDECREF(co->co_consts[__i]);
     darray_free(co->co_consts);
 
-    darray_for(co->co_globals) ME_XDECREF(co->co_globals[__i]);
-    darray_free(co->co_globals);
-
-    darray_for(co->co_locals) ME_XDECREF(co->co_locals[__i]);
-    darray_free(co->co_locals);
+    // Only the module owns the globals, functions borrow them
+    if (co->co_globals && !co->in_function) {
+        darray_for(co->co_globals) ME_XDECREF(co->co_globals[__i]);
+        darray_free(co->co_globals);
+    }
 
-    darray_free(co->co_lnotab);
+    darray_for(co->co_caches) ME_XDECREF(co->co_caches[__i].cached);
+    darray_free(co->co_caches);
 
-    if (co->co_bytecode)
-        free(co->co_bytecode);
+    if (!co->co_mapped) {
+        darray_free(co->co_lines);
+        if (co->co_bytecode)
+            free(co->co_bytecode);
+    }
 
     if (co->break_patches)
         darray_free(co->break_patches);
 
+    free(co->co_instrs);
+
+    // Last, constants and globals freed above may have been borrowing its bytes
+    if (co->co_image)
+        munmap(co->co_image, co->co_image_size);
+
     free(co);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define __CO_H
 
 #include <stdint.h>
+#include <string.h>
 
 #include "../utils/hashmap.h"
 
@@ -9,22 +10,71 @@
 
 #include "object.h"
 
+// Inline cache of a quickenable instruction, the instruction carries its index as a u16 operand.
+// Adaptive (generic) instructions count down "counter" and rewrite themselves into a specialized
+// variant once it hits zero, specialized ones deoptimize back on a guard miss.
+typedef struct {
+    uint32_t offset;    // Offset of the owning instruction, for the stats dump
+    uint32_t counter;   // Executions left before the next specialization attempt
+    MEObject* cached;   // Callee of a specialized call, owned reference
+    uint64_t hits;      // Guard passed in a specialized form
+    uint64_t misses;    // Guard failed, instruction was deoptimized
+    uint64_t generic;   // Executed in the adaptive form
+} MECodeCache;
+
+// Start of a run of instructions compiled from the same source line
+typedef struct {
+    uint32_t offset;
+    uint32_t line;
+} MECodeLine;
+
+// An instruction the way the VM runs it, co_bytecode stays the compiled and serialized form. Fixed
+// width and aligned, an EXTENDED_ARG is folded into the instruction it extends and the operand is
+// resolved once instead of being decoded on every execution.
+typedef struct MEInstr {
+    const void* handler;        // Label of the handler with the threaded dispatch, unused otherwise
+    union {
+        MEObject* obj;          // LOAD_CONST, borrowed from co_consts
+        MEObject** slot;        // Global loads, stores and updates
+        uint32_t index;         // Local slot of local loads, stores and updates
+        struct MEInstr* target; // Jumps, absolute
+        MECodeCache* cache;     // Quickenable instructions
+    };
+    uint8_t op;                 // Quickening rewrites it along with "handler"
+    uint8_t arg;                // BinaryOp, UnaryOp, comparison, increment or argument count
+    uint8_t borrowed;           // Loads: push without a reference. Their consumer: bit 0 for the top, bit 1 below it
+    uint32_t line;
+} MEInstr;
+
 typedef struct MECodeObject {
     char* co_name;
     uint8_t* co_bytecode;
     size_t co_size;
     size_t co_capacity;
-    HashMap* co_h_globals;
-    HashMap* co_h_locals;
     MEObject** co_consts;
     MEObject** co_globals;
-    MEObject** co_locals;
-    uint8_t* co_lnotab;
+    MECodeLine* co_lines; // Sorted by offset, a darray while compiling
+    uint32_t co_nlines;
+    int co_line;          // Line of whatever is being emitted, recorded by the emitters
+    MECodeCache* co_caches; // Darray, one per quickenable instruction
+    uint32_t co_nlocals; // Size of the locals window of a frame, parameters come first
+    uint32_t co_stacksize; // Maximum value stack depth, computed while compiling
     int in_function;
+    int stack_depth;
     uint32_t loop_start;
     uint32_t loop_end_jump;
     uint32_t loop_end_pos;
     uint32_t* break_patches;
+    HashMap* co_h_consts;   // Constant key -> index in co_consts, only while compiling
+    HashMap* co_h_interned; // Constant key -> object, shared by a module and its functions while compiling
+    Arena* co_const_arena;  // Keys of both, shared like co_h_interned
+    int co_mapped;          // co_bytecode and co_lines point into a mapped .mec image, plain arrays not darrays
+    void* co_image;         // That image, owned and unmapped by the module code object
+    size_t co_image_size;
+    MEInstr* co_instrs;     // Decoded by the VM before the code first runs, NULL until then
+    uint32_t co_ninstrs;
+    int co_register;        // co_bytecode holds register code, see reg.h
+    uint32_t co_nregs;      // Register window of a frame running it
 } MECodeObject;
 
 typedef enum {
@@ -42,13 +92,155 @@ typedef enum {
     CO_OP_POP,
     CO_OP_JUMP_REL,
     CO_OP_JUMP_IF_FALSE,
+    CO_OP_JUMP_IF_FALSE_OR_POP, // Short-circuit "ile", jumps keeping a falsy tos, pops it otherwise
+    CO_OP_JUMP_IF_TRUE_OR_POP,  // Short-circuit "veyahut", same with a truthy tos
+    CO_OP_COMPARE_JUMP_IF_FALSE, // u8 comparison BinaryOp then the u16 offset, a comparison fused with JUMP_IF_FALSE
+    CO_OP_INC_LOCAL,  // i8 delta then the u16 slot, "slot += delta" in place
+    CO_OP_INC_GLOBAL,
+    CO_OP_BINARY_OP_INPLACE_LOCAL,  // u8 BinaryOp then the u16 slot, "slot = slot op tos"
+    CO_OP_BINARY_OP_INPLACE_GLOBAL,
+    CO_OP_EXTENDED_ARG, // u16 high half of the next instruction's u16 operand (its cache index for cached ones)
+    CO_OP_TAIL_CALL,    // u8 argument count, "tebliğ f(...)" in a function, the callee takes over the caller's frame
+
+    // Type specialized binary ops, no operand. Long/long and float/float are handled inline by the
+    // VM, anything else falls back to the type slots like CO_OP_BINARY_OP does.
+    CO_OP_BINARY_ADD,
+    CO_OP_BINARY_SUB,
+    CO_OP_BINARY_MUL,
+    CO_OP_BINARY_DIV,
+    CO_OP_BINARY_MOD,
+    CO_OP_BINARY_BIT_AND,
+    CO_OP_BINARY_BIT_OR,
+    CO_OP_BINARY_BIT_XOR,
+    CO_OP_BINARY_LSHIFT,
+    CO_OP_BINARY_RSHIFT,
+    CO_OP_COMPARE_EQ,
+    CO_OP_COMPARE_NEQ,
+    CO_OP_COMPARE_LT,
+    CO_OP_COMPARE_LTE,
+    CO_OP_COMPARE_GT,
+    CO_OP_COMPARE_GTE,
+
+    // Quickened forms, never emitted by the compiler. The VM rewrites adaptive instructions into
+    // these in place and back again when their guard fails.
+    CO_OP_BINARY_ADD_LONG,
+    CO_OP_BINARY_SUB_LONG,
+    CO_OP_BINARY_MUL_LONG,
+    CO_OP_BINARY_DIV_LONG,
+    CO_OP_BINARY_MOD_LONG,
+    CO_OP_BINARY_ADD_FLOAT,
+    CO_OP_BINARY_SUB_FLOAT,
+    CO_OP_BINARY_MUL_FLOAT,
+    CO_OP_BINARY_DIV_FLOAT,
+    CO_OP_COMPARE_EQ_LONG,
+    CO_OP_COMPARE_NEQ_LONG,
+    CO_OP_COMPARE_LT_LONG,
+    CO_OP_COMPARE_LTE_LONG,
+    CO_OP_COMPARE_GT_LONG,
+    CO_OP_COMPARE_GTE_LONG,
+    CO_OP_COMPARE_EQ_FLOAT,
+    CO_OP_COMPARE_NEQ_FLOAT,
+    CO_OP_COMPARE_LT_FLOAT,
+    CO_OP_COMPARE_LTE_FLOAT,
+    CO_OP_COMPARE_GT_FLOAT,
+    CO_OP_COMPARE_GTE_FLOAT,
+    CO_OP_CALL_EXACT_ARGS,
+    CO_OP_CALL_BUILTIN,
+
+    // Superinstructions, never in bytecode either. The VM's decoder gives one to the first record of a
+    // run of instructions listed in co_op_fuses, its handler does the whole run in a single dispatch.
+    CO_OP_LOAD_VARIABLE_VARIABLE,
+    CO_OP_LOAD_GLOBAL_VARIABLE,
+    CO_OP_LOAD_GLOBAL_GLOBAL,
+    CO_OP_LOAD_VARIABLE_STORE_VARIABLE,
+    CO_OP_LOAD_GLOBAL_STORE_GLOBAL,
+    CO_OP_LOAD_VARIABLE_INPLACE_LOCAL,
+    CO_OP_LOAD_GLOBAL_INPLACE_GLOBAL,
+    CO_OP_LOAD_VARIABLE_CONST_ADD,
+    CO_OP_LOAD_VARIABLE_CONST_SUB,
+    CO_OP_LOAD_VARIABLE_CONST_COMPARE_JUMP,
+    CO_OP_LOAD_GLOBAL_CONST_COMPARE_JUMP,
+
+    // Loads the decoder gave a borrowed push to, never in bytecode either. The next instruction only
+    // looks at the value, the slot keeps it alive until then.
+    CO_OP_LOAD_CONST_BORROWED,
+    CO_OP_LOAD_GLOBAL_BORROWED,
+    CO_OP_LOAD_VARIABLE_BORROWED,
+
+    CO_OP_COUNT,
 } MECodeOp;
 
-MECodeObject* co_new(const char* filename, Stmt** stmts);
+typedef struct {
+    int fold;     // Fold constant expressions and propagate sabit literals before compiling, on by default
+    int peephole; // Run co_peephole over every code object, on by default
+    int registers; // Compile to register code for the register VM instead, off by default
+} MECoOptions;
+
+extern MECoOptions co_options;
+
+extern const char* co_op_names[CO_OP_COUNT];
+extern const uint8_t co_op_size[CO_OP_COUNT];
+extern const int8_t co_op_stack_effect[CO_OP_COUNT];
+extern const uint8_t co_op_pops[CO_OP_COUNT];
+extern const uint8_t co_op_deopt[CO_OP_COUNT];
+
+// Longest run a superinstruction stands for
+#define CO_FUSE_MAX 3
+
+extern const uint8_t co_op_fuses[CO_OP_COUNT][CO_FUSE_MAX];
+
+// u16 operand at "p", bytecode has no alignment so it is copied out instead of dereferenced
+static inline uint16_t co_read_u16(const uint8_t* p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Full operand of an instruction from its EXTENDED_ARG prefix (0 without one) and its own u16 field.
+// JUMP_REL is signed, the prefix is added shifted to its sign extended i16.
+static inline uint32_t co_arg_value(uint8_t op, uint16_t high, uint16_t low) {
+    if (op == CO_OP_JUMP_REL)
+        return ((uint32_t)high << 16) + (uint32_t)(int32_t)(int16_t)low;
+
+    return ((uint32_t)high << 16) | low;
+}
+
+// Operand of the EXTENDED_ARG prefix "value" needs, 0 when it fits the instruction on its own
+static inline uint16_t co_arg_high(uint8_t op, uint32_t value) {
+    if (op == CO_OP_JUMP_REL)
+        return (uint16_t)((value - (uint32_t)(int32_t)(int16_t)(value & 0xFFFF)) >> 16);
+
+    return (uint16_t)(value >> 16);
+}
+
+static inline int co_arg_fits(uint8_t op, uint32_t value) {
+    return co_arg_high(op, value) == 0;
+}
+
+// "nglobals" is the global slot count analyse returned
+MECodeObject* co_new(const char* filename, Stmt** stmts, uint32_t nglobals);
+MECodeObject* co_alloc(const char* name, size_t name_size, size_t capacity);
 void co_disasm(MECodeObject* co);
+void co_dump_cache_stats(MECodeObject* co);
+void co_peephole(MECodeObject* co);
+void co_narrow(MECodeObject* co);
+MEObject** co_fold(Stmt** stmts, Arena* arena);
+MEObject* co_literal_object(LiteralExpr* literal);
 void co_free(MECodeObject* co);
 
-int lnotab_get_line_from_ip(uint8_t* lnotab, uint32_t ip);
+// Checks a module's code and the code of every function in its consts before they run, 0 with the
+// error set if anything is off. The VM does no stack checks of its own, see verify.c.
+int co_verify(MECodeObject* co);
+
+// Source line of the instruction covering "offset", 0 if unknown
+uint32_t co_line_from_offset(MECodeObject* co, uint32_t offset);
+
+// Shared with the register compiler, see co.c
+void co_line_mark(MECodeObject* co);
+void co_init_consts(MECodeObject* co, MECodeObject* parent);
+void co_drop_consts(MECodeObject* co, int owner);
+uint32_t co_add_const(MECodeObject* co, MEObject* obj);
+uint32_t co_add_literal(MECodeObject* co, LiteralExpr* literal);
 
 #endif
 
@@ -61,8 +253,11 @@ SG idx                      - Store Global
 LV idx                      - Load Variable
 SV idx                      - Store Variable
 BIN op                      - Binary Operation with op
+BINARY_ADD .. COMPARE_GTE   - Binary Operation with the op baked into the opcode
+                              ADD/SUB/MUL/DIV/MOD and COMPARE_* carry a u16 cache idx
+CALL n cache                - Call Function with n arguments, u16 cache idx
 UN op                       - Unary Operation with op
-CALL n                      - Call Function with n arguments
+EXTENDED_ARG hi             - hi << 16 is added to the u16 operand of the next instruction
 
 
 
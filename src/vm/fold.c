@@ -0,0 +1,268 @@
+#include "co.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../utils/darray.h"
+#include "../utils/hashmap.h"
+
+#include "objects/boolobject.h"
+#include "objects/strobject.h"
+
+#include "vm.h"
+
+// Constant folding over the analysed AST, run by co_new before anything is compiled. Operators whose
+// operands are all literals are evaluated with the same type slots the VM would use and replaced by a
+// LITERAL_FOLDED node, uses of "sabit" bindings with a literal value are replaced by that literal.
+// Anything that fails to evaluate (division by zero, type mismatch...) is left as it is so the error
+// still happens at runtime, on the right line.
+
+// Bigger folded strings stay runtime operations, "a" * 1000000 would only bloat co_consts
+#define FOLD_MAX_STR_SIZE 4096
+
+typedef struct {
+    Arena* arena;       // Folded literal nodes
+    HashMap* writes;    // Declarations, parameters and assignments per name
+    HashMap* values;    // LiteralExpr* of the sabit bindings that are safe to substitute
+    MEObject** objects; // Darray, references owned by folded literal nodes
+} Folder;
+
+static void fold_count(Folder* folder, StringView name) {
+    uintptr_t count = 0;
+    hashmap_get(folder->writes, name.data, name.byte_len, &count);
+    hashmap_set(folder->writes, name.data, name.byte_len, count + 1);
+}
+
+static void fold_count_expr(Folder* folder, Expr* expr) {
+    if (!expr)
+        return;
+
+    switch (expr->kind) {
+        case EXPR_BINARY:
+            if (expr->binary->op == BIN_ASSIGN && expr->binary->lhs->kind == EXPR_VARIABLE)
+                fold_count(folder, expr->binary->lhs->variable->name);
+
+            fold_count_expr(folder, expr->binary->lhs);
+            fold_count_expr(folder, expr->binary->rhs);
+            break;
+        case EXPR_UNARY: {
+            UnaryOp op = expr->unary->op;
+            if ((op == UNARY_PRE_INC || op == UNARY_PRE_DEC || op == UNARY_POST_INC || op == UNARY_POST_DEC)
+                && expr->unary->operand->kind == EXPR_VARIABLE)
+                fold_count(folder, expr->unary->operand->variable->name);
+
+            fold_count_expr(folder, expr->unary->operand);
+            break;
+        }
+        case EXPR_CALL:
+            darray_for(expr->call->args) fold_count_expr(folder, expr->call->args[__i]);
+            break;
+        default:
+            break;
+    }
+}
+
+// Names are resolved per code object by the compiler, not per scope. A binding is only propagated
+// when its name is written exactly once in the whole program, so shadowing never comes into play.
+static void fold_count_stmt(Folder* folder, Stmt* stmt) {
+    if (!stmt)
+        return;
+
+    switch (stmt->kind) {
+        case STMT_COMPOUND:
+            darray_for(stmt->compound->stmts) fold_count_stmt(folder, stmt->compound->stmts[__i]);
+            break;
+        case STMT_DECL:
+            fold_count(folder, stmt->decl_stmt->name);
+            fold_count_expr(folder, stmt->decl_stmt->initializer);
+            break;
+        case STMT_EXPR:
+            fold_count_expr(folder, stmt->expr_stmt);
+            break;
+        case STMT_WHILE:
+            fold_count_expr(folder, stmt->while_stmt->condition);
+            darray_for(stmt->while_stmt->body) fold_count_stmt(folder, stmt->while_stmt->body[__i]);
+            break;
+        case STMT_IF:
+            fold_count_expr(folder, stmt->if_stmt->condition);
+            darray_for(stmt->if_stmt->then_branch) fold_count_stmt(folder, stmt->if_stmt->then_branch[__i]);
+            fold_count_stmt(folder, stmt->if_stmt->else_branch);
+            break;
+        case STMT_FUNCTION_DECL:
+            fold_count(folder, stmt->function_decl->name);
+            darray_for(stmt->function_decl->params) {
+                if (stmt->function_decl->params[__i]->kind == EXPR_VARIABLE)
+                    fold_count(folder, stmt->function_decl->params[__i]->variable->name);
+            }
+            darray_for(stmt->function_decl->body) fold_count_stmt(folder, stmt->function_decl->body[__i]);
+            break;
+        case STMT_RETURN:
+            fold_count_expr(folder, stmt->return_stmt->value);
+            break;
+        default:
+            break;
+    }
+}
+
+// Takes over "result", the expression becomes a literal holding it
+static void fold_replace(Folder* folder, Expr* expr, MEObject* result) {
+    if (!result)
+        return;
+
+    if (me_str_check(result) && ((MEStrObject*)result)->ob_bytelength > FOLD_MAX_STR_SIZE) {
+        ME_DECREF(result);
+        return;
+    }
+
+    LiteralExpr* literal = arena_alloc(folder->arena, sizeof(LiteralExpr));
+    literal->type = LITERAL_FOLDED;
+    literal->value = (StringView){0};
+    literal->object = result;
+    darray_push(folder->objects, result);
+
+    expr->kind = EXPR_LITERAL;
+    expr->literal = literal;
+}
+
+// A literal lhs of "ile"/"veyahut" already decides which operand is the value, the other one is dropped
+static void fold_logical(Expr* expr) {
+    Expr* lhs = expr->binary->lhs;
+    if (lhs->kind != EXPR_LITERAL)
+        return;
+
+    MEObject* obj = co_literal_object(lhs->literal);
+    if (!obj)
+        return;
+
+    int is_true = me_is_true(obj);
+    ME_DECREF(obj);
+
+    if (is_true == (expr->binary->op == BIN_OR))
+        *expr = *lhs;
+    else
+        *expr = *expr->binary->rhs;
+}
+
+static void fold_expr(Folder* folder, Expr* expr) {
+    if (!expr)
+        return;
+
+    switch (expr->kind) {
+        case EXPR_VARIABLE: {
+            uintptr_t literal;
+            if (hashmap_get(folder->values, expr->variable->name.data, expr->variable->name.byte_len, &literal)) {
+                expr->kind = EXPR_LITERAL;
+                expr->literal = (LiteralExpr*)literal;
+            }
+            break;
+        }
+        case EXPR_CALL:
+            darray_for(expr->call->args) fold_expr(folder, expr->call->args[__i]);
+            break;
+        case EXPR_UNARY: {
+            UnaryOp op = expr->unary->op;
+            if (op == UNARY_PRE_INC || op == UNARY_PRE_DEC || op == UNARY_POST_INC || op == UNARY_POST_DEC)
+                break; // Operand is a store target
+
+            fold_expr(folder, expr->unary->operand);
+            if (expr->unary->operand->kind != EXPR_LITERAL)
+                break;
+
+            MEObject* operand = co_literal_object(expr->unary->operand->literal);
+            if (!operand)
+                break;
+
+            fold_replace(folder, expr, me_unary_op(operand, op));
+            ME_DECREF(operand);
+            break;
+        }
+        case EXPR_BINARY: {
+            BinaryOp op = expr->binary->op;
+            if (op == BIN_ASSIGN) {
+                fold_expr(folder, expr->binary->rhs);
+                break;
+            }
+
+            fold_expr(folder, expr->binary->lhs);
+            fold_expr(folder, expr->binary->rhs);
+            if (op == BIN_AND || op == BIN_OR) {
+                fold_logical(expr);
+                break;
+            }
+
+            if (expr->binary->lhs->kind != EXPR_LITERAL || expr->binary->rhs->kind != EXPR_LITERAL)
+                break;
+
+            MEObject* lhs = co_literal_object(expr->binary->lhs->literal);
+            MEObject* rhs = co_literal_object(expr->binary->rhs->literal);
+            if (lhs && rhs)
+                fold_replace(folder, expr, me_binary_op(lhs, rhs, op));
+
+            if (lhs)
+                ME_DECREF(lhs);
+            if (rhs)
+                ME_DECREF(rhs);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void fold_stmt(Folder* folder, Stmt* stmt) {
+    if (!stmt)
+        return;
+
+    switch (stmt->kind) {
+        case STMT_COMPOUND:
+            darray_for(stmt->compound->stmts) fold_stmt(folder, stmt->compound->stmts[__i]);
+            break;
+        case STMT_DECL: {
+            DeclStmt* decl = stmt->decl_stmt;
+            fold_expr(folder, decl->initializer);
+
+            uintptr_t writes = 0;
+            hashmap_get(folder->writes, decl->name.data, decl->name.byte_len, &writes);
+            if (decl->is_const && writes == 1 && decl->initializer && decl->initializer->kind == EXPR_LITERAL)
+                hashmap_set(folder->values, decl->name.data, decl->name.byte_len, (uintptr_t)decl->initializer->literal);
+            break;
+        }
+        case STMT_EXPR:
+            fold_expr(folder, stmt->expr_stmt);
+            break;
+        case STMT_WHILE:
+            fold_expr(folder, stmt->while_stmt->condition);
+            darray_for(stmt->while_stmt->body) fold_stmt(folder, stmt->while_stmt->body[__i]);
+            break;
+        case STMT_IF:
+            fold_expr(folder, stmt->if_stmt->condition);
+            darray_for(stmt->if_stmt->then_branch) fold_stmt(folder, stmt->if_stmt->then_branch[__i]);
+            fold_stmt(folder, stmt->if_stmt->else_branch);
+            break;
+        case STMT_FUNCTION_DECL:
+            darray_for(stmt->function_decl->body) fold_stmt(folder, stmt->function_decl->body[__i]);
+            break;
+        case STMT_RETURN:
+            fold_expr(folder, stmt->return_stmt->value);
+            break;
+        default:
+            break;
+    }
+}
+
+MEObject** co_fold(Stmt** stmts, Arena* arena) {
+    Folder folder = {
+        .arena = arena,
+        .writes = hashmap_new(),
+        .values = hashmap_new(),
+        .objects = darray_new(MEObject*),
+    };
+
+    darray_for(stmts) fold_count_stmt(&folder, stmts[__i]);
+    darray_for(stmts) fold_stmt(&folder, stmts[__i]);
+
+    hashmap_free(folder.writes);
+    hashmap_free(folder.values);
+
+    return folder.objects;
+}
@@ -0,0 +1,415 @@
+#include "mec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/darray.h"
+
+#include "objects/boolobject.h"
+#include "objects/floatobject.h"
+#include "objects/functionobject.h"
+#include "objects/longobject.h"
+#include "objects/noneobject.h"
+#include "objects/strobject.h"
+
+#include "builtins/builtin.h"
+
+// The file is mapped copy-on-write and used in place: co_bytecode, co_lines and the bytes of string
+// constants point straight into it, only the code objects, the refcounted constants and the globals
+// are allocated at load time. Pages stay shared between processes running the same image until
+// quickening writes to them. Layout, every integer in host byte order (the endianness marker rejects
+// files from other hosts):
+//
+//   "MEC\x1a" u32 0x01020304 u32 version u32 opcode count u32 options u64 source hash u32 nglobals
+//   code object:
+//     u32 name size, name | u32 nlocals | u32 stacksize | u32 code size, code
+//     u32 line count, zero padding to a multiple of 4, (u32 offset, u32 line) per line
+//     | u32 cache count, u32 offset per cache | u32 const count, consts
+//   const: u8 tag then 'n' none | 'T' / 'F' bools | 'l' i64 | 'd' f64 | 's' u32 byte size, u32 length, bytes
+//          | 'c' u32 nargs, code object of a function
+//   u64 hash of everything before it, a damaged file is rejected instead of being trusted
+
+#define MEC_MAGIC "MEC\x1a"
+#define MEC_ENDIAN 0x01020304u
+
+#define MEC_OPT_FOLD     (1u << 0)
+#define MEC_OPT_PEEPHOLE (1u << 1)
+
+static uint32_t mec_options() {
+    return (co_options.fold ? MEC_OPT_FOLD : 0) | (co_options.peephole ? MEC_OPT_PEEPHOLE : 0);
+}
+
+char* mec_path(const char* filename) {
+    size_t len = strlen(filename);
+    char* path = malloc(len + 2);
+    memcpy(path, filename, len + 1);
+
+    // "x.me" -> "x.mec", anything else just gets ".mec" appended
+    if (len >= 3 && strcmp(filename + len - 3, ".me") == 0) {
+        path[len] = 'c';
+        path[len + 1] = '\0';
+    } else {
+        path = realloc(path, len + 5);
+        memcpy(path + len, ".mec", 5);
+    }
+
+    return path;
+}
+
+#define MEC_HASH_SEED 0xcbf29ce484222325ull
+
+static uint64_t mec_hash_update(uint64_t hash, const void* data, size_t size);
+
+// FNV-1a
+uint64_t mec_hash(const char* src, size_t size) {
+    return mec_hash_update(MEC_HASH_SEED, src, size);
+}
+
+/* ---- Writing ---- */
+
+typedef struct {
+    FILE* file;
+    uint64_t hash; // Of everything written so far
+    size_t pos;
+} MecWriter;
+
+static uint64_t mec_hash_update(uint64_t hash, const void* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= ((const uint8_t*)data)[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static int mec_write(MecWriter* f, const void* data, size_t size) {
+    f->hash = mec_hash_update(f->hash, data, size);
+    f->pos += size;
+    return size == 0 || fwrite(data, 1, size, f->file) == size;
+}
+
+static int mec_write_u32(MecWriter* f, uint32_t value) {
+    return mec_write(f, &value, 4);
+}
+
+static int mec_write_co(MecWriter* f, MECodeObject* co);
+
+static int mec_write_const(MecWriter* f, MEObject* obj) {
+    uint8_t tag;
+    if (obj == me_none)
+        tag = 'n';
+    else if (obj == me_true)
+        tag = 'T';
+    else if (obj == me_false)
+        tag = 'F';
+    else if (me_long_check(obj))
+        tag = 'l';
+    else if (me_float_check(obj))
+        tag = 'd';
+    else if (me_str_check(obj))
+        tag = 's';
+    else if (me_function_check(obj))
+        tag = 'c';
+    else
+        return 0; // Nothing else ends up in co_consts
+
+    if (!mec_write(f, &tag, 1))
+        return 0;
+
+    switch (tag) {
+        case 'l': {
+            int64_t value = me_long_value(obj);
+            return mec_write(f, &value, 8);
+        }
+        case 'd':
+            return mec_write(f, &((MEFloatObject*)obj)->ob_value, 8);
+        case 's':
+            return mec_write_u32(f, ((MEStrObject*)obj)->ob_bytelength)
+                && mec_write_u32(f, ((MEStrObject*)obj)->ob_length)
+                && mec_write(f, ((MEStrObject*)obj)->ob_value, ((MEStrObject*)obj)->ob_bytelength);
+        case 'c':
+            return mec_write_u32(f, ((MEFunctionObject*)obj)->nargs)
+                && mec_write_co(f, ((MEFunctionObject*)obj)->co);
+        default:
+            return 1;
+    }
+}
+
+static int mec_write_co(MecWriter* f, MECodeObject* co) {
+    uint32_t name_size = strlen(co->co_name);
+    if (!mec_write_u32(f, name_size) || !mec_write(f, co->co_name, name_size))
+        return 0;
+
+    if (!mec_write_u32(f, co->co_nlocals) || !mec_write_u32(f, co->co_stacksize))
+        return 0;
+
+    if (!mec_write_u32(f, co->co_size) || !mec_write(f, co->co_bytecode, co->co_size))
+        return 0;
+
+    // The mapping is page aligned, aligning the file offset is enough for co_lines to be used in place
+    static const uint8_t padding[4] = {0};
+    if (!mec_write_u32(f, co->co_nlines) || !mec_write(f, padding, (4 - f->pos % 4) % 4)
+        || !mec_write(f, co->co_lines, sizeof(MECodeLine) * co->co_nlines))
+        return 0;
+
+    if (!mec_write_u32(f, darray_size(co->co_caches)))
+        return 0;
+
+    darray_for(co->co_caches) {
+        if (!mec_write_u32(f, co->co_caches[__i].offset))
+            return 0;
+    }
+
+    if (!mec_write_u32(f, darray_size(co->co_consts)))
+        return 0;
+
+    darray_for(co->co_consts) {
+        if (!mec_write_const(f, co->co_consts[__i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+// Must be called before the module runs, quickening rewrites the bytecode in place. The file is written
+// under a temporary name and renamed over the old one so concurrent runs never see half a cache.
+int mec_save(const char* path, MECodeObject* co, uint64_t src_hash) {
+    size_t tmp_size = strlen(path) + 32;
+    char* tmp = malloc(tmp_size);
+    snprintf(tmp, tmp_size, "%s.%ld.tmp", path, (long)getpid());
+
+    MecWriter f = { .file = fopen(tmp, "wb"), .hash = MEC_HASH_SEED, .pos = 0 };
+    if (!f.file) {
+        free(tmp);
+        return 0;
+    }
+
+    uint32_t header[] = { MEC_ENDIAN, ME_MEC_VERSION, CO_OP_COUNT, mec_options() };
+    int ok = mec_write(&f, MEC_MAGIC, 4)
+        && mec_write(&f, header, sizeof(header))
+        && mec_write(&f, &src_hash, 8)
+        && mec_write_u32(&f, darray_size(co->co_globals))
+        && mec_write_co(&f, co);
+
+    uint64_t checksum = f.hash;
+    ok = ok && mec_write(&f, &checksum, 8);
+    ok = fclose(f.file) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok)
+        remove(tmp);
+
+    free(tmp);
+    return ok;
+}
+
+/* ---- Reading ---- */
+
+typedef struct {
+    uint8_t* data; // Mapped writable, quickening patches co_bytecode in place
+    size_t size;
+    size_t pos;
+} MecReader;
+
+static void* mec_read(MecReader* r, size_t size) {
+    if (size > r->size - r->pos)
+        return NULL;
+
+    void* data = r->data + r->pos;
+    r->pos += size;
+    return data;
+}
+
+static int mec_read_u32(MecReader* r, uint32_t* out) {
+    const void* data = mec_read(r, 4);
+    if (!data)
+        return 0;
+
+    memcpy(out, data, 4);
+    return 1;
+}
+
+static MECodeObject* mec_read_co(MecReader* r);
+
+// New reference, NULL on a malformed constant
+static MEObject* mec_read_const(MecReader* r) {
+    const uint8_t* tag = mec_read(r, 1);
+    if (!tag)
+        return NULL;
+
+    switch (*tag) {
+        case 'n': return me_none;
+        case 'T': return me_true;
+        case 'F': return me_false;
+        case 'l': {
+            const void* data = mec_read(r, 8);
+            int64_t value;
+            if (!data)
+                return NULL;
+
+            memcpy(&value, data, 8);
+            return me_long_from_long(value);
+        }
+        case 'd': {
+            const void* data = mec_read(r, 8);
+            double value;
+            if (!data)
+                return NULL;
+
+            memcpy(&value, data, 8);
+            return me_float_from_double(value);
+        }
+        case 's': {
+            uint32_t size, length;
+            const char* data;
+            if (!mec_read_u32(r, &size) || !mec_read_u32(r, &length) || !(data = mec_read(r, size)))
+                return NULL;
+
+            return me_str_from_borrowed(data, size, length);
+        }
+        case 'c': {
+            uint32_t nargs;
+            if (!mec_read_u32(r, &nargs))
+                return NULL;
+
+            MECodeObject* co = mec_read_co(r);
+            if (!co)
+                return NULL;
+
+            co->in_function = 1;
+            return me_function_new(co, nargs);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static MECodeObject* mec_read_co(MecReader* r) {
+    uint32_t name_size;
+    const char* name;
+    if (!mec_read_u32(r, &name_size) || !(name = mec_read(r, name_size)))
+        return NULL;
+
+    MECodeObject* co = co_alloc(name, name_size, 0);
+    darray_free(co->co_lines);
+    free(co->co_bytecode);
+    co->co_lines = NULL;
+    co->co_bytecode = NULL;
+    co->co_mapped = 1;
+
+    uint32_t code_size, count;
+    const void* data;
+    if (!mec_read_u32(r, &co->co_nlocals) || !mec_read_u32(r, &co->co_stacksize))
+        goto fail;
+
+    if (!mec_read_u32(r, &code_size) || !(data = mec_read(r, code_size)))
+        goto fail;
+
+    co->co_bytecode = (uint8_t*)data;
+    co->co_size = code_size;
+    co->co_capacity = code_size;
+
+    if (!mec_read_u32(r, &co->co_nlines) || !mec_read(r, (4 - r->pos % 4) % 4)
+        || !(data = mec_read(r, sizeof(MECodeLine) * (size_t)co->co_nlines)))
+        goto fail;
+
+    co->co_lines = (MECodeLine*)data;
+
+    if (!mec_read_u32(r, &count))
+        goto fail;
+
+    for (uint32_t i = 0; i < count; i++) {
+        MECodeCache cache = { .counter = 0, .cached = NULL };
+        if (!mec_read_u32(r, &cache.offset))
+            goto fail;
+
+        darray_push(co->co_caches, cache);
+    }
+
+    if (!mec_read_u32(r, &count))
+        goto fail;
+
+    for (uint32_t i = 0; i < count; i++) {
+        MEObject* obj = mec_read_const(r);
+        if (!obj)
+            goto fail;
+
+        darray_pushd(co->co_consts, obj);
+    }
+
+    return co;
+
+fail:
+    co_free(co);
+    return NULL;
+}
+
+MECodeObject* mec_load(const char* path, uint64_t src_hash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 8) {
+        close(fd);
+        return NULL;
+    }
+
+    // Private writable mapping, writes (quickening) get their own copy of the page and never reach the file
+    size_t size = st.st_size;
+    uint8_t* image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        return NULL;
+
+    MecReader r = { .data = image, .size = size - 8, .pos = 0 };
+    uint32_t header[4];
+    const void* magic = mec_read(&r, 4);
+    const void* fields = mec_read(&r, sizeof(header));
+    const void* hash = mec_read(&r, 8);
+    uint32_t nglobals;
+    uint64_t checksum;
+    MECodeObject* co = NULL;
+
+    if (!magic || !fields || !hash || !mec_read_u32(&r, &nglobals) || memcmp(magic, MEC_MAGIC, 4) != 0)
+        goto fail;
+
+    memcpy(header, fields, sizeof(header));
+    if (header[0] != MEC_ENDIAN || header[1] != ME_MEC_VERSION || header[2] != CO_OP_COUNT || header[3] != mec_options())
+        goto fail;
+
+    if (memcmp(hash, &src_hash, 8) != 0)
+        goto fail;
+
+    memcpy(&checksum, image + size - 8, 8);
+    if (checksum != mec_hash_update(MEC_HASH_SEED, image, size - 8))
+        goto fail;
+
+    co = mec_read_co(&r);
+    if (!co || r.pos != r.size)
+        goto fail;
+
+    co->co_globals = darray_new(MEObject*);
+    me_register_builtins_co(co);
+    while (darray_size(co->co_globals) < nglobals)
+        darray_pushd(co->co_globals, me_none);
+
+    // A well formed file can still hold bytecode the VM must not run
+    if (!co_verify(co))
+        goto fail;
+
+    co->co_image = image;
+    co->co_image_size = size;
+
+    return co;
+
+fail:
+    // Before the unmap, borrowed strings in a half built module still point into the image
+    co_free(co);
+    munmap(image, size);
+    return NULL;
+}
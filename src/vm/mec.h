@@ -0,0 +1,22 @@
+#ifndef __MEC_H
+#define __MEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "co.h"
+
+// Compiled module cache, "script.me" is cached as "script.mec" next to it. A cache is only used when
+// the source hash, ME_MEC_VERSION, the opcode count and the compile options all match, anything else
+// (including a truncated or foreign file) makes the caller compile from source again.
+
+// Bump whenever the bytecode or the file layout changes
+#define ME_MEC_VERSION 7
+
+char* mec_path(const char* filename);
+uint64_t mec_hash(const char* src, size_t size);
+
+MECodeObject* mec_load(const char* path, uint64_t src_hash);
+int mec_save(const char* path, MECodeObject* co, uint64_t src_hash);
+
+#endif
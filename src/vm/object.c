@@ -2,6 +2,10 @@
 
 #include "objects/boolobject.h"
 
+#if ME_COUNT_REFCOUNTS
+MERefcountStats me_refcount_stats;
+#endif
+
 void me_objects_init() {
     // This is an initializer for some type objects that need runtime initialization.
     me_bool_init();
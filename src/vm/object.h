@@ -3,19 +3,50 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <limits.h>
 
 typedef struct METypeObject METypeObject;
 typedef struct MEObject MEObject;
 
-#define ME_INCREF(obj) do { if ((obj) != NULL) ++(obj)->ob_refcount; } while (0)
-#define ME_DECREF(obj) do { if (--(obj)->ob_refcount <= 0 && (obj)->ob_type->tp_dealloc) (obj)->ob_type->tp_dealloc(obj); } while (0)
-#define ME_XDECREF(obj) do { if (obj != NULL && --(obj)->ob_refcount <= 0 && (obj)->ob_type->tp_dealloc) (obj)->ob_type->tp_dealloc(obj); } while (0)
+// Small integers never touch the heap, they are stored in the pointer itself with the lowest bit
+// set. Real objects are at least 8 byte aligned so that bit is always clear for them. Tagged
+// values have no refcount and no ob_type, everything that looks inside an object has to go
+// through the macros below.
+#define ME_IS_TAGGED_INT(obj)               (((uintptr_t)(obj)) & 1)
+#define ME_TAGGED_INT_FROM(value)           ((MEObject*)(((uintptr_t)(long)(value) << 1) | 1))
+#define ME_TAGGED_INT_VALUE(obj)            ((long)((intptr_t)(obj) >> 1))
+#define ME_TAGGED_INT_MIN                   (LONG_MIN >> 1)
+#define ME_TAGGED_INT_MAX                   (LONG_MAX >> 1)
+
+// Build with -DME_COUNT_REFCOUNTS=1 to count every refcount write into me_refcount_stats, to see
+// what the VM's borrowed loads save. Tagged ints are not counted, they have no refcount to write.
+#ifndef ME_COUNT_REFCOUNTS
+#define ME_COUNT_REFCOUNTS 0
+#endif
+
+#if ME_COUNT_REFCOUNTS
+typedef struct {
+    uint64_t increfs;
+    uint64_t decrefs;
+} MERefcountStats;
+
+extern MERefcountStats me_refcount_stats;
+#define ME_COUNT_REFCOUNT(op) (me_refcount_stats.op++)
+#else
+#define ME_COUNT_REFCOUNT(op) ((void)0)
+#endif
+
+#define ME_INCREF(obj) do { if ((obj) != NULL && !ME_IS_TAGGED_INT(obj)) { ME_COUNT_REFCOUNT(increfs); ++(obj)->ob_refcount; } } while (0)
+#define ME_DECREF(obj) do { if (!ME_IS_TAGGED_INT(obj) && (ME_COUNT_REFCOUNT(decrefs), --(obj)->ob_refcount <= 0) && (obj)->ob_type->tp_dealloc) (obj)->ob_type->tp_dealloc(obj); } while (0)
+#define ME_XDECREF(obj) do { if (obj != NULL && !ME_IS_TAGGED_INT(obj) && (ME_COUNT_REFCOUNT(decrefs), --(obj)->ob_refcount <= 0) && (obj)->ob_type->tp_dealloc) (obj)->ob_type->tp_dealloc(obj); } while (0)
 
 #define ME_OBJHEAD size_t ob_refcount; METypeObject* ob_type;
 
-#define ME_TYPE(obj)                        ((obj)->ob_type)
-#define ME_TYPE_NAME(obj)                   ((obj)->ob_type->tp_name)
-#define ME_TYPE_CHECK(obj, typeobject)      ((obj)->ob_type == typeobject || (obj)->ob_type->tp_base == typeobject)
+#define ME_TYPE(obj)                        (ME_IS_TAGGED_INT(obj) ? &me_type_long : (obj)->ob_type)
+#define ME_TYPE_NAME(obj)                   (ME_TYPE(obj)->tp_name)
+#define ME_TYPE_CHECK(obj, typeobject)      (ME_TYPE(obj) == typeobject || ME_TYPE(obj)->tp_base == typeobject)
+
+extern METypeObject me_type_long;
 
 struct MEObject {
     ME_OBJHEAD
@@ -32,10 +32,6 @@ MEObject* me_bool_from_str(MEObject* str) {
     return (ME_TYPE_CHECK(str, &me_type_str) && ((MEStrObject*)str)->ob_length > 0) ? me_true : me_false;
 }
 
-static void bool_dealloc(MEObject* obj) {
-    free(obj);
-}
-
 static MEObject* bool_str(MEObject* obj) {
     return me_str_from_long(((MEBoolObject*)obj)->ob_value);
 }
@@ -48,7 +44,7 @@ METypeObject me_type_bool = {
     .tp_name = "bool",
     .tp_base = &me_type_long,
     .tp_sizeof = sizeof(MEBoolObject),
-    .tp_dealloc = (fn_destructor)bool_dealloc,
+    .tp_dealloc = NULL, // Both instances are static, like none they are never freed
     .tp_str = (fn_str)bool_str,
     .tp_bool = (fn_bool)bool_bool,
     .tp_call = NULL,
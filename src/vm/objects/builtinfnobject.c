@@ -6,8 +6,10 @@
 #include "boolobject.h"
 #include "strobject.h"
 
+#include "../alloc.h"
+
 static MEObject* builtinfn_dealloc(MEObject* obj) {
-    free(obj);
+    me_object_free(obj);
     return NULL;
 }
 
@@ -34,14 +36,12 @@ static MEObject* builtinfn_cmp(MEObject* v, MEObject* w, MECmpOp op) {
 
 
 MEObject* me_builtinfn_new(const char* name, MEBuiltinFunction fn) {
-    MEBuiltinFnObject* obj = malloc(sizeof(MEBuiltinFnObject));
+    MEBuiltinFnObject* obj = (MEBuiltinFnObject*)me_object_alloc(&me_type_builtinfn);
     if (!obj) {
         me_set_error(me_error_generic, "Failed to allocate memory for builtin function object");
         return NULL;
     }
     
-    obj->ob_type = &me_type_builtinfn;
-    obj->ob_refcount = 1; // Initial reference count
 
     obj->ob_name = name;
     obj->fn = fn;
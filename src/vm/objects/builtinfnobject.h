@@ -5,7 +5,7 @@
 
 extern METypeObject me_type_builtinfn;
 
-typedef MEObject* (*MEBuiltinFunction)(MEObject* self, MEObject** args);
+typedef MEObject* (*MEBuiltinFunction)(MEObject* self, MEObject** args, size_t nargs);
 
 typedef struct {
     ME_OBJHEAD
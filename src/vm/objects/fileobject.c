@@ -7,10 +7,11 @@
 #include "boolobject.h"
 #include "strobject.h"
 
+#include "../alloc.h"
+
 
 MEObject* me_file_new(FILE* file, const char* filename, const char* mode) {
-    MEFileObject* obj = malloc(sizeof(MEFileObject));
-    obj->ob_type = &me_file_type;
+    MEFileObject* obj = (MEFileObject*)me_object_alloc(&me_file_type);
     obj->ob_file = file;
     obj->ob_filename = strdup(filename);
     obj->ob_mode = strdup(mode);
@@ -25,7 +26,7 @@ void file_dealloc(MEObject* self) {
 
     free(file_obj->ob_filename);
     free(file_obj->ob_mode);
-    free(self);
+    me_object_free(self);
 }
 
 static MEObject* file_str(MEObject* obj) {
@@ -8,13 +8,13 @@
 #include "boolobject.h"
 #include "strobject.h"
 
+#include "../alloc.h"
+
 MEObject* me_float_from_double(double value) {
-    MEFloatObject* obj = (MEFloatObject*)malloc(sizeof(MEFloatObject));
+    MEFloatObject* obj = (MEFloatObject*)me_object_alloc(&me_type_float);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_float;
-    obj->ob_refcount = 1;
 
     obj->ob_value = value;
 
@@ -22,12 +22,10 @@ MEObject* me_float_from_double(double value) {
 }
 
 MEObject* me_float_from_long(long value) {
-    MEFloatObject* obj = (MEFloatObject*)malloc(sizeof(MEFloatObject));
+    MEFloatObject* obj = (MEFloatObject*)me_object_alloc(&me_type_float);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_float;
-    obj->ob_refcount = 1;
 
     obj->ob_value = value;
 
@@ -35,12 +33,10 @@ MEObject* me_float_from_long(long value) {
 }
 
 MEObject* me_float_from_ulong(unsigned long value) {
-    MEFloatObject* obj = (MEFloatObject*)malloc(sizeof(MEFloatObject));
+    MEFloatObject* obj = (MEFloatObject*)me_object_alloc(&me_type_float);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_float;
-    obj->ob_refcount = 1;
 
     obj->ob_value = value;
 
@@ -48,17 +44,15 @@ MEObject* me_float_from_ulong(unsigned long value) {
 }
 
 MEObject* me_float_from_str(const char* str) {
-    MEFloatObject* obj = (MEFloatObject*)malloc(sizeof(MEFloatObject));
+    MEFloatObject* obj = (MEFloatObject*)me_object_alloc(&me_type_float);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_float;
-    obj->ob_refcount = 1;
 
     char* endptr;
     double value = strtod(str, &endptr);
     if (*endptr != '\0') {
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
@@ -68,7 +62,7 @@ MEObject* me_float_from_str(const char* str) {
 }
 
 static void float_dealloc(MEObject* obj) {
-    free(obj);
+    me_object_free(obj);
 }
 
 static MEObject* float_str(MEObject* obj) {
@@ -90,20 +84,17 @@ static MEObject* float_cmp(MEObject* v, MEObject* w, MECmpOp op) {
     if (me_float_check(w))
         rhs = ((MEFloatObject*)w)->ob_value;
     else if (me_long_check(w))
-        rhs = (double)((MELongObject*)w)->ob_value;
+        rhs = (double)me_long_value(w);
     else
         return me_error_notimplemented;
 
-    double lhv = ((MEFloatObject*)v)->ob_value;
-    double rhv = ((MEFloatObject*)w)->ob_value;
-
     switch (op) {
-        case ME_CMP_EQ: return lhv == rhv ? me_true : me_false;
-        case ME_CMP_NEQ: return lhv != rhv ? me_true : me_false;
-        case ME_CMP_LT: return lhv < rhv ? me_true : me_false;
-        case ME_CMP_LTE: return lhv <= rhv ? me_true : me_false;
-        case ME_CMP_GT: return lhv > rhv ? me_true : me_false;
-        case ME_CMP_GTE: return lhv >= rhv ? me_true : me_false;
+        case ME_CMP_EQ: return lhs == rhs ? me_true : me_false;
+        case ME_CMP_NEQ: return lhs != rhs ? me_true : me_false;
+        case ME_CMP_LT: return lhs < rhs ? me_true : me_false;
+        case ME_CMP_LTE: return lhs <= rhs ? me_true : me_false;
+        case ME_CMP_GT: return lhs > rhs ? me_true : me_false;
+        case ME_CMP_GTE: return lhs >= rhs ? me_true : me_false;
         default:
             return me_error_notimplemented;
     }
@@ -113,7 +104,7 @@ static MEObject* float_nb_add(MEObject* v, MEObject* w) {
     if (me_float_check(w))
         return me_float_from_double(((MEFloatObject*)v)->ob_value + ((MEFloatObject*)w)->ob_value);
     else if (me_long_check(w))
-        return me_float_from_double(((MEFloatObject*)v)->ob_value + (double)((MELongObject*)w)->ob_value);
+        return me_float_from_double(((MEFloatObject*)v)->ob_value + (double)me_long_value(w));
     else
         return me_error_notimplemented;
 }
@@ -122,7 +113,7 @@ static MEObject* float_nb_sub(MEObject* v, MEObject* w) {
     if (me_float_check(w))
         return me_float_from_double(((MEFloatObject*)v)->ob_value - ((MEFloatObject*)w)->ob_value);
     else if (me_long_check(w))
-        return me_float_from_double(((MEFloatObject*)v)->ob_value - (double)((MELongObject*)w)->ob_value);
+        return me_float_from_double(((MEFloatObject*)v)->ob_value - (double)me_long_value(w));
     else
         return me_error_notimplemented;
 }
@@ -131,7 +122,7 @@ static MEObject* float_nb_mul(MEObject* v, MEObject* w) {
     if (me_float_check(w))
         return me_float_from_double(((MEFloatObject*)v)->ob_value * ((MEFloatObject*)w)->ob_value);
     else if (me_long_check(w))
-        return me_float_from_double(((MEFloatObject*)v)->ob_value * (double)((MELongObject*)w)->ob_value);
+        return me_float_from_double(((MEFloatObject*)v)->ob_value * (double)me_long_value(w));
     else
         return me_error_notimplemented;
 }
@@ -144,11 +135,11 @@ static MEObject* float_nb_div(MEObject* v, MEObject* w) {
         }
         return me_float_from_double(((MEFloatObject*)v)->ob_value / ((MEFloatObject*)w)->ob_value);
     } else if (me_long_check(w)) {
-        if (((MELongObject*)w)->ob_value == 0) {
+        if (me_long_value(w) == 0) {
             me_set_error(me_error_divisionbyzero, "Division by zero in float division");
             return NULL;
         }
-        return me_float_from_double(((MEFloatObject*)v)->ob_value / (double)((MELongObject*)w)->ob_value);
+        return me_float_from_double(((MEFloatObject*)v)->ob_value / (double)me_long_value(w));
     } else {
         return me_error_notimplemented;
     }
@@ -162,11 +153,11 @@ static MEObject* float_nb_mod(MEObject* v, MEObject* w) {
         }
         return me_float_from_double(fmod(((MEFloatObject*)v)->ob_value, ((MEFloatObject*)w)->ob_value));
     } else if (me_long_check(w)) {
-        if (((MELongObject*)w)->ob_value == 0) {
+        if (me_long_value(w) == 0) {
             me_set_error(me_error_divisionbyzero, "Division by zero in modulo operation");
             return NULL;
         }
-        return me_float_from_double(fmod(((MEFloatObject*)v)->ob_value, (double)((MELongObject*)w)->ob_value));
+        return me_float_from_double(fmod(((MEFloatObject*)v)->ob_value, (double)me_long_value(w)));
     } else {
         return me_error_notimplemented;
     }
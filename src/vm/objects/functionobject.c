@@ -3,15 +3,15 @@
 #include "boolobject.h"
 #include "errorobject.h"
 
+#include "../alloc.h"
+
 MEObject* me_function_new(MECodeObject* co, size_t nargs) {
-    MEFunctionObject* obj = malloc(sizeof(MEFunctionObject));
+    MEFunctionObject* obj = (MEFunctionObject*)me_object_alloc(&me_type_function);
     if (!obj) {
         me_set_error(me_error_outofmemory, "Failed to allocate memory for function object");
         return NULL;
     }
 
-    obj->ob_type = &me_type_function;
-    obj->ob_refcount = 1;
 
     obj->co = co;
     obj->nargs = nargs;
@@ -20,7 +20,7 @@ MEObject* me_function_new(MECodeObject* co, size_t nargs) {
 }
 
 static void function_dealloc(MEObject* obj) {
-    free(obj);
+    me_object_free(obj);
 }
 
 static MEObject* function_str(MEObject* obj) {
@@ -6,70 +6,61 @@
 #include "boolobject.h"
 #include "errorobject.h"
 
-MEObject* me_long_from_long(long value) {
-    MELongObject* obj = (MELongObject*)malloc(sizeof(MELongObject));
+#include "../alloc.h"
+
+// Only values that do not fit in a tagged pointer end up on the heap
+static MEObject* long_alloc(long value) {
+    MELongObject* obj = (MELongObject*)me_object_alloc(&me_type_long);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_long;
-    obj->ob_refcount = 1;
 
     obj->ob_value = value;
 
     return (MEObject*)obj;
 }
 
-MEObject* me_long_from_ulong(unsigned long value) {
-    MELongObject* obj = (MELongObject*)malloc(sizeof(MELongObject));
-    if (!obj)
-        return NULL;
+MEObject* me_long_from_long(long value) {
+    if (value >= ME_TAGGED_INT_MIN && value <= ME_TAGGED_INT_MAX)
+        return ME_TAGGED_INT_FROM(value);
 
-    obj->ob_type = &me_type_long;
-    obj->ob_refcount = 1;
+    return long_alloc(value);
+}
 
-    obj->ob_value = value;
+MEObject* me_long_from_ulong(unsigned long value) {
+    if (value <= ME_TAGGED_INT_MAX)
+        return ME_TAGGED_INT_FROM(value);
 
-    return (MEObject*)obj;
+    return long_alloc((long)value);
 }
 
 MEObject* me_long_from_str(const char* str) {
-    MELongObject* obj = (MELongObject*)malloc(sizeof(MELongObject));
-    if (!obj)
-        return NULL;
-
-    obj->ob_type = &me_type_long;
-    obj->ob_refcount = 1;
-
     char* endptr;
     long value = strtol(str, &endptr, 10);
-    if (*endptr != '\0') {
-        free(obj);
+    if (*endptr != '\0')
         return NULL;
-    }
 
-    obj->ob_value = value;
-
-    return (MEObject*)obj;
+    return me_long_from_long(value);
 }
 
 static void long_dealloc(MEObject* obj) {
-    free(obj);
+    me_object_free(obj);
 }
 
 static MEObject* long_str(MEObject* obj) {
-    return me_str_from_long(((MELongObject*)obj)->ob_value);
+    return me_str_from_long(me_long_value(obj));
 }
 
 static MEObject* long_bool(MEObject* obj) {
-    return ((MELongObject*)obj)->ob_value ? me_true : me_false;
+    return me_long_value(obj) ? me_true : me_false;
 }
 
 static MEObject* long_cmp(MEObject* v, MEObject* w, MECmpOp op) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    long lhs = ((MELongObject*)v)->ob_value;
-    long rhs = ((MELongObject*)w)->ob_value;
+    long lhs = me_long_value(v);
+    long rhs = me_long_value(w);
 
     switch (op) {
         case ME_CMP_EQ: return lhs == rhs ? me_true : me_false;
@@ -87,137 +78,101 @@ static MEObject* long_nb_add(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value + lw->ob_value);
+    return me_long_from_long(me_long_value(v) + me_long_value(w));
 }
 
 static MEObject* long_nb_sub(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value - lw->ob_value);
+    return me_long_from_long(me_long_value(v) - me_long_value(w));
 }
 
 static MEObject* long_nb_mul(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value * lw->ob_value);
+    return me_long_from_long(me_long_value(v) * me_long_value(w));
 }
 
 MEObject* long_nb_div(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    if (lw->ob_value == 0) {
+    if (me_long_value(w) == 0) {
         me_set_error(me_error_divisionbyzero, "Division by zero in modulo operation");
         return NULL;
     }
 
-    return me_long_from_long(lv->ob_value / lw->ob_value);
+    return me_long_from_long(me_long_value(v) / me_long_value(w));
 }
 
 static MEObject* long_nb_mod(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    if (lw->ob_value == 0) {
+    if (me_long_value(w) == 0) {
         me_set_error(me_error_divisionbyzero, "Division by zero in modulo operation");
         return NULL;
     }
 
-    return me_long_from_long(lv->ob_value % lw->ob_value);
+    return me_long_from_long(me_long_value(v) % me_long_value(w));
 }
 
 static MEObject* long_nb_bit_and(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value & lw->ob_value);
+    return me_long_from_long(me_long_value(v) & me_long_value(w));
 }
 
 static MEObject* long_nb_bit_or(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value | lw->ob_value);
+    return me_long_from_long(me_long_value(v) | me_long_value(w));
 }
 
 static MEObject* long_nb_bit_xor(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value ^ lw->ob_value);
+    return me_long_from_long(me_long_value(v) ^ me_long_value(w));
 }
 
 static MEObject* long_nb_lshift(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value << lw->ob_value);
+    return me_long_from_long(me_long_value(v) << me_long_value(w));
 }
 
 static MEObject* long_nb_rshift(MEObject* v, MEObject* w) {
     if (!me_long_check(v) || !me_long_check(w))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-    MELongObject* lw = (MELongObject*)w;
-
-    return me_long_from_long(lv->ob_value >> lw->ob_value);
+    return me_long_from_long(me_long_value(v) >> me_long_value(w));
 }
 
 static MEObject* long_unary_bit_not(MEObject* v) {
     if (!me_long_check(v))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-
-    return me_long_from_long(~lv->ob_value);
+    return me_long_from_long(~me_long_value(v));
 }
 
 static MEObject* long_unary_negative(MEObject* v) {
     if (!me_long_check(v))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-
-    return me_long_from_long(-lv->ob_value);
+    return me_long_from_long(-me_long_value(v));
 }
 
 static MEObject* long_unary_positive(MEObject* v) {
     if (!me_long_check(v))
         return me_error_notimplemented;
 
-    MELongObject* lv = (MELongObject*)v;
-
-    return me_long_from_long(lv->ob_value);
+    return me_long_from_long(me_long_value(v));
 }
 
 METypeObject me_type_long = {
@@ -14,6 +14,14 @@ static inline int me_long_check(MEObject* obj) {
     return ME_TYPE_CHECK(obj, &me_type_long);
 }
 
+// Works for tagged and boxed longs alike, bools share the boxed layout
+static inline long me_long_value(MEObject* obj) {
+    if (ME_IS_TAGGED_INT(obj))
+        return ME_TAGGED_INT_VALUE(obj);
+
+    return ((MELongObject*)obj)->ob_value;
+}
+
 MEObject* me_long_from_long(long value);
 MEObject* me_long_from_ulong(unsigned long value);
 MEObject* me_long_from_str(const char* str);
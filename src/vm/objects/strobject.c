@@ -10,20 +10,21 @@
 #include "boolobject.h"
 #include "longobject.h"
 
+#include "../alloc.h"
+
 MEObject* me_str_from_str(const char* str) {
-    MEStrObject* obj = (MEStrObject*)malloc(sizeof(MEStrObject));
+    MEStrObject* obj = (MEStrObject*)me_object_alloc(&me_type_str);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_str;
-    obj->ob_refcount = 1;
 
     obj->ob_length = utf8_strlen(str);
     obj->ob_bytelength = utf8_strsize(str);
+    obj->ob_borrowed = 0;
 
     obj->ob_value = (char*)malloc(obj->ob_bytelength);
     if (!obj->ob_value) {
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
@@ -33,23 +34,22 @@ MEObject* me_str_from_str(const char* str) {
 }
 
 MEObject* me_str_from_long(long value) {
-    MEStrObject* obj = (MEStrObject*)malloc(sizeof(MEStrObject));
+    MEStrObject* obj = (MEStrObject*)me_object_alloc(&me_type_str);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_str;
-    obj->ob_refcount = 1;
 
+    obj->ob_borrowed = 0;
     obj->ob_value = (char*)malloc(32);
     if (!obj->ob_value) {
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
     int written = snprintf(obj->ob_value, 32, "%ld", value);
     if (written < 0 || written >= 32) {
         free(obj->ob_value);
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
@@ -60,23 +60,22 @@ MEObject* me_str_from_long(long value) {
 }
 
 MEObject* me_str_from_ulong(unsigned long value) {
-    MEStrObject* obj = (MEStrObject*)malloc(sizeof(MEStrObject));
+    MEStrObject* obj = (MEStrObject*)me_object_alloc(&me_type_str);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_str;
-    obj->ob_refcount = 1;
 
+    obj->ob_borrowed = 0;
     obj->ob_value = (char*)malloc(32);
     if (!obj->ob_value) {
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
     int written = snprintf(obj->ob_value, 32, "%lu", value);
     if (written < 0 || written >= 32) {
         free(obj->ob_value);
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
@@ -87,23 +86,22 @@ MEObject* me_str_from_ulong(unsigned long value) {
 }
 
 MEObject* me_str_from_double(double value) {
-    MEStrObject* obj = (MEStrObject*)malloc(sizeof(MEStrObject));
+    MEStrObject* obj = (MEStrObject*)me_object_alloc(&me_type_str);
     if (!obj)
         return NULL;
 
-    obj->ob_type = &me_type_str;
-    obj->ob_refcount = 1;
 
+    obj->ob_borrowed = 0;
     obj->ob_value = (char*)malloc(32);
     if (!obj->ob_value) {
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
     int written = snprintf(obj->ob_value, 32, "%.2f", value);
     if (written < 0 || written >= 32) {
         free(obj->ob_value);
-        free(obj);
+        me_object_free((MEObject*)obj);
         return NULL;
     }
 
@@ -113,12 +111,27 @@ MEObject* me_str_from_double(double value) {
     return (MEObject*)obj;
 }
 
+MEObject* me_str_from_borrowed(const char* data, size_t bytelength, size_t length) {
+    MEStrObject* obj = (MEStrObject*)me_object_alloc(&me_type_str);
+    if (!obj)
+        return NULL;
+
+    obj->ob_value = (char*)data;
+    obj->ob_length = length;
+    obj->ob_bytelength = bytelength;
+    obj->ob_borrowed = 1;
+
+    return (MEObject*)obj;
+}
+
 static void str_dealloc(MEObject* obj) {
-    free(((MEStrObject*)obj)->ob_value);
-    free(obj);
+    if (!((MEStrObject*)obj)->ob_borrowed)
+        free(((MEStrObject*)obj)->ob_value);
+    me_object_free(obj);
 }
 
 static MEObject* str_str(MEObject* obj) {
+    ME_INCREF(obj);
     return obj;
 }
 
@@ -132,7 +145,13 @@ static MEObject* str_cmp(MEObject* v, MEObject* w, MECmpOp op) {
         return NULL;
     }
 
-    int cmp = strcmp(((MEStrObject*)v)->ob_value, ((MEStrObject*)w)->ob_value);
+    // ob_value is not NUL terminated, compare the common prefix and then the lengths
+    MEStrObject* str_v = (MEStrObject*)v;
+    MEStrObject* str_w = (MEStrObject*)w;
+    size_t common = str_v->ob_bytelength < str_w->ob_bytelength ? str_v->ob_bytelength : str_w->ob_bytelength;
+    int cmp = memcmp(str_v->ob_value, str_w->ob_value, common);
+    if (cmp == 0)
+        cmp = (str_v->ob_bytelength > str_w->ob_bytelength) - (str_v->ob_bytelength < str_w->ob_bytelength);
     switch (op) {
         case ME_CMP_EQ: return cmp == 0 ? me_true : me_false;
         case ME_CMP_NEQ: return cmp != 0 ? me_true : me_false;
@@ -154,19 +173,18 @@ static MEObject* str_nb_add(MEObject* v, MEObject* w) {
     MEStrObject* str_v = (MEStrObject*)v;
     MEStrObject* str_w = (MEStrObject*)w;
 
-    MEStrObject* new_str = (MEStrObject*)malloc(sizeof(MEStrObject));
+    MEStrObject* new_str = (MEStrObject*)me_object_alloc(&me_type_str);
     if (!new_str) {
         me_set_error(me_error_outofmemory, "Out of memory while adding strings");
         return NULL;
     }
 
-    new_str->ob_type = &me_type_str;
-    new_str->ob_refcount = 1;
     new_str->ob_length = str_v->ob_length + str_w->ob_length;
     new_str->ob_bytelength = str_v->ob_bytelength + str_w->ob_bytelength;
+    new_str->ob_borrowed = 0;
     new_str->ob_value = (char*)malloc(new_str->ob_bytelength);
     if (!new_str->ob_value) {
-        free(new_str);
+        me_object_free((MEObject*)new_str);
         me_set_error(me_error_outofmemory, "Out of memory while adding strings");
         return NULL;
     }
@@ -182,29 +200,28 @@ static MEObject* str_nb_mul(MEObject* v, MEObject* w) {
         return me_error_notimplemented;
 
     MEStrObject* str_v = (MEStrObject*)v;
-    MELongObject* long_w = (MELongObject*)w;
+    long count = me_long_value(w);
 
-    if (long_w->ob_value < 0)
+    if (count < 0)
         return me_str_from_str(""); 
 
-    MEStrObject* new_str = (MEStrObject*)malloc(sizeof(MEStrObject));
+    MEStrObject* new_str = (MEStrObject*)me_object_alloc(&me_type_str);
     if (!new_str) {
         me_set_error(me_error_outofmemory, "Out of memory while multiplying string");
         return NULL;
     }
 
-    new_str->ob_type = &me_type_str;
-    new_str->ob_refcount = 1;
-    new_str->ob_length = str_v->ob_length * long_w->ob_value;
-    new_str->ob_bytelength = str_v->ob_bytelength * long_w->ob_value;
+    new_str->ob_length = str_v->ob_length * count;
+    new_str->ob_bytelength = str_v->ob_bytelength * count;
+    new_str->ob_borrowed = 0;
     new_str->ob_value = (char*)malloc(new_str->ob_bytelength);
     if (!new_str->ob_value) {
-        free(new_str);
+        me_object_free((MEObject*)new_str);
         me_set_error(me_error_outofmemory, "Out of memory while multiplying string");
         return NULL;
     }
 
-    for (size_t i = 0; i < long_w->ob_value; i++)
+    for (size_t i = 0; i < count; i++)
         memcpy(new_str->ob_value + i * str_v->ob_bytelength, str_v->ob_value, str_v->ob_bytelength);
 
     return (MEObject*)new_str;
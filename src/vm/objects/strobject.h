@@ -10,6 +10,7 @@ typedef struct {
     char* ob_value;
     size_t ob_length;
     size_t ob_bytelength;
+    int ob_borrowed; // ob_value belongs to someone else (a mapped .mec image) and is never freed
 } MEStrObject;
 
 static inline int me_str_check(MEObject* obj) {
@@ -20,5 +21,7 @@ MEObject* me_str_from_str(const char* str);
 MEObject* me_str_from_long(long value);
 MEObject* me_str_from_ulong(unsigned long value);
 MEObject* me_str_from_double(double value);
+// No copy, "data" must outlive the object
+MEObject* me_str_from_borrowed(const char* data, size_t bytelength, size_t length);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,420 @@
+#include "co.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils/darray.h"
+
+// Post compile clean up of co_bytecode. Everything it removes is first overwritten with NOPs so
+// offsets stay put while the passes run, the last pass squeezes the NOPs out and rebases jumps,
+// cache offsets and co_lines onto the compacted code. Loops are already closed by then, so the
+// break patches are plain jumps like any other.
+
+#define PP_MAX_THREADING 16
+
+// Instructions may carry an EXTENDED_ARG prefix, the passes work on whole instructions. "pos" is where
+// the prefix (or the opcode when there is none) starts, pp_op_pos is where the opcode is.
+static uint32_t pp_op_pos(uint8_t* code, uint32_t pos) {
+    return code[pos] == CO_OP_EXTENDED_ARG ? pos + 3 : pos;
+}
+
+static uint8_t pp_op(uint8_t* code, uint32_t pos) {
+    return code[pp_op_pos(code, pos)];
+}
+
+static uint32_t pp_size(uint8_t* code, uint32_t pos) {
+    uint32_t op_pos = pp_op_pos(code, pos);
+    return op_pos - pos + co_op_size[code[op_pos]];
+}
+
+// The u16 operand is always the last field of an instruction
+static uint32_t pp_arg(uint8_t* code, uint32_t pos) {
+    uint32_t op_pos = pp_op_pos(code, pos);
+    uint16_t high = op_pos != pos ? co_read_u16(code + pos + 1) : 0;
+    return co_arg_value(code[op_pos], high, co_read_u16(code + op_pos + co_op_size[code[op_pos]] - 2));
+}
+
+static int pp_is_jump(uint8_t op) {
+    return op == CO_OP_JUMP_REL || op == CO_OP_JUMP_IF_FALSE || op == CO_OP_JUMP_IF_FALSE_OR_POP || op == CO_OP_JUMP_IF_TRUE_OR_POP
+        || op == CO_OP_COMPARE_JUMP_IF_FALSE;
+}
+
+static uint32_t pp_jump_target(uint8_t* code, uint32_t pos) {
+    uint32_t end = pos + pp_size(code, pos);
+    if (pp_op(code, pos) == CO_OP_JUMP_REL)
+        return end + (int32_t)pp_arg(code, pos);
+
+    return end + pp_arg(code, pos);
+}
+
+// Points the jump at "pos" to "target" if its operand can encode it
+static int pp_set_jump_target(uint8_t* code, uint32_t pos, uint32_t target) {
+    uint32_t op_pos = pp_op_pos(code, pos);
+    uint8_t op = code[op_pos];
+    int64_t offset = (int64_t)target - (op_pos + co_op_size[op]);
+
+    if (op != CO_OP_JUMP_REL && offset < 0)
+        return 0;
+
+    uint32_t value = (uint32_t)offset;
+    if (op_pos == pos && !co_arg_fits(op, value))
+        return 0;
+
+    if (op_pos != pos) {
+        uint16_t high = co_arg_high(op, value);
+        memcpy(code + pos + 1, &high, 2);
+    }
+
+    uint16_t low = value & 0xFFFF;
+    memcpy(code + op_pos + co_op_size[op] - 2, &low, 2);
+    return 1;
+}
+
+static void pp_nop(uint8_t* code, uint32_t pos) {
+    memset(code + pos, CO_OP_NOP, pp_size(code, pos));
+}
+
+static int pp_stack_effect(uint8_t* code, uint32_t pos) {
+    uint32_t op_pos = pp_op_pos(code, pos);
+    uint8_t op = code[op_pos];
+    if (op == CO_OP_CALL_FUNCTION || op == CO_OP_CALL_EXACT_ARGS || op == CO_OP_CALL_BUILTIN || op == CO_OP_TAIL_CALL)
+        return co_op_stack_effect[op] - (int)code[op_pos + 1];
+
+    return co_op_stack_effect[op];
+}
+
+// Values an instruction takes off the stack, what it pushes is that plus its stack effect
+static int pp_pops(uint8_t* code, uint32_t pos) {
+    uint32_t op_pos = pp_op_pos(code, pos);
+    uint8_t op = code[op_pos];
+    if (op == CO_OP_CALL_FUNCTION || op == CO_OP_CALL_EXACT_ARGS || op == CO_OP_CALL_BUILTIN || op == CO_OP_TAIL_CALL)
+        return code[op_pos + 1] + co_op_pops[op];
+
+    return co_op_pops[op];
+}
+
+// Whether a jump of "op" landing on "target_op" can go straight to that one's target. A short-circuit
+// jump keeps the value it tested, the next one of the same kind tests it again and jumps as well.
+static int pp_threads_through(uint8_t op, uint8_t target_op) {
+    if (target_op == CO_OP_JUMP_REL)
+        return 1;
+
+    return target_op == op && (op == CO_OP_JUMP_IF_FALSE_OR_POP || op == CO_OP_JUMP_IF_TRUE_OR_POP);
+}
+
+// Jumps landing on an unconditional jump go straight to its target instead
+static void pp_thread_jumps(uint8_t* code, uint32_t size) {
+    for (uint32_t pos = 0; pos < size; pos += pp_size(code, pos)) {
+        uint8_t op = pp_op(code, pos);
+        if (!pp_is_jump(op))
+            continue;
+
+        uint32_t target = pp_jump_target(code, pos);
+        for (int i = 0; i < PP_MAX_THREADING && target < size && pp_threads_through(op, pp_op(code, target)) && target != pos; i++)
+            target = pp_jump_target(code, target);
+
+        if (target <= size)
+            pp_set_jump_target(code, pos, target);
+
+        // A jump to the next instruction does nothing, a conditional one still has to drop its condition.
+        // The short-circuit ones only drop it on one path and stay.
+        if (pp_jump_target(code, pos) == pos + pp_size(code, pos)) {
+            if (op == CO_OP_JUMP_REL) {
+                pp_nop(code, pos);
+            } else if (op == CO_OP_JUMP_IF_FALSE) {
+                pp_nop(code, pos);
+                code[pos] = CO_OP_POP;
+            }
+        }
+    }
+}
+
+// Anything not reachable from the entry is turned into NOPs, typically code after a RETURN or a
+// "yeter" and the implicit RETURN NONE of functions that always return
+static void pp_remove_dead_code(uint8_t* code, uint32_t size) {
+    uint8_t* reachable = calloc(size + 1, 1);
+    uint32_t* worklist = malloc(sizeof(uint32_t) * (size + 1));
+    uint32_t count = 0;
+
+    worklist[count++] = 0;
+    while (count > 0) {
+        uint32_t pos = worklist[--count];
+        while (pos < size && !reachable[pos]) {
+            reachable[pos] = 1;
+            uint8_t op = pp_op(code, pos);
+
+            if (pp_is_jump(op)) {
+                uint32_t target = pp_jump_target(code, pos);
+                if (target < size && !reachable[target])
+                    worklist[count++] = target;
+            }
+
+            if (op == CO_OP_RETURN || op == CO_OP_TAIL_CALL || op == CO_OP_JUMP_REL)
+                break;
+
+            pos += pp_size(code, pos);
+        }
+    }
+
+    for (uint32_t pos = 0; pos < size;) {
+        uint32_t next = pos + pp_size(code, pos);
+        if (!reachable[pos])
+            pp_nop(code, pos);
+
+        pos = next;
+    }
+
+    free(worklist);
+    free(reachable);
+}
+
+static uint8_t* pp_find_jump_targets(uint8_t* code, uint32_t size) {
+    uint8_t* targets = calloc(size + 1, 1);
+    for (uint32_t pos = 0; pos < size; pos += pp_size(code, pos)) {
+        if (pp_is_jump(pp_op(code, pos)) && pp_jump_target(code, pos) <= size)
+            targets[pp_jump_target(code, pos)] = 1;
+    }
+
+    return targets;
+}
+
+static uint32_t pp_next(uint8_t* code, uint32_t size, uint32_t pos) {
+    pos += pp_size(code, pos);
+    while (pos < size && code[pos] == CO_OP_NOP)
+        pos++;
+
+    return pos;
+}
+
+// Whether anything jumps into (from, to], merging the instructions at both ends is unsafe then
+static int pp_has_target(uint8_t* targets, uint32_t from, uint32_t to) {
+    for (uint32_t pos = from + 1; pos <= to; pos++) {
+        if (targets[pos])
+            return 1;
+    }
+
+    return 0;
+}
+
+static uint8_t pp_load_of_store(uint8_t op) {
+    switch (op) {
+        case CO_OP_STORE_GLOBAL: return CO_OP_LOAD_GLOBAL;
+        case CO_OP_STORE_VARIABLE: return CO_OP_LOAD_VARIABLE;
+        default: return CO_OP_NOP;
+    }
+}
+
+// An assignment compiles to "LOAD lhs; <rhs>; BINARY_OP ASSIGN; STORE lhs", the lhs load only exists
+// to be thrown away again. Walks back from the BINARY_OP over the straight line code in "block" to
+// find the instruction that pushed the lhs slot, both are removed when it is a plain load. Anything
+// else produced it (a DUP left by an earlier rewrite, say) and the assignment is left alone.
+static int pp_collapse_assign(uint8_t* code, uint32_t* block, uint32_t block_size, uint32_t assign_pos) {
+    int slot = 2; // Of the lhs counted from the top, 1 being the top, right after the instruction
+    for (uint32_t i = block_size; i-- > 0;) {
+        uint32_t pos = block[i];
+        int pops = pp_pops(code, pos);
+        int pushes = pops + pp_stack_effect(code, pos);
+
+        if (slot <= pushes) {
+            uint8_t op = pp_op(code, pos);
+            if (slot != 1 || (op != CO_OP_LOAD_CONST && op != CO_OP_LOAD_GLOBAL && op != CO_OP_LOAD_VARIABLE))
+                return 0;
+
+            pp_nop(code, pos);
+            pp_nop(code, assign_pos);
+            return 1;
+        }
+
+        slot += pops - pushes;
+    }
+
+    return 0;
+}
+
+static int pp_patterns(uint8_t* code, uint32_t size, uint8_t* targets) {
+    int changed = 0;
+    uint32_t* block = malloc(sizeof(uint32_t) * (size + 1));
+    uint32_t block_size = 0;
+
+    for (uint32_t pos = 0; pos < size; pos += pp_size(code, pos)) {
+        uint8_t op = pp_op(code, pos);
+        if (targets[pos])
+            block_size = 0;
+
+        if (op == CO_OP_NOP)
+            continue;
+
+        uint32_t next = pp_next(code, size, pos);
+        uint8_t next_op = next < size ? pp_op(code, next) : CO_OP_NOP;
+        int next_free = next < size && !pp_has_target(targets, pos, next);
+
+        // Pure push immediately dropped, "LOAD_CONST; POP" of expression statements and the like
+        if ((op == CO_OP_LOAD_CONST || op == CO_OP_LOAD_GLOBAL || op == CO_OP_LOAD_VARIABLE || op == CO_OP_DUP)
+            && next_op == CO_OP_POP && next_free) {
+            pp_nop(code, pos);
+            pp_nop(code, next);
+            block_size = 0;
+            changed = 1;
+            continue;
+        }
+
+        // "STORE_x i; LOAD_x i" becomes "DUP; STORE_x i"
+        if (pp_load_of_store(op) != CO_OP_NOP && next_free && next_op == pp_load_of_store(op)
+            && pp_size(code, next) == pp_size(code, pos) && pp_arg(code, next) == pp_arg(code, pos)) {
+            uint8_t store[6];
+            uint32_t store_size = pp_size(code, pos);
+            memcpy(store, code + pos, store_size);
+            pp_nop(code, next);
+            code[pos] = CO_OP_DUP;
+            memcpy(code + pos + 1, store, store_size);
+            block_size = 0;
+            changed = 1;
+            continue;
+        }
+
+        block[block_size++] = pos;
+        if (pp_is_jump(op) || op == CO_OP_RETURN || op == CO_OP_TAIL_CALL)
+            block_size = 0;
+    }
+
+    free(block);
+    return changed;
+}
+
+// Runs before pp_patterns, "STORE_x i; LOAD_x i" would otherwise take the lhs load of "i = i + 1"
+// right after a store to i and leave a DUP behind in its place
+static void pp_assignments(uint8_t* code, uint32_t size, uint8_t* targets) {
+    uint32_t* block = malloc(sizeof(uint32_t) * (size + 1));
+    uint32_t block_size = 0;
+
+    for (uint32_t pos = 0; pos < size; pos += pp_size(code, pos)) {
+        uint8_t op = pp_op(code, pos);
+        if (targets[pos])
+            block_size = 0;
+
+        if (op == CO_OP_NOP)
+            continue;
+
+        if (op == CO_OP_BINARY_OP && code[pp_op_pos(code, pos) + 1] == BIN_ASSIGN && pp_collapse_assign(code, block, block_size, pos)) {
+            block_size = 0; // Positions in it may now point at NOPs
+            continue;
+        }
+
+        block[block_size++] = pos;
+        if (pp_is_jump(op) || op == CO_OP_RETURN || op == CO_OP_TAIL_CALL)
+            block_size = 0;
+    }
+
+    free(block);
+}
+
+// Squeezes the NOPs out and rebases everything that refers to a bytecode offset
+static void pp_compact(MECodeObject* co) {
+    uint8_t* code = co->co_bytecode;
+    uint32_t size = co->co_size;
+
+    // New offset of every old byte, removed bytes map to the next surviving instruction
+    uint32_t* remap = malloc(sizeof(uint32_t) * (size + 1));
+    uint32_t new_size = 0;
+    for (uint32_t pos = 0; pos < size;) {
+        uint8_t len = co_op_size[code[pos]];
+        for (uint32_t i = 0; i < len; i++)
+            remap[pos + i] = new_size;
+
+        if (code[pos] != CO_OP_NOP)
+            new_size += len;
+
+        pos += len;
+    }
+    remap[size] = new_size;
+
+    if (new_size == size) {
+        free(remap);
+        return;
+    }
+
+    uint8_t* compacted = malloc(co->co_capacity);
+    for (uint32_t pos = 0; pos < size; pos += pp_size(code, pos)) {
+        if (code[pos] == CO_OP_NOP)
+            continue;
+
+        memcpy(compacted + remap[pos], code + pos, pp_size(code, pos));
+        if (pp_is_jump(pp_op(code, pos))) {
+            uint32_t target = pp_jump_target(code, pos);
+            pp_set_jump_target(compacted, remap[pos], remap[target <= size ? target : size]);
+        }
+    }
+
+    for (size_t i = 0; i < darray_size(co->co_caches); i++)
+        co->co_caches[i].offset = remap[co->co_caches[i].offset];
+
+    // Entries of removed instructions land on the next survivor, the last one mapped to an offset wins
+    uint32_t nlines = 0;
+    for (uint32_t i = 0; i < co->co_nlines; i++) {
+        MECodeLine entry = co->co_lines[i];
+        entry.offset = remap[entry.offset <= size ? entry.offset : size];
+        if (entry.offset >= new_size)
+            break;
+
+        if (nlines > 0 && co->co_lines[nlines - 1].offset == entry.offset)
+            nlines--;
+
+        if (nlines > 0 && co->co_lines[nlines - 1].line == entry.line)
+            continue;
+
+        co->co_lines[nlines++] = entry;
+    }
+    co->co_nlines = nlines;
+    darray_set_size(co->co_lines, nlines);
+
+    memcpy(code, compacted, new_size);
+    co->co_size = new_size;
+
+    free(compacted);
+    free(remap);
+}
+
+// The compiler gives every forward jump a prefix as their distance is not known yet, this drops the
+// prefixes whose operand fits without them. Compacting only brings code closer together, what fits
+// now still fits once the NOPs are gone.
+static void pp_narrow(uint8_t* code, uint32_t size) {
+    for (uint32_t pos = 0; pos < size; pos += pp_size(code, pos)) {
+        if (code[pos] == CO_OP_EXTENDED_ARG && co_arg_fits(pp_op(code, pos), pp_arg(code, pos)))
+            memset(code + pos, CO_OP_NOP, 3);
+    }
+}
+
+// "STORE_x i; LOAD_x i" turned into "DUP; STORE_x i" peaks one value higher than the compiler counted,
+// twice over when the load is followed by another one of i. Same linear walk as co_stack_effect.
+static void pp_stack_size(MECodeObject* co) {
+    int depth = 0;
+    co->co_stacksize = 0;
+    for (uint32_t pos = 0; pos < co->co_size; pos += pp_size(co->co_bytecode, pos)) {
+        depth += pp_stack_effect(co->co_bytecode, pos);
+        if (depth > (int)co->co_stacksize)
+            co->co_stacksize = depth;
+    }
+}
+
+void co_narrow(MECodeObject* co) {
+    pp_narrow(co->co_bytecode, co->co_size);
+    pp_compact(co);
+}
+
+void co_peephole(MECodeObject* co) {
+    uint8_t* code = co->co_bytecode;
+    uint32_t size = co->co_size;
+
+    pp_thread_jumps(code, size);
+    pp_remove_dead_code(code, size);
+
+    uint8_t* targets = pp_find_jump_targets(code, size);
+    pp_assignments(code, size, targets);
+    for (int pass = 0; pass < 4 && pp_patterns(code, size, targets); pass++);
+    free(targets);
+
+    pp_narrow(code, size);
+    pp_compact(co);
+    pp_stack_size(co);
+}
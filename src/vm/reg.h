@@ -0,0 +1,64 @@
+#ifndef __REG_H
+#define __REG_H
+
+#include <stdint.h>
+
+#include "../parser/stmt.h"
+
+#include "co.h"
+#include "vm.h"
+
+// Register code, the alternative backend selected with co_options.registers. The same AST compiles to
+// three-address instructions instead of stack bytecode, co_bytecode then holds MERegInstr records
+// (co_size is in bytes, so co_lines works unchanged) and co_register is set. Nothing persists them,
+// the .mec cache only holds stack bytecode.
+//
+// Every frame is a window of co_nregs registers: a function's locals come first (parameters in order),
+// the module's globals are the first registers of the module frame, temporaries follow. Registers
+// hold owned references or NULL. Functions reach globals through GETGLOBAL and SETGLOBAL.
+
+// Operand flag, the rest of the operand is an index into co_consts instead of a register
+#define ME_REG_K 0x80000000u
+
+typedef enum {
+    RC_OP_MOVE,         // R[a] = RK(b)
+    RC_OP_GETGLOBAL,    // R[a] = G[b]
+    RC_OP_SETGLOBAL,    // G[a] = RK(b)
+    RC_OP_ADD,          // R[a] = RK(b) + RK(c), ints and floats inline
+    RC_OP_SUB,
+    RC_OP_MUL,
+    RC_OP_DIV,
+    RC_OP_MOD,
+    RC_OP_BINARY,       // R[a] = RK(b) op RK(c), "arg" is the BinaryOp
+    RC_OP_UNARY,        // R[a] = op RK(b), "arg" is the UnaryOp
+    RC_OP_JUMP,         // To instruction a
+    RC_OP_JUMP_IF_FALSE, // To a if RK(b) is falsy
+    RC_OP_JUMP_IF_TRUE,
+    RC_OP_COMPARE_JUMP, // To a unless RK(b) cmp RK(c), "arg" is the comparison BinaryOp
+    RC_OP_CALL,         // R[a] = R[b](R[a + 1] ... R[a + arg])
+    RC_OP_CALL_GLOBAL,  // R[a] = G[b](R[a + 1] ... R[a + arg])
+    RC_OP_TAIL_CALL,    // Returns R[b](R[a + 1] ... R[a + arg]), the callee runs in this frame
+    RC_OP_TAIL_CALL_GLOBAL, // Same with G[b]
+    RC_OP_RETURN,       // Returns RK(b)
+    RC_OP_COUNT,
+} MERegOp;
+
+typedef struct {
+    const void* handler; // Resolved by the register loop before the code first runs
+    uint8_t op;
+    uint8_t arg;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+} MERegInstr;
+
+extern const char* rc_op_names[RC_OP_COUNT];
+
+// Compiles the module "co" (consts and globals already set up) and every function in it
+void co_reg_compile(MECodeObject* co, Stmt** stmts);
+void co_reg_disasm(MECodeObject* co);
+
+// me_vm_run hands register code over to this loop
+MEVMExitCode me_vm_run_registers(MEVM* vm);
+
+#endif
@@ -0,0 +1,581 @@
+#include "reg.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../utils/darray.h"
+#include "../utils/utf8.h"
+
+#include "objects/functionobject.h"
+
+// Operand of the none constant, IDX 0 of every code object
+#define RC_K_NONE (ME_REG_K | 0)
+// Operand of the int 1 constant, IDX 1, steps of ++ and --
+#define RC_K_ONE (ME_REG_K | 1)
+
+const char* rc_op_names[RC_OP_COUNT] = {
+    [RC_OP_MOVE] = "MOVE",
+    [RC_OP_GETGLOBAL] = "GETGLOBAL",
+    [RC_OP_SETGLOBAL] = "SETGLOBAL",
+    [RC_OP_ADD] = "ADD",
+    [RC_OP_SUB] = "SUB",
+    [RC_OP_MUL] = "MUL",
+    [RC_OP_DIV] = "DIV",
+    [RC_OP_MOD] = "MOD",
+    [RC_OP_BINARY] = "BINARY",
+    [RC_OP_UNARY] = "UNARY",
+    [RC_OP_JUMP] = "JUMP",
+    [RC_OP_JUMP_IF_FALSE] = "JUMP_IF_FALSE",
+    [RC_OP_JUMP_IF_TRUE] = "JUMP_IF_TRUE",
+    [RC_OP_COMPARE_JUMP] = "COMPARE_JUMP",
+    [RC_OP_CALL] = "CALL",
+    [RC_OP_CALL_GLOBAL] = "CALL_GLOBAL",
+    [RC_OP_TAIL_CALL] = "TAIL_CALL",
+    [RC_OP_TAIL_CALL_GLOBAL] = "TAIL_CALL_GLOBAL",
+    [RC_OP_RETURN] = "RETURN",
+};
+
+// Binary operators with an opcode of their own, the rest go through RC_OP_BINARY
+static const uint8_t rc_binop_to_op[BIN_BIT_RSHIFT + 1] = {
+    [BIN_ADD] = RC_OP_ADD,
+    [BIN_SUB] = RC_OP_SUB,
+    [BIN_MUL] = RC_OP_MUL,
+    [BIN_DIV] = RC_OP_DIV,
+    [BIN_MOD] = RC_OP_MOD,
+};
+
+typedef struct {
+    MECodeObject* co;
+    uint32_t nvars;          // Registers of the variables, temporaries start here
+    uint32_t top;            // First free register, temporaries are handed out like a stack
+    uint32_t loop_start;     // Instruction "devam" jumps to
+    uint32_t* break_patches; // Darray of the jumps "yeter" left for the innermost loop
+} RegCompiler;
+
+static uint32_t rc_expr(RegCompiler* rc, Expr* expr);
+static void rc_expr_to(RegCompiler* rc, Expr* expr, uint32_t dst);
+static void rc_stmt(RegCompiler* rc, Stmt* stmt);
+
+static inline uint32_t rc_count(MECodeObject* co) {
+    return co->co_size / sizeof(MERegInstr);
+}
+
+static uint32_t rc_emit(RegCompiler* rc, uint8_t op, uint8_t arg, uint32_t a, uint32_t b, uint32_t c) {
+    MECodeObject* co = rc->co;
+    while (co->co_size + sizeof(MERegInstr) > co->co_capacity) {
+        co->co_capacity *= 2;
+        co->co_bytecode = (uint8_t*)realloc(co->co_bytecode, co->co_capacity);
+    }
+
+    co_line_mark(co);
+
+    uint32_t idx = rc_count(co);
+    ((MERegInstr*)co->co_bytecode)[idx] = (MERegInstr){ .op = op, .arg = arg, .a = a, .b = b, .c = c };
+    co->co_size += sizeof(MERegInstr);
+    return idx;
+}
+
+static inline void rc_patch(RegCompiler* rc, uint32_t jump, uint32_t target) {
+    ((MERegInstr*)rc->co->co_bytecode)[jump].a = target;
+}
+
+static uint32_t rc_alloc(RegCompiler* rc, uint32_t count) {
+    uint32_t reg = rc->top;
+    rc->top += count;
+    if (rc->top > rc->co->co_nregs)
+        rc->co->co_nregs = rc->top;
+
+    return reg;
+}
+
+// Register of a variable, UINT32_MAX for a global seen from a function, those take GETGLOBAL and
+// SETGLOBAL. Module code keeps every global in its own registers.
+static inline uint32_t rc_var_reg(RegCompiler* rc, SymbolScope scope, uint32_t slot) {
+    if (scope == SYMBOL_LOCAL || !rc->co->in_function)
+        return slot;
+
+    return UINT32_MAX;
+}
+
+static inline void rc_move(RegCompiler* rc, uint32_t dst, uint32_t src) {
+    if (dst != src)
+        rc_emit(rc, RC_OP_MOVE, 0, dst, src, 0);
+}
+
+// Writes the value of "operand" into a variable
+static void rc_store(RegCompiler* rc, SymbolScope scope, uint32_t slot, uint32_t operand) {
+    uint32_t reg = rc_var_reg(rc, scope, slot);
+    if (reg == UINT32_MAX)
+        rc_emit(rc, RC_OP_SETGLOBAL, 0, slot, operand, 0);
+    else
+        rc_move(rc, reg, operand);
+}
+
+// Whether evaluating "expr" can change the variable in register "reg". Calls only reach the module's
+// registers, through SETGLOBAL, the locals of a function are its own.
+static int rc_may_write(RegCompiler* rc, Expr* expr, uint32_t reg) {
+    switch (expr->kind) {
+        case EXPR_BINARY:
+            if (expr->binary->op == BIN_ASSIGN && rc_var_reg(rc, expr->binary->lhs->variable->scope, expr->binary->lhs->variable->slot) == reg)
+                return 1;
+            return rc_may_write(rc, expr->binary->lhs, reg) || rc_may_write(rc, expr->binary->rhs, reg);
+        case EXPR_UNARY:
+            if (expr->unary->op >= UNARY_PRE_INC && rc_var_reg(rc, expr->unary->operand->variable->scope, expr->unary->operand->variable->slot) == reg)
+                return 1;
+            return rc_may_write(rc, expr->unary->operand, reg);
+        case EXPR_CALL:
+            if (!rc->co->in_function)
+                return 1;
+            for (size_t i = 0; i < darray_size(expr->call->args); i++) {
+                if (rc_may_write(rc, expr->call->args[i], reg))
+                    return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Operands of a binary op or a comparison. A variable lhs is read straight from its register, unless
+// the rhs could write to it first.
+static void rc_operands(RegCompiler* rc, BinaryExpr* binary, uint32_t* lhs, uint32_t* rhs) {
+    uint32_t saved = rc->top;
+    *lhs = rc_expr(rc, binary->lhs);
+    if (!(*lhs & ME_REG_K) && *lhs < saved && rc_may_write(rc, binary->rhs, *lhs)) {
+        uint32_t tmp = rc_alloc(rc, 1);
+        rc_move(rc, tmp, *lhs);
+        *lhs = tmp;
+    }
+
+    *rhs = rc_expr(rc, binary->rhs);
+}
+
+// "x = value", the value is computed straight into the register of x when only its last instruction
+// writes there. "ile", "veyahut" and postfix updates write earlier and go through a temporary.
+static uint32_t rc_assign(RegCompiler* rc, VariableExpr* var, Expr* value) {
+    uint32_t reg = rc_var_reg(rc, var->scope, var->slot);
+    int direct = reg != UINT32_MAX;
+    if (value->kind == EXPR_BINARY && (value->binary->op == BIN_AND || value->binary->op == BIN_OR))
+        direct = 0;
+    else if (value->kind == EXPR_UNARY && (value->unary->op == UNARY_POST_INC || value->unary->op == UNARY_POST_DEC))
+        direct = 0;
+
+    if (direct) {
+        rc_expr_to(rc, value, reg);
+        return reg;
+    }
+
+    uint32_t operand = rc_expr(rc, value);
+    rc_store(rc, var->scope, var->slot, operand);
+    return reg != UINT32_MAX ? reg : operand;
+}
+
+// ++ and --, "dst" receives the value before or after the update, UINT32_MAX if it is not needed
+static uint32_t rc_update(RegCompiler* rc, UnaryExpr* unary, uint32_t dst) {
+    VariableExpr* var = unary->operand->variable;
+    uint8_t op = unary->op == UNARY_PRE_INC || unary->op == UNARY_POST_INC ? RC_OP_ADD : RC_OP_SUB;
+    int post = unary->op == UNARY_POST_INC || unary->op == UNARY_POST_DEC;
+
+    uint32_t reg = rc_var_reg(rc, var->scope, var->slot);
+    if (reg != UINT32_MAX) {
+        if (post && dst != UINT32_MAX)
+            rc_move(rc, dst, reg);
+
+        rc_emit(rc, op, 0, reg, reg, RC_K_ONE);
+
+        if (!post && dst != UINT32_MAX)
+            rc_move(rc, dst, reg);
+
+        return reg;
+    }
+
+    uint32_t old = dst != UINT32_MAX && post ? dst : rc_alloc(rc, 1);
+    rc_emit(rc, RC_OP_GETGLOBAL, 0, old, var->slot, 0);
+
+    uint32_t updated = dst == UINT32_MAX ? old : post ? rc_alloc(rc, 1) : dst;
+    rc_emit(rc, op, 0, updated, old, RC_K_ONE);
+    rc_emit(rc, RC_OP_SETGLOBAL, 0, var->slot, updated, 0);
+    return post ? old : updated;
+}
+
+// The arguments go into the temporaries right above "base", the topmost allocated register, which
+// receives the result. The callee is read from its variable. A tail call returns the result instead.
+static void rc_call(RegCompiler* rc, CallExpr* call, uint32_t base, int tail) {
+    uint32_t argc = darray_size(call->args);
+    for (uint32_t i = 0; i < argc; i++)
+        rc_expr_to(rc, call->args[i], rc_alloc(rc, 1));
+
+    uint32_t reg = rc_var_reg(rc, call->scope, call->slot);
+    if (reg == UINT32_MAX)
+        rc_emit(rc, tail ? RC_OP_TAIL_CALL_GLOBAL : RC_OP_CALL_GLOBAL, argc, base, call->slot, 0);
+    else
+        rc_emit(rc, tail ? RC_OP_TAIL_CALL : RC_OP_CALL, argc, base, reg, 0);
+
+    rc->top = base + 1;
+}
+
+static void rc_expr_to_kind(RegCompiler* rc, Expr* expr, uint32_t dst) {
+    switch (expr->kind) {
+        case EXPR_LITERAL:
+            rc_emit(rc, RC_OP_MOVE, 0, dst, ME_REG_K | co_add_literal(rc->co, expr->literal), 0);
+            break;
+        case EXPR_VARIABLE: {
+            uint32_t reg = rc_var_reg(rc, expr->variable->scope, expr->variable->slot);
+            if (reg == UINT32_MAX)
+                rc_emit(rc, RC_OP_GETGLOBAL, 0, dst, expr->variable->slot, 0);
+            else
+                rc_move(rc, dst, reg);
+            break;
+        }
+        case EXPR_BINARY: {
+            BinaryExpr* binary = expr->binary;
+            if (binary->op == BIN_ASSIGN) {
+                rc_move(rc, dst, rc_assign(rc, binary->lhs->variable, binary->rhs));
+                break;
+            }
+
+            if (binary->op == BIN_AND || binary->op == BIN_OR) {
+                // Either operand is the value, the rhs only runs when the lhs doesn't decide it
+                rc_expr_to(rc, binary->lhs, dst);
+                uint32_t jump = rc_emit(rc, binary->op == BIN_AND ? RC_OP_JUMP_IF_FALSE : RC_OP_JUMP_IF_TRUE, 0, 0, dst, 0);
+                rc_expr_to(rc, binary->rhs, dst);
+                rc_patch(rc, jump, rc_count(rc->co));
+                break;
+            }
+
+            uint32_t lhs, rhs;
+            rc_operands(rc, binary, &lhs, &rhs);
+
+            uint8_t op = rc_binop_to_op[binary->op];
+            rc_emit(rc, op ? op : RC_OP_BINARY, binary->op, dst, lhs, rhs);
+            break;
+        }
+        case EXPR_UNARY: {
+            UnaryOp op = expr->unary->op;
+            if (op == UNARY_PRE_INC || op == UNARY_PRE_DEC || op == UNARY_POST_INC || op == UNARY_POST_DEC) {
+                rc_update(rc, expr->unary, dst);
+                break;
+            }
+
+            uint32_t operand = rc_expr(rc, expr->unary->operand);
+            rc_emit(rc, RC_OP_UNARY, op, dst, operand, 0);
+            break;
+        }
+        case EXPR_CALL:
+            // A temporary with nothing above it, an argument of an enclosing call say, takes the result directly
+            if (dst >= rc->nvars && dst + 1 == rc->top) {
+                rc_call(rc, expr->call, dst, 0);
+            } else {
+                uint32_t base = rc_alloc(rc, 1);
+                rc_call(rc, expr->call, base, 0);
+                rc_move(rc, dst, base);
+            }
+            break;
+    }
+}
+
+// Computes "expr" into "dst", temporaries above the current top are free again afterwards
+static void rc_expr_to(RegCompiler* rc, Expr* expr, uint32_t dst) {
+    int line = rc->co->co_line;
+    uint32_t saved = rc->top;
+    rc->co->co_line = expr->line;
+    rc_expr_to_kind(rc, expr, dst);
+    rc->co->co_line = line;
+    rc->top = saved;
+}
+
+// Operand holding the value of "expr": a constant, the register of a variable or a new temporary.
+// Temporaries stay allocated until the caller resets rc->top.
+static uint32_t rc_expr(RegCompiler* rc, Expr* expr) {
+    int line = rc->co->co_line;
+    rc->co->co_line = expr->line;
+
+    uint32_t operand;
+    switch (expr->kind) {
+        case EXPR_LITERAL:
+            operand = ME_REG_K | co_add_literal(rc->co, expr->literal);
+            break;
+        case EXPR_VARIABLE:
+            operand = rc_var_reg(rc, expr->variable->scope, expr->variable->slot);
+            if (operand == UINT32_MAX) {
+                operand = rc_alloc(rc, 1);
+                rc_emit(rc, RC_OP_GETGLOBAL, 0, operand, expr->variable->slot, 0);
+            }
+            break;
+        case EXPR_BINARY:
+            if (expr->binary->op == BIN_ASSIGN) {
+                operand = rc_assign(rc, expr->binary->lhs->variable, expr->binary->rhs);
+                break;
+            }
+            operand = rc_alloc(rc, 1);
+            rc_expr_to_kind(rc, expr, operand);
+            break;
+        case EXPR_UNARY: {
+            UnaryOp op = expr->unary->op;
+            if (op == UNARY_PRE_INC || op == UNARY_PRE_DEC) {
+                operand = rc_update(rc, expr->unary, UINT32_MAX);
+                break;
+            }
+            operand = rc_alloc(rc, 1);
+            rc_expr_to_kind(rc, expr, operand);
+            break;
+        }
+        case EXPR_CALL:
+            operand = rc_alloc(rc, 1);
+            rc_call(rc, expr->call, operand, 0);
+            break;
+        default:
+            operand = RC_K_NONE;
+            break;
+    }
+
+    rc->co->co_line = line;
+    return operand;
+}
+
+// Condition of a şayet or madem plus the jump taken when it is false, a comparison is a single
+// COMPARE_JUMP on the operands' registers
+static uint32_t rc_condition(RegCompiler* rc, Expr* condition) {
+    uint32_t saved = rc->top;
+    uint32_t jump;
+
+    if (condition->kind == EXPR_BINARY && condition->binary->op >= BIN_EQ && condition->binary->op <= BIN_GTE) {
+        uint32_t lhs, rhs;
+        rc_operands(rc, condition->binary, &lhs, &rhs);
+
+        int line = rc->co->co_line;
+        rc->co->co_line = condition->line;
+        jump = rc_emit(rc, RC_OP_COMPARE_JUMP, condition->binary->op, 0, lhs, rhs);
+        rc->co->co_line = line;
+    } else {
+        uint32_t operand = rc_expr(rc, condition);
+        jump = rc_emit(rc, RC_OP_JUMP_IF_FALSE, 0, 0, operand, 0);
+    }
+
+    rc->top = saved;
+    return jump;
+}
+
+static void rc_function(RegCompiler* rc, FunctionDeclStmt* decl, int line) {
+    MECodeObject* co = rc->co;
+    MECodeObject* func_co = co_alloc(decl->name.data, decl->name.byte_len, 128);
+    func_co->co_globals = co->co_globals;
+    func_co->co_nlocals = decl->nlocals; // Parameters first, in order
+    func_co->co_nregs = decl->nlocals;
+    func_co->co_register = 1;
+    func_co->in_function = 1;
+    func_co->co_line = line; // Of the implicit RETURN NONE
+    co_init_consts(func_co, co);
+
+    RegCompiler inner = { .co = func_co, .nvars = decl->nlocals, .top = decl->nlocals, .loop_start = 0, .break_patches = darray_new(uint32_t) };
+    for (size_t i = 0; i < darray_size(decl->body); i++)
+        rc_stmt(&inner, decl->body[i]);
+
+    // A branch may still fall through to the end, the loop has no end of code check either
+    rc_emit(&inner, RC_OP_RETURN, 0, 0, RC_K_NONE, 0);
+    darray_free(inner.break_patches);
+
+    co_drop_consts(func_co, 0);
+
+    MEObject* func_obj = me_function_new(func_co, darray_size(decl->params));
+    uint32_t func_idx = co_add_const(co, func_obj);
+    rc_store(rc, decl->scope, decl->slot, ME_REG_K | func_idx);
+}
+
+static void rc_stmt_kind(RegCompiler* rc, Stmt* stmt) {
+    switch (stmt->kind) {
+        case STMT_EXPR: {
+            Expr* expr = stmt->expr_stmt;
+            // A dropped value needs no register, updates are done in place
+            if (expr->kind == EXPR_BINARY && expr->binary->op == BIN_ASSIGN)
+                rc_assign(rc, expr->binary->lhs->variable, expr->binary->rhs);
+            else if (expr->kind == EXPR_UNARY && expr->unary->op >= UNARY_PRE_INC)
+                rc_update(rc, expr->unary, UINT32_MAX);
+            else
+                rc_expr(rc, expr);
+            break;
+        }
+        case STMT_DECL: {
+            DeclStmt* decl = stmt->decl_stmt;
+            VariableExpr var = { .name = decl->name, .scope = decl->scope, .slot = decl->slot };
+            if (decl->initializer)
+                rc_assign(rc, &var, decl->initializer);
+            else
+                rc_store(rc, decl->scope, decl->slot, RC_K_NONE);
+            break;
+        }
+        case STMT_COMPOUND:
+            for (size_t i = 0; i < darray_size(stmt->compound->stmts); i++)
+                rc_stmt(rc, stmt->compound->stmts[i]);
+            break;
+        case STMT_RETURN: {
+            Expr* value = stmt->return_stmt->value;
+            if (rc->co->in_function && value && value->kind == EXPR_CALL) {
+                rc_call(rc, value->call, rc_alloc(rc, 1), 1);
+                break;
+            }
+
+            uint32_t operand = stmt->return_stmt->value ? rc_expr(rc, stmt->return_stmt->value) : RC_K_NONE;
+            rc_emit(rc, RC_OP_RETURN, 0, 0, operand, 0);
+            break;
+        }
+        case STMT_IF: {
+            uint32_t then_jump = rc_condition(rc, stmt->if_stmt->condition);
+
+            for (size_t i = 0; i < darray_size(stmt->if_stmt->then_branch); i++)
+                rc_stmt(rc, stmt->if_stmt->then_branch[i]);
+
+            uint32_t else_jump = 0;
+            if (stmt->if_stmt->else_branch)
+                else_jump = rc_emit(rc, RC_OP_JUMP, 0, 0, 0, 0);
+
+            rc_patch(rc, then_jump, rc_count(rc->co));
+
+            if (stmt->if_stmt->else_branch) {
+                rc_stmt(rc, stmt->if_stmt->else_branch);
+                rc_patch(rc, else_jump, rc_count(rc->co));
+            }
+            break;
+        }
+        case STMT_FUNCTION_DECL:
+            rc_function(rc, stmt->function_decl, stmt->line);
+            break;
+        case STMT_WHILE: {
+            uint32_t loop_start = rc_count(rc->co);
+            uint32_t jump_out = rc_condition(rc, stmt->while_stmt->condition);
+
+            uint32_t old_loop_start = rc->loop_start;
+            size_t old_break_count = darray_size(rc->break_patches); // Breaks of the enclosing loops stay untouched
+            rc->loop_start = loop_start;
+
+            for (size_t i = 0; i < darray_size(stmt->while_stmt->body); i++)
+                rc_stmt(rc, stmt->while_stmt->body[i]);
+
+            rc_emit(rc, RC_OP_JUMP, 0, loop_start, 0, 0);
+
+            uint32_t loop_end = rc_count(rc->co);
+            rc_patch(rc, jump_out, loop_end);
+            for (size_t i = old_break_count; i < darray_size(rc->break_patches); i++)
+                rc_patch(rc, rc->break_patches[i], loop_end);
+
+            darray_set_size(rc->break_patches, old_break_count);
+            rc->loop_start = old_loop_start;
+            break;
+        }
+        case STMT_BREAK:
+            darray_pushd(rc->break_patches, rc_emit(rc, RC_OP_JUMP, 0, 0, 0, 0));
+            break;
+        case STMT_CONTINUE:
+            rc_emit(rc, RC_OP_JUMP, 0, rc->loop_start, 0, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+// Statements never keep a temporary, each one starts from the variables' registers again
+static void rc_stmt(RegCompiler* rc, Stmt* stmt) {
+    if (!stmt)
+        return;
+
+    int line = rc->co->co_line;
+    uint32_t saved = rc->top;
+    rc->co->co_line = stmt->line;
+    rc_stmt_kind(rc, stmt);
+    rc->co->co_line = line;
+    rc->top = saved;
+}
+
+void co_reg_compile(MECodeObject* co, Stmt** stmts) {
+    uint32_t nglobals = darray_size(co->co_globals);
+
+    co->co_register = 1;
+    co->co_nregs = nglobals;
+
+    RegCompiler rc = { .co = co, .nvars = nglobals, .top = nglobals, .loop_start = 0, .break_patches = darray_new(uint32_t) };
+    for (size_t i = 0; i < darray_size(stmts); i++)
+        rc_stmt(&rc, stmts[i]);
+
+    rc_emit(&rc, RC_OP_RETURN, 0, 0, RC_K_NONE, 0);
+    darray_free(rc.break_patches);
+}
+
+static void rc_print_operand(uint32_t operand) {
+    if (operand & ME_REG_K)
+        printf(" K%u", operand & ~ME_REG_K);
+    else
+        printf(" R%u", operand);
+}
+
+void co_reg_disasm(MECodeObject* co) {
+    MERegInstr* code = (MERegInstr*)co->co_bytecode;
+    uint32_t count = rc_count(co);
+
+    for (uint32_t i = 0; i < count; i++) {
+        MERegInstr* in = &code[i];
+        printf("%04u: %s", i, rc_op_names[in->op]);
+
+        switch (in->op) {
+            case RC_OP_MOVE:
+                printf(" R%u", in->a);
+                rc_print_operand(in->b);
+                break;
+            case RC_OP_GETGLOBAL:
+                printf(" R%u G%u", in->a, in->b);
+                break;
+            case RC_OP_SETGLOBAL:
+                printf(" G%u", in->a);
+                rc_print_operand(in->b);
+                break;
+            case RC_OP_UNARY:
+                printf(" %u R%u", in->arg, in->a);
+                rc_print_operand(in->b);
+                break;
+            case RC_OP_JUMP:
+                printf(" %u", in->a);
+                break;
+            case RC_OP_JUMP_IF_FALSE:
+            case RC_OP_JUMP_IF_TRUE:
+                printf(" %u", in->a);
+                rc_print_operand(in->b);
+                break;
+            case RC_OP_COMPARE_JUMP:
+                printf(" %u %u", in->arg, in->a);
+                rc_print_operand(in->b);
+                rc_print_operand(in->c);
+                break;
+            case RC_OP_CALL:
+            case RC_OP_TAIL_CALL:
+                printf(" R%u R%u %u", in->a, in->b, in->arg);
+                break;
+            case RC_OP_CALL_GLOBAL:
+            case RC_OP_TAIL_CALL_GLOBAL:
+                printf(" R%u G%u %u", in->a, in->b, in->arg);
+                break;
+            case RC_OP_RETURN:
+                rc_print_operand(in->b);
+                break;
+            default:
+                if (in->op == RC_OP_BINARY)
+                    printf(" %u", in->arg);
+                printf(" R%u", in->a);
+                rc_print_operand(in->b);
+                rc_print_operand(in->c);
+                break;
+        }
+
+        printf("\n");
+    }
+
+    for (size_t i = 0; i < darray_size(co->co_consts); i++) {
+        if (!me_function_check(co->co_consts[i]))
+            continue;
+
+        MEFunctionObject* func = (MEFunctionObject*)co->co_consts[i];
+        printf("--------------------\n");
+        printf("Function: %.*s, nargs: %zu, nlocals: %u, nregs: %u\n", (int)utf8_strsize(func->co->co_name), func->co->co_name, func->nargs, func->co->co_nlocals, func->co->co_nregs);
+        co_reg_disasm(func->co);
+        printf("--------------------\n");
+    }
+}
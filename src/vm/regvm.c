@@ -0,0 +1,481 @@
+#include "reg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils/darray.h"
+
+#include "objects/builtinfnobject.h"
+#include "objects/functionobject.h"
+#include "objects/errorobject.h"
+#include "objects/boolobject.h"
+#include "objects/noneobject.h"
+#include "objects/floatobject.h"
+#include "objects/longobject.h"
+
+#define ME_REG_FRAMES_INITIAL_CAPACITY 64
+
+// Same build switches as the stack loop in vm.c
+#ifndef ME_VM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define ME_VM_COMPUTED_GOTO 1
+#else
+#define ME_VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+#ifndef ME_VM_COUNT_DISPATCHES
+#define ME_VM_COUNT_DISPATCHES 0
+#endif
+
+#if ME_VM_COUNT_DISPATCHES
+#define COUNT_DISPATCH() (vm->dispatches++)
+#else
+#define COUNT_DISPATCH() ((void)0)
+#endif
+
+#if ME_VM_COMPUTED_GOTO
+#define TARGET(op) case op: TARGET_##op: COUNT_DISPATCH();
+#define DISPATCH() goto *(ip++)->handler
+#else
+#define TARGET(op) case op: COUNT_DISPATCH();
+#define DISPATCH() goto dispatch
+#endif
+
+// A register frame, the callee's window starts at its first argument so calls copy nothing:
+// [function object] [locals...] [temporaries...]
+typedef struct {
+    MECodeObject* co;
+    MERegInstr* ip;  // Where to continue once the callee returns
+    MEObject** base;
+} MERegFrame;
+
+// ip is already one past the running instruction when its handler starts
+#define INSTR (ip[-1])
+#define RK(x) (((x) & ME_REG_K ? consts : base)[(x) & ~ME_REG_K]) // A select, not a branch
+
+// The register's old value is released after the new one is in, it may be one of the operands
+#define SET_REG(x, value) do { \
+    MEObject** __slot = &base[x]; \
+    MEObject* __old = *__slot; \
+    *__slot = (value); \
+    ME_XDECREF(__old); \
+} while (0)
+
+// Keeps the int paths straight line, gcc otherwise lays them out behind a taken branch or two and
+// the tight loops run at half speed
+#if defined(__GNUC__) || defined(__clang__)
+#define LIKELY(x) __builtin_expect(!!(x), 1)
+#else
+#define LIKELY(x) (x)
+#endif
+
+#define BOTH_TAGGED(lhs, rhs) (ME_IS_TAGGED_INT(lhs) & ME_IS_TAGGED_INT(rhs))
+#define BOTH_FLOAT(lhs, rhs) (!ME_IS_TAGGED_INT(lhs) && !ME_IS_TAGGED_INT(rhs) && (lhs)->ob_type == &me_type_float && (rhs)->ob_type == &me_type_float)
+#define LONG_VALUE(obj) ME_TAGGED_INT_VALUE(obj)
+#define FLOAT_VALUE(obj) (((MEFloatObject*)(obj))->ob_value)
+
+// R[a] = RK(b) op RK(c), tagged ints and floats inline when "long_ok" and "float_ok" hold for them
+#define ARITH_HANDLER(opcode, long_ok, long_expr, float_ok, float_expr, slow) \
+    TARGET(opcode) { \
+        MEObject* lhs = RK(INSTR.b); \
+        MEObject* rhs = RK(INSTR.c); \
+        MEObject* result; \
+        long value; \
+        (void)value; \
+        if (LIKELY(BOTH_TAGGED(lhs, rhs) && (long_ok))) { \
+            long l = LONG_VALUE(lhs), r = LONG_VALUE(rhs); \
+            (void)l; (void)r; \
+            result = me_vm_long(long_expr); \
+        } else if (BOTH_FLOAT(lhs, rhs) && (float_ok)) { \
+            double l = FLOAT_VALUE(lhs), r = FLOAT_VALUE(rhs); \
+            (void)l; (void)r; \
+            result = me_float_from_double(float_expr); \
+        } else { \
+            result = slow(lhs, rhs); \
+            if (!result) \
+                goto error; \
+        } \
+        SET_REG(INSTR.a, result); \
+        DISPATCH(); \
+    }
+
+// Moves the register slab to a bigger one, every frame is rebased onto it. New registers are NULL.
+static void me_vm_reg_grow(MEVM* vm, MERegFrame* frames, uint32_t frame_count, size_t needed) {
+    size_t capacity = vm->stack_capacity * 2;
+    while (capacity < needed)
+        capacity *= 2;
+
+    MEObject** stack = calloc(capacity, sizeof(MEObject*));
+    memcpy(stack, vm->stack, sizeof(MEObject*) * vm->stack_capacity);
+
+    for (uint32_t i = 0; i < frame_count; i++)
+        frames[i].base = stack + (frames[i].base - vm->stack);
+
+    free(vm->stack);
+    vm->stack = stack;
+    vm->stack_capacity = capacity;
+}
+
+// The callee's window starts at the first argument, its result lands in R[a] once it returns.
+// Functions are constants of the code defining them and builtins sit in co_globals, so the callee
+// stays alive without a reference from the frame.
+#define CALL_HANDLER(opcode, callee_of) \
+    TARGET(opcode) { \
+        uint8_t arg_count = INSTR.arg; \
+        MEObject** args = &base[INSTR.a + 1]; \
+        MEObject* func_obj = (callee_of); \
+    \
+        if (me_function_check(func_obj)) { \
+            MEFunctionObject* func = (MEFunctionObject*)func_obj; \
+            if (arg_count != func->nargs) { \
+                me_set_error(me_error_generic, "Function \"%s\" expects %u arguments, got %u.", func->co->co_name, func->nargs, arg_count); \
+                goto error; \
+            } \
+    \
+            if (frame_count == MAX_RECURSION_DEPTH) { \
+                me_set_error(me_error_generic, "Maximum recursion depth of %d exceeded.", MAX_RECURSION_DEPTH); \
+                goto error; \
+            } \
+    \
+            MECodeObject* callee = func->co; \
+            size_t args_offset = args - vm->stack; \
+            if (args_offset + callee->co_nregs > vm->stack_capacity) { \
+                me_vm_reg_grow(vm, frames, frame_count, args_offset + callee->co_nregs); \
+                args = vm->stack + args_offset; \
+                globals = vm->stack; \
+            } \
+    \
+            if (frame_count == frame_capacity) { \
+                frame_capacity *= 2; \
+                frames = realloc(frames, sizeof(MERegFrame) * frame_capacity); \
+            } \
+    \
+            frames[frame_count - 1].ip = ip; \
+    \
+            frame = &frames[frame_count++]; \
+            frame->co = callee; \
+            frame->base = args; /* Arguments are already in parameter order, they become the first locals */ \
+    \
+            for (uint32_t i = arg_count; i < callee->co_nlocals; i++) { \
+                ME_INCREF(me_none); \
+                ME_XDECREF(args[i]); \
+                args[i] = me_none; \
+            } \
+    \
+            base = args; \
+            consts = callee->co_consts; \
+            code = ip = (MERegInstr*)callee->co_bytecode; \
+            DISPATCH(); \
+        } \
+    \
+        if (me_builtinfn_check(func_obj)) { \
+            MEObject* result = ((MEBuiltinFnObject*)func_obj)->fn(func_obj, args, arg_count); \
+    \
+            for (int i = 0; i < arg_count; i++) { \
+                ME_DECREF(args[i]); \
+                args[i] = NULL; \
+            } \
+    \
+            if (!result) \
+                goto error; \
+    \
+            SET_REG(INSTR.a, result); \
+            DISPATCH(); \
+        } \
+    \
+        me_set_error(me_error_typemismatch, "Object is not callable: \"%s\".", ME_TYPE_NAME(func_obj)); \
+        goto error; \
+    }
+
+// Returns from the running frame, "value" is an owned reference. The whole window goes, the caller's
+// temporaries above the call are free anyway.
+#define LEAVE_FRAME(value) do { \
+    MEObject* return_value = (value); \
+    for (MEObject** p = base, **end = base + frame->co->co_nregs; p < end; p++) { \
+        MEObject* o = *p; \
+        *p = NULL; \
+        ME_XDECREF(o); \
+    } \
+    \
+    if (frame_count == 1) { \
+        ME_XDECREF(return_value); \
+        me_vm_reg_release(vm); \
+        free(frames); \
+        return MEVM_EXIT_OK; \
+    } \
+    \
+    MEObject** callee_base = base; \
+    frame = &frames[--frame_count - 1]; \
+    base = frame->base; \
+    consts = frame->co->co_consts; \
+    code = (MERegInstr*)frame->co->co_bytecode; \
+    ip = frame->ip; \
+    \
+    /* R[a] of the call, right below the callee's window */ \
+    MEObject* old = callee_base[-1]; \
+    callee_base[-1] = return_value; \
+    ME_XDECREF(old); \
+    DISPATCH(); \
+} while (0)
+
+// "tebliğ f(...)", the callee reuses the frame instead of pushing one. Everything in the window but the
+// arguments is released and they move down to become the callee's first locals.
+#define TAIL_CALL_HANDLER(opcode, callee_of) \
+    TARGET(opcode) { \
+        uint8_t arg_count = INSTR.arg; \
+        MEObject** args = &base[INSTR.a + 1]; \
+        MEObject* func_obj = (callee_of); \
+    \
+        if (me_function_check(func_obj)) { \
+            MEFunctionObject* func = (MEFunctionObject*)func_obj; \
+            if (arg_count != func->nargs) { \
+                me_set_error(me_error_generic, "Function \"%s\" expects %u arguments, got %u.", func->co->co_name, func->nargs, arg_count); \
+                goto error; \
+            } \
+    \
+            for (MEObject** p = base; p < args; p++) { \
+                MEObject* o = *p; \
+                *p = NULL; \
+                ME_XDECREF(o); \
+            } \
+            for (MEObject** p = args + arg_count, **end = base + frame->co->co_nregs; p < end; p++) { \
+                MEObject* o = *p; \
+                *p = NULL; \
+                ME_XDECREF(o); \
+            } \
+            memmove(base, args, sizeof(MEObject*) * arg_count); \
+            for (MEObject** p = base + arg_count; p < args + arg_count; p++) \
+                *p = NULL; \
+    \
+            MECodeObject* callee = func->co; \
+            size_t base_offset = base - vm->stack; \
+            if (base_offset + callee->co_nregs > vm->stack_capacity) { \
+                me_vm_reg_grow(vm, frames, frame_count, base_offset + callee->co_nregs); \
+                base = frame->base; \
+                globals = vm->stack; \
+            } \
+    \
+            for (uint32_t i = arg_count; i < callee->co_nlocals; i++) { \
+                ME_INCREF(me_none); \
+                ME_XDECREF(base[i]); \
+                base[i] = me_none; \
+            } \
+    \
+            frame->co = callee; \
+            consts = callee->co_consts; \
+            code = ip = (MERegInstr*)callee->co_bytecode; \
+            DISPATCH(); \
+        } \
+    \
+        if (me_builtinfn_check(func_obj)) { \
+            MEObject* result = ((MEBuiltinFnObject*)func_obj)->fn(func_obj, args, arg_count); \
+    \
+            for (int i = 0; i < arg_count; i++) { \
+                ME_DECREF(args[i]); \
+                args[i] = NULL; \
+            } \
+    \
+            if (!result) \
+                goto error; \
+    \
+            LEAVE_FRAME(result); \
+        } \
+    \
+        me_set_error(me_error_typemismatch, "Object is not callable: \"%s\".", ME_TYPE_NAME(func_obj)); \
+        goto error; \
+    }
+
+#if ME_VM_COMPUTED_GOTO
+// Handlers of "co" and every function in it, the loop dispatches through them without the table
+static void me_vm_reg_resolve(MECodeObject* co, void* const* handlers) {
+    MERegInstr* code = (MERegInstr*)co->co_bytecode;
+    if (code[0].handler)
+        return;
+
+    for (uint32_t i = 0; i < co->co_size / sizeof(MERegInstr); i++)
+        code[i].handler = handlers[code[i].op];
+
+    for (size_t i = 0; i < darray_size(co->co_consts); i++) {
+        MEObject* obj = co->co_consts[i];
+        if (me_function_check(obj))
+            me_vm_reg_resolve(((MEFunctionObject*)obj)->co, handlers);
+    }
+}
+#endif
+
+// Registers hold owned references or NULL, whatever is left anywhere in the slab is released
+static void me_vm_reg_release(MEVM* vm) {
+    for (size_t i = 0; i < vm->stack_capacity; i++) {
+        ME_XDECREF(vm->stack[i]);
+        vm->stack[i] = NULL;
+    }
+}
+
+MEVMExitCode me_vm_run_registers(MEVM* vm) {
+#if ME_VM_COMPUTED_GOTO
+    static void* dispatch_table[256] = {
+        [0 ... 255] = &&TARGET_unknown,
+        [RC_OP_MOVE] = &&TARGET_RC_OP_MOVE,
+        [RC_OP_GETGLOBAL] = &&TARGET_RC_OP_GETGLOBAL,
+        [RC_OP_SETGLOBAL] = &&TARGET_RC_OP_SETGLOBAL,
+        [RC_OP_ADD] = &&TARGET_RC_OP_ADD,
+        [RC_OP_SUB] = &&TARGET_RC_OP_SUB,
+        [RC_OP_MUL] = &&TARGET_RC_OP_MUL,
+        [RC_OP_DIV] = &&TARGET_RC_OP_DIV,
+        [RC_OP_MOD] = &&TARGET_RC_OP_MOD,
+        [RC_OP_BINARY] = &&TARGET_RC_OP_BINARY,
+        [RC_OP_UNARY] = &&TARGET_RC_OP_UNARY,
+        [RC_OP_JUMP] = &&TARGET_RC_OP_JUMP,
+        [RC_OP_JUMP_IF_FALSE] = &&TARGET_RC_OP_JUMP_IF_FALSE,
+        [RC_OP_JUMP_IF_TRUE] = &&TARGET_RC_OP_JUMP_IF_TRUE,
+        [RC_OP_COMPARE_JUMP] = &&TARGET_RC_OP_COMPARE_JUMP,
+        [RC_OP_CALL] = &&TARGET_RC_OP_CALL,
+        [RC_OP_CALL_GLOBAL] = &&TARGET_RC_OP_CALL_GLOBAL,
+        [RC_OP_TAIL_CALL] = &&TARGET_RC_OP_TAIL_CALL,
+        [RC_OP_TAIL_CALL_GLOBAL] = &&TARGET_RC_OP_TAIL_CALL_GLOBAL,
+        [RC_OP_RETURN] = &&TARGET_RC_OP_RETURN,
+    };
+#endif
+
+    MECodeObject* co = vm->co;
+#if ME_VM_COMPUTED_GOTO
+    me_vm_reg_resolve(co, dispatch_table);
+#endif
+
+    memset(vm->stack, 0, sizeof(MEObject*) * vm->stack_capacity);
+    if (co->co_nregs > vm->stack_capacity)
+        me_vm_reg_grow(vm, NULL, 0, co->co_nregs);
+
+    uint32_t frame_capacity = ME_REG_FRAMES_INITIAL_CAPACITY;
+    uint32_t frame_count = 1;
+    MERegFrame* frames = malloc(sizeof(MERegFrame) * frame_capacity);
+    MERegFrame* frame = &frames[0];
+    frame->co = co;
+    frame->ip = (MERegInstr*)co->co_bytecode;
+    frame->base = vm->stack;
+
+    // The module's globals are the first registers of its frame, functions reach them through the
+    // bottom of the slab
+    for (size_t i = 0; i < darray_size(co->co_globals); i++) {
+        vm->stack[i] = co->co_globals[i];
+        ME_INCREF(vm->stack[i]);
+    }
+
+    // Hot state lives in locals for the duration of the loop
+    MERegInstr* code = frame->ip;
+    MERegInstr* ip = code;
+    MEObject** base = frame->base;
+    MEObject** consts = co->co_consts;
+    MEObject** globals = vm->stack;
+
+    for (;;) {
+#if !ME_VM_COMPUTED_GOTO
+    dispatch:
+#endif
+        switch ((ip++)->op) {
+            TARGET(RC_OP_MOVE) {
+                MEObject* o = RK(INSTR.b);
+                ME_INCREF(o);
+                SET_REG(INSTR.a, o);
+                DISPATCH();
+            }
+            TARGET(RC_OP_GETGLOBAL) {
+                MEObject* o = globals[INSTR.b];
+                ME_INCREF(o);
+                SET_REG(INSTR.a, o);
+                DISPATCH();
+            }
+            TARGET(RC_OP_SETGLOBAL) {
+                MEObject* o = RK(INSTR.b);
+                ME_INCREF(o);
+                MEObject* old = globals[INSTR.a];
+                globals[INSTR.a] = o;
+                ME_XDECREF(old);
+                DISPATCH();
+            }
+            // Tagged ints are at most 62 bits wide, sums and differences can not overflow a long
+            ARITH_HANDLER(RC_OP_ADD, 1, l + r, 1, l + r, me_binary_add)
+            ARITH_HANDLER(RC_OP_SUB, 1, l - r, 1, l - r, me_binary_sub)
+            ARITH_HANDLER(RC_OP_MUL, !__builtin_mul_overflow(LONG_VALUE(lhs), LONG_VALUE(rhs), &value), value, 1, l * r, me_binary_mul)
+            // Division by zero takes the slow path so the error is raised in one place
+            ARITH_HANDLER(RC_OP_DIV, LONG_VALUE(rhs) != 0, l / r, FLOAT_VALUE(rhs) != 0.0, l / r, me_binary_div)
+            ARITH_HANDLER(RC_OP_MOD, LONG_VALUE(rhs) != 0, l % r, 0, 0, me_binary_mod)
+            TARGET(RC_OP_BINARY) {
+                MEObject* result = me_binary_op(RK(INSTR.b), RK(INSTR.c), INSTR.arg);
+                if (!result)
+                    goto error;
+
+                SET_REG(INSTR.a, result);
+                DISPATCH();
+            }
+            TARGET(RC_OP_UNARY) {
+                MEObject* result = me_unary_op(RK(INSTR.b), INSTR.arg);
+                if (!result)
+                    goto error;
+
+                SET_REG(INSTR.a, result);
+                DISPATCH();
+            }
+            TARGET(RC_OP_JUMP) {
+                ip = code + INSTR.a;
+                DISPATCH();
+            }
+            TARGET(RC_OP_JUMP_IF_FALSE) {
+                if (!me_is_true(RK(INSTR.b)))
+                    ip = code + INSTR.a;
+
+                DISPATCH();
+            }
+            TARGET(RC_OP_JUMP_IF_TRUE) {
+                if (me_is_true(RK(INSTR.b)))
+                    ip = code + INSTR.a;
+
+                DISPATCH();
+            }
+            TARGET(RC_OP_COMPARE_JUMP) {
+                MEObject* lhs = RK(INSTR.b);
+                MEObject* rhs = RK(INSTR.c);
+                int is_true;
+                if (LIKELY(BOTH_TAGGED(lhs, rhs))) {
+                    is_true = me_vm_compare_long(LONG_VALUE(lhs), LONG_VALUE(rhs), INSTR.arg);
+                } else {
+                    MEObject* result = me_binary_cmp(lhs, rhs, INSTR.arg);
+                    if (!result)
+                        goto error;
+
+                    is_true = me_is_true(result);
+                    ME_DECREF(result);
+                }
+
+                if (!is_true)
+                    ip = code + INSTR.a;
+
+                DISPATCH();
+            }
+            CALL_HANDLER(RC_OP_CALL, base[INSTR.b])
+            CALL_HANDLER(RC_OP_CALL_GLOBAL, globals[INSTR.b])
+            TAIL_CALL_HANDLER(RC_OP_TAIL_CALL, base[INSTR.b])
+            TAIL_CALL_HANDLER(RC_OP_TAIL_CALL_GLOBAL, globals[INSTR.b])
+            TARGET(RC_OP_RETURN) {
+                MEObject* result = RK(INSTR.b);
+                ME_INCREF(result);
+                LEAVE_FRAME(result);
+            }
+            default:
+#if ME_VM_COMPUTED_GOTO
+            TARGET_unknown:
+#endif
+                me_set_error(me_error_generic, "Unknown opcode.");
+                goto error;
+        }
+    }
+
+error:
+    // ip is right past the failing instruction
+    vm->error_line = co_line_from_offset(frame->co, (uint32_t)((ip - 1 - code) * sizeof(MERegInstr)));
+    me_vm_reg_release(vm);
+    free(frames);
+    return MEVM_EXIT_ERROR;
+}
@@ -0,0 +1,244 @@
+#include "co.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../utils/darray.h"
+
+#include "objects/errorobject.h"
+#include "objects/functionobject.h"
+
+// Bytecode verifier, run once over every code object before it reaches the VM, freshly compiled or
+// mapped from a .mec file. Every instruction has to decode, its operands have to index into the
+// consts, globals, locals and caches of its code object and its jump has to land on an instruction.
+// Walking the control flow graph, every instruction has to be reached with a single stack depth that
+// covers what it pops and stays within co_stacksize, and no path may run past the end. The VM relies
+// on all of that instead of checking the stack on every instruction.
+
+typedef struct {
+    MECodeObject* co;
+    MEFunctionObject* func; // Whose code "co" is, NULL for the module
+    size_t nglobals;    // Of the module, functions share its globals
+    uint8_t* starts;    // 1 where an instruction (its prefix, if it has one) starts
+    int32_t* depths;    // Stack depth on entry, -1 while unreached
+    uint32_t* worklist;
+    uint32_t count;
+} Verifier;
+
+static int verify_fail(Verifier* v, uint32_t pos, const char* what) {
+    me_set_error(me_error_generic, "Invalid bytecode in \"%s\" at %u: %s.", v->co->co_name, pos, what);
+    return 0;
+}
+
+static int verify_reach(Verifier* v, uint32_t from, uint32_t pos, int32_t depth) {
+    if (pos >= v->co->co_size || !v->starts[pos])
+        return verify_fail(v, from, "jump into the middle of an instruction or past the end");
+
+    if (v->depths[pos] == -1) {
+        v->depths[pos] = depth;
+        v->worklist[v->count++] = pos;
+    } else if (v->depths[pos] != depth) {
+        return verify_fail(v, pos, "reached with different stack depths");
+    }
+
+    return 1;
+}
+
+static int verify_is_jump(uint8_t op) {
+    return op == CO_OP_JUMP_REL || op == CO_OP_JUMP_IF_FALSE || op == CO_OP_JUMP_IF_FALSE_OR_POP
+        || op == CO_OP_JUMP_IF_TRUE_OR_POP || op == CO_OP_COMPARE_JUMP_IF_FALSE;
+}
+
+static int verify_has_cache(uint8_t op) {
+    return (op >= CO_OP_BINARY_ADD && op <= CO_OP_BINARY_MOD) || (op >= CO_OP_COMPARE_EQ && op <= CO_OP_COMPARE_GTE)
+        || op == CO_OP_CALL_FUNCTION;
+}
+
+static int verify_is_arith(uint8_t binop) {
+    return (binop >= BIN_ADD && binop <= BIN_MOD) || (binop >= BIN_BIT_AND && binop <= BIN_BIT_RSHIFT);
+}
+
+// Instruction boundaries, an EXTENDED_ARG and the instruction it extends make up one. The quickened
+// forms only ever come from the VM rewriting its own decoded copy, in bytecode they would find the
+// empty caches of a loaded image.
+static int verify_decode(Verifier* v) {
+    uint8_t* code = v->co->co_bytecode;
+    uint32_t size = v->co->co_size;
+
+    for (uint32_t pos = 0; pos < size;) {
+        uint8_t op = code[pos];
+        if (op >= CO_OP_BINARY_ADD_LONG || co_op_size[op] == 0)
+            return verify_fail(v, pos, "unknown opcode");
+
+        uint32_t len = co_op_size[op];
+        if (op == CO_OP_EXTENDED_ARG) {
+            uint8_t next = pos + 3 < size ? code[pos + 3] : CO_OP_COUNT;
+            if (next >= CO_OP_BINARY_ADD_LONG || next == CO_OP_EXTENDED_ARG || co_op_size[next] < 3)
+                return verify_fail(v, pos, "EXTENDED_ARG without an operand to extend");
+
+            len += co_op_size[next];
+        }
+
+        if (pos + len > size)
+            return verify_fail(v, pos, "truncated instruction");
+
+        v->starts[pos] = 1;
+        pos += len;
+    }
+
+    return 1;
+}
+
+// Operands of the instruction at "pos", "op_pos" is past its prefix
+static int verify_operands(Verifier* v, uint32_t pos, uint32_t op_pos) {
+    MECodeObject* co = v->co;
+    uint8_t* code = co->co_bytecode;
+    uint8_t op = code[op_pos];
+    uint8_t size = co_op_size[op];
+    if (size < 3)
+        return op != CO_OP_BINARY_OP || code[op_pos + 1] <= BIN_BIT_RSHIFT ? 1 : verify_fail(v, pos, "unknown binary op");
+
+    uint16_t high = op_pos != pos ? co_read_u16(code + pos + 1) : 0;
+    uint32_t arg = co_arg_value(op, high, co_read_u16(code + op_pos + size - 2));
+    size_t nglobals = v->nglobals;
+
+    switch (op) {
+        case CO_OP_LOAD_CONST:
+            return arg < darray_size(co->co_consts) ? 1 : verify_fail(v, pos, "constant out of range");
+        case CO_OP_LOAD_GLOBAL:
+        case CO_OP_STORE_GLOBAL:
+        case CO_OP_INC_GLOBAL:
+            return arg < nglobals ? 1 : verify_fail(v, pos, "global out of range");
+        case CO_OP_LOAD_VARIABLE:
+        case CO_OP_STORE_VARIABLE:
+        case CO_OP_INC_LOCAL:
+            return arg < co->co_nlocals ? 1 : verify_fail(v, pos, "local out of range");
+        case CO_OP_BINARY_OP_INPLACE_GLOBAL:
+            if (arg >= nglobals)
+                return verify_fail(v, pos, "global out of range");
+
+            return verify_is_arith(code[op_pos + 1]) ? 1 : verify_fail(v, pos, "not an arithmetic op");
+        case CO_OP_BINARY_OP_INPLACE_LOCAL:
+            if (arg >= co->co_nlocals)
+                return verify_fail(v, pos, "local out of range");
+
+            return verify_is_arith(code[op_pos + 1]) ? 1 : verify_fail(v, pos, "not an arithmetic op");
+        case CO_OP_COMPARE_JUMP_IF_FALSE:
+            if (code[op_pos + 1] < BIN_EQ || code[op_pos + 1] > BIN_GTE)
+                return verify_fail(v, pos, "not a comparison");
+            break;
+        default:
+            break;
+    }
+
+    if (verify_has_cache(op) && arg >= darray_size(co->co_caches))
+        return verify_fail(v, pos, "cache out of range");
+
+    return 1;
+}
+
+static int verify_flow(Verifier* v) {
+    MECodeObject* co = v->co;
+    uint8_t* code = co->co_bytecode;
+
+    if (co->co_size == 0)
+        return verify_fail(v, 0, "empty code");
+
+    if (!verify_reach(v, 0, 0, 0))
+        return 0;
+
+    while (v->count > 0) {
+        uint32_t pos = v->worklist[--v->count];
+        uint32_t op_pos = code[pos] == CO_OP_EXTENDED_ARG ? pos + 3 : pos;
+        uint8_t op = code[op_pos];
+        uint32_t end = op_pos + co_op_size[op];
+
+        int32_t depth = v->depths[pos];
+        int32_t pops = co_op_pops[op];
+        int32_t effect = co_op_stack_effect[op];
+        if (op == CO_OP_CALL_FUNCTION || op == CO_OP_TAIL_CALL) {
+            pops += code[op_pos + 1];
+            effect -= code[op_pos + 1];
+        }
+
+        if (depth < pops)
+            return verify_fail(v, pos, "stack underflow");
+
+        // The callee takes over the frame of a function, the module frame has nothing to hand over
+        if (op == CO_OP_TAIL_CALL && !v->func)
+            return verify_fail(v, pos, "TAIL_CALL outside a function");
+
+        if (depth + effect > (int32_t)co->co_stacksize)
+            return verify_fail(v, pos, "stack deeper than co_stacksize");
+
+        if (!verify_operands(v, pos, op_pos))
+            return 0;
+
+        if (verify_is_jump(op)) {
+            uint16_t high = op_pos != pos ? co_read_u16(code + pos + 1) : 0;
+            uint32_t target = end + co_arg_value(op, high, co_read_u16(code + end - 2));
+
+            // The short-circuit jumps keep the value they tested
+            int32_t target_depth = op == CO_OP_JUMP_IF_FALSE_OR_POP || op == CO_OP_JUMP_IF_TRUE_OR_POP ? depth : depth + effect;
+            if (!verify_reach(v, pos, target, target_depth))
+                return 0;
+        }
+
+        if (op == CO_OP_RETURN || op == CO_OP_TAIL_CALL || op == CO_OP_JUMP_REL)
+            continue;
+
+        if (end >= co->co_size)
+            return verify_fail(v, pos, "runs past the end of the code");
+
+        if (!verify_reach(v, pos, end, depth + effect))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int verify_code(MECodeObject* co, MEFunctionObject* func, size_t nglobals) {
+    Verifier v = {
+        .co = co,
+        .func = func,
+        .nglobals = nglobals,
+        .starts = calloc(co->co_size + 1, 1),
+        .depths = malloc(sizeof(int32_t) * (co->co_size + 1)),
+        .worklist = malloc(sizeof(uint32_t) * (co->co_size + 1)),
+        .count = 0,
+    };
+
+    for (size_t i = 0; i <= co->co_size; i++)
+        v.depths[i] = -1;
+
+    // Arguments are the first locals of the frame, more of them would run into the operand stack
+    int ok = func && func->nargs > co->co_nlocals ? verify_fail(&v, 0, "more arguments than locals") : 1;
+    ok = ok && verify_decode(&v) && verify_flow(&v);
+
+    for (size_t i = 0; ok && i < darray_size(co->co_caches); i++) {
+        if (co->co_caches[i].offset >= co->co_size)
+            ok = verify_fail(&v, co->co_caches[i].offset, "cache of no instruction");
+    }
+
+    free(v.starts);
+    free(v.depths);
+    free(v.worklist);
+    return ok;
+}
+
+static int verify_tree(MECodeObject* co, MEFunctionObject* func, size_t nglobals) {
+    if (!verify_code(co, func, nglobals))
+        return 0;
+
+    for (size_t i = 0; i < darray_size(co->co_consts); i++) {
+        MEObject* obj = co->co_consts[i];
+        if (me_function_check(obj) && !verify_tree(((MEFunctionObject*)obj)->co, (MEFunctionObject*)obj, nglobals))
+            return 0;
+    }
+
+    return 1;
+}
+
+int co_verify(MECodeObject* co) {
+    return verify_tree(co, NULL, co->co_globals ? darray_size(co->co_globals) : 0);
+}
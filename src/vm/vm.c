@@ -1,264 +1,1340 @@
 #include "vm.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "../utils/darray.h"
 #include "../lut.h"
+#include "../utils/darray.h"
 
 #include "co.h"
+#include "reg.h"
 
 #include "objects/builtinfnobject.h"
 #include "objects/functionobject.h"
 #include "objects/errorobject.h"
 #include "objects/boolobject.h"
+#include "objects/noneobject.h"
+#include "objects/floatobject.h"
+#include "objects/longobject.h"
 #include "object.h"
 
-#define MAX_RECURSION_DEPTH 1024
-
-#define TOP(vm) ((vm)->stack[(vm)->sp - 1])
-// #define POP(vm) (darray_pop((vm)->stack), (vm)->sp--, TOP(vm))
-#define POP(vm) ({ MEObject* obj = TOP(vm); darray_pop((vm)->stack); (vm)->sp--; obj; })
-#define PUSH(vm, obj) (darray_push((vm)->stack, (obj)), (vm)->sp++)
-
-MEObject* me_binary_op(MEObject* lhs, MEObject* rhs, BinaryOp op);
-MEObject* me_unary_op(MEObject* obj, UnaryOp op);
-MEVMExitCode me_function_call(MEVM* vm, MEObject* func_obj, MEObject** args, uint8_t arg_count);
-
-MEObject* me_binary_add(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_sub(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_mul(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_div(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_mod(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_bit_and(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_bit_or(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_bit_xor(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_lshift(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_rshift(MEObject* lhs, MEObject* rhs);
-MEObject* me_binary_cmp(MEObject* lhs, MEObject* rhs, BinaryOp op);
+#define ME_VM_STACK_INITIAL_CAPACITY 1024
+#define ME_VM_FRAMES_INITIAL_CAPACITY 64
+
+// Threaded dispatch through GCC/Clang "labels as values". Every handler jumps straight to the
+// next one instead of going back through the switch, so each opcode gets its own indirect branch.
+// Build with -DME_VM_COMPUTED_GOTO=0 to force the plain switch loop.
+#ifndef ME_VM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define ME_VM_COMPUTED_GOTO 1
+#else
+#define ME_VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+// The loop runs the decoded MEInstr records, ip is already one past the running instruction when
+// its handler starts so the handler finds its own operands at ip[-1]
+// Build with -DME_VM_COUNT_DISPATCHES=1 to count every instruction run into vm->dispatches, to see
+// what a change to the instruction set saves on the bench scripts
+#ifndef ME_VM_COUNT_DISPATCHES
+#define ME_VM_COUNT_DISPATCHES 0
+#endif
+
+#if ME_VM_COUNT_DISPATCHES
+#define COUNT_DISPATCH() (vm->dispatches++)
+#else
+#define COUNT_DISPATCH() ((void)0)
+#endif
+
+#if ME_VM_COMPUTED_GOTO
+#define TARGET(op) case op: TARGET_##op: COUNT_DISPATCH();
+#define DISPATCH() goto *(ip++)->handler
+#define SET_OP(opcode) do { uint8_t __op = (opcode); ip[-1].op = __op; ip[-1].handler = dispatch_table[__op]; } while (0)
+#else
+#define TARGET(op) case op: COUNT_DISPATCH();
+#define DISPATCH() goto dispatch // Not "continue", handlers dispatch from inside do { } while (0) macros
+#define SET_OP(opcode) (ip[-1].op = (opcode))
+#endif
+
+// Top of stack is cached in "tos", the slab only holds the values below it. Every frame has a
+// dummy slot right after its locals ("bottom") that receives whatever "tos" held when the frame's
+// stack was empty, so PUSH and POP never have to branch on an empty stack. Logically the stack is
+// bottom[1..sp) plus "tos" sitting at *sp.
+#define TOP() (tos)
+#define PUSH(obj) do { *sp++ = tos; tos = (obj); } while (0)
+#define POP() ({ MEObject* __o = tos; tos = *--sp; __o; })
+#define STACK_DEPTH() ((uint32_t)(sp - bottom))
+
+// Code is run only after co_verify proved that no instruction can find the stack short, so the
+// handlers skip the check. Build with -DME_VM_CHECKED=1 to have them check anyway.
+#ifndef ME_VM_CHECKED
+#define ME_VM_CHECKED 0
+#endif
+
+#if ME_VM_CHECKED
+#define CHECK_STACK(n) do { \
+    if (STACK_DEPTH() < (n)) { \
+        me_set_error(me_error_generic, "Stack underflow."); \
+        goto error; \
+    } \
+} while (0)
+#else
+#define CHECK_STACK(n) ((void)0)
+#endif
+
+// Reloads the per frame state after a call or a return switched frames
+#define LOAD_FRAME() do { \
+    locals = frame->base; \
+    bottom = locals + frame->co->co_nlocals; \
+} while (0)
+
+// Operand checks of the specialized binary ops, tagged ints are the only longs handled inline
+#define BOTH_TAGGED(lhs, rhs) (ME_IS_TAGGED_INT(lhs) & ME_IS_TAGGED_INT(rhs))
+#define BOTH_FLOAT(lhs, rhs) (!ME_IS_TAGGED_INT(lhs) && !ME_IS_TAGGED_INT(rhs) && (lhs)->ob_type == &me_type_float && (rhs)->ob_type == &me_type_float)
+#define LONG_VALUE(obj) ME_TAGGED_INT_VALUE(obj)
+#define FLOAT_VALUE(obj) (((MEFloatObject*)(obj))->ob_value)
+
+// Releases an operand unless a borrowed load pushed it, "bit" is its place in ip[-1].borrowed
+#define RELEASE_OPERAND(obj, bit) do { \
+    if (!(ip[-1].borrowed & (bit))) \
+        ME_XDECREF(obj); \
+} while (0)
+
+// Pops the rhs and peeks the lhs of a binary op, the result replaces the lhs in "tos"
+#define BINARY_OPERANDS() \
+    CHECK_STACK(2); \
+    MEObject* rhs = POP(); \
+    MEObject* lhs = TOP(); \
+    MEObject* result
+
+#define BINARY_RESULT() do { \
+    RELEASE_OPERAND(lhs, 2); \
+    RELEASE_OPERAND(rhs, 1); \
+    if (!result) { \
+        tos = NULL; \
+        goto error; \
+    } \
+    tos = result; \
+    DISPATCH(); \
+} while (0)
+
+// Arithmetic on two tagged ints, done in place and boxed only if the result leaves the tagged range
+#define BINARY_LONG_HANDLER(opcode, expr, slow) \
+    TARGET(opcode) { \
+        BINARY_OPERANDS(); \
+        if (BOTH_TAGGED(lhs, rhs)) { \
+            long l = LONG_VALUE(lhs), r = LONG_VALUE(rhs); \
+            result = me_vm_long(expr); \
+        } else { \
+            result = slow(lhs, rhs); \
+        } \
+        BINARY_RESULT(); \
+    }
+
+#define COMPARE_HANDLER(opcode, cmp, binop) \
+    TARGET(opcode) { \
+        MECodeCache* cache = ip[-1].cache; \
+        BINARY_OPERANDS(); \
+        ADAPT_BINARY(cache); \
+        if (BOTH_TAGGED(lhs, rhs)) \
+            result = LONG_VALUE(lhs) cmp LONG_VALUE(rhs) ? me_true : me_false; \
+        else if (BOTH_FLOAT(lhs, rhs)) \
+            result = FLOAT_VALUE(lhs) cmp FLOAT_VALUE(rhs) ? me_true : me_false; \
+        else \
+            result = me_binary_cmp(lhs, rhs, binop); \
+        BINARY_RESULT(); \
+    }
+
+// Quickening. Adaptive instructions count down their cache and try to specialize when it hits zero,
+// a failed attempt or a deoptimization waits ME_VM_QUICKEN_BACKOFF executions before the next try.
+#define ME_VM_QUICKEN_BACKOFF 64
+
+#define ADAPT_BINARY(cache) do { \
+    (cache)->generic++; \
+    if ((cache)->counter == 0) { \
+        uint8_t quick = me_vm_quicken_binary(ip[-1].op, lhs, rhs); \
+        if (quick) \
+            SET_OP(quick); \
+        else \
+            (cache)->counter = ME_VM_QUICKEN_BACKOFF; \
+    } else { \
+        (cache)->counter--; \
+    } \
+} while (0)
+
+#define DEOPT(cache) do { \
+    (cache)->misses++; \
+    (cache)->counter = ME_VM_QUICKEN_BACKOFF; \
+    SET_OP(co_op_deopt[ip[-1].op]); \
+} while (0)
+
+// Quickened long/long arithmetic, "guard" rules out what has to take the slow path without being a
+// type miss (overflow, division by zero)
+#define BINARY_LONG_QUICK(opcode, guard, expr, slow) \
+    TARGET(opcode) { \
+        MECodeCache* cache = ip[-1].cache; \
+        BINARY_OPERANDS(); \
+        if (BOTH_TAGGED(lhs, rhs)) { \
+            long l = LONG_VALUE(lhs), r = LONG_VALUE(rhs); \
+            if (guard) { \
+                cache->hits++; \
+                tos = me_vm_long(expr); \
+                DISPATCH(); \
+            } \
+        } else { \
+            DEOPT(cache); \
+        } \
+        result = slow(lhs, rhs); \
+        BINARY_RESULT(); \
+    }
+
+#define BINARY_FLOAT_QUICK(opcode, guard, expr, slow) \
+    TARGET(opcode) { \
+        MECodeCache* cache = ip[-1].cache; \
+        BINARY_OPERANDS(); \
+        if (BOTH_FLOAT(lhs, rhs)) { \
+            double l = FLOAT_VALUE(lhs), r = FLOAT_VALUE(rhs); \
+            if (guard) { \
+                cache->hits++; \
+                result = me_float_from_double(expr); \
+                BINARY_RESULT(); \
+            } \
+        } else { \
+            DEOPT(cache); \
+        } \
+        result = slow(lhs, rhs); \
+        BINARY_RESULT(); \
+    }
+
+#define COMPARE_LONG_QUICK(opcode, cmp, binop) \
+    TARGET(opcode) { \
+        MECodeCache* cache = ip[-1].cache; \
+        BINARY_OPERANDS(); \
+        if (BOTH_TAGGED(lhs, rhs)) { \
+            cache->hits++; \
+            tos = LONG_VALUE(lhs) cmp LONG_VALUE(rhs) ? me_true : me_false; \
+            DISPATCH(); \
+        } \
+        DEOPT(cache); \
+        result = me_binary_cmp(lhs, rhs, binop); \
+        BINARY_RESULT(); \
+    }
+
+#define COMPARE_FLOAT_QUICK(opcode, cmp, binop) \
+    TARGET(opcode) { \
+        MECodeCache* cache = ip[-1].cache; \
+        BINARY_OPERANDS(); \
+        if (BOTH_FLOAT(lhs, rhs)) { \
+            cache->hits++; \
+            result = FLOAT_VALUE(lhs) cmp FLOAT_VALUE(rhs) ? me_true : me_false; \
+        } else { \
+            DEOPT(cache); \
+            result = me_binary_cmp(lhs, rhs, binop); \
+        } \
+        BINARY_RESULT(); \
+    }
+
+// Superinstructions, the rest of the run follows the head at ip[0] and ip[1]. Fast paths only take
+// tagged ints, anything else does what the head alone would and lets the run go on from ip[0].
+#define LOCAL_SLOT(instr) locals[(instr).index]
+#define GLOBAL_SLOT(instr) (*(instr).slot)
+
+// The loads of a run keep their "borrowed" mark, the head does what its own load would
+#define LOAD_REF(obj, instr) do { \
+    if (!(instr).borrowed) \
+        ME_INCREF(obj); \
+} while (0)
+
+#define LOAD_HEAD(load) do { \
+    MEObject* __o = load(ip[-1]); \
+    PUSH(__o); \
+    LOAD_REF(__o, ip[-1]); \
+    DISPATCH(); \
+} while (0)
+
+#define LOAD_PAIR_HANDLER(opcode, first, second) \
+    TARGET(opcode) { \
+        MEObject* a = first(ip[-1]); \
+        MEObject* b = second(ip[0]); \
+        PUSH(a); \
+        LOAD_REF(a, ip[-1]); \
+        PUSH(b); \
+        LOAD_REF(b, ip[0]); \
+        ip++; \
+        DISPATCH(); \
+    }
+
+// "a = b", the reference is taken before the old value goes in case both are the same slot
+#define MOVE_HANDLER(opcode, slot_of) \
+    TARGET(opcode) { \
+        MEObject* value = slot_of(ip[-1]); \
+        MEObject** slot = &slot_of(ip[0]); \
+        ME_INCREF(value); \
+        ME_XDECREF(*slot); \
+        *slot = value; \
+        ip++; \
+        DISPATCH(); \
+    }
+
+#define LOAD_INPLACE_HANDLER(opcode, slot_of) \
+    TARGET(opcode) { \
+        MEObject* rhs = slot_of(ip[-1]); \
+        MEObject** slot = &slot_of(ip[0]); \
+        uint8_t binop = ip[0].arg; \
+        if (BOTH_TAGGED(*slot, rhs) && (binop == BIN_ADD || binop == BIN_SUB)) { \
+            long r = LONG_VALUE(rhs); \
+            *slot = me_vm_long(LONG_VALUE(*slot) + (binop == BIN_ADD ? r : -r)); \
+            ip++; \
+            DISPATCH(); \
+        } \
+        LOAD_HEAD(slot_of); \
+    }
+
+#define LOAD_CONST_BINARY_HANDLER(opcode, slot_of, op) \
+    TARGET(opcode) { \
+        MEObject* lhs = slot_of(ip[-1]); \
+        MEObject* rhs = ip[0].obj; \
+        if (BOTH_TAGGED(lhs, rhs)) { \
+            PUSH(me_vm_long(LONG_VALUE(lhs) op LONG_VALUE(rhs))); \
+            ip += 2; \
+            DISPATCH(); \
+        } \
+        LOAD_HEAD(slot_of); \
+    }
+
+#define LOAD_CONST_COMPARE_JUMP_HANDLER(opcode, slot_of) \
+    TARGET(opcode) { \
+        MEObject* lhs = slot_of(ip[-1]); \
+        MEObject* rhs = ip[0].obj; \
+        if (BOTH_TAGGED(lhs, rhs)) { \
+            ip = me_vm_compare_long(LONG_VALUE(lhs), LONG_VALUE(rhs), ip[1].arg) ? ip + 2 : ip[1].target; \
+            DISPATCH(); \
+        } \
+        LOAD_HEAD(slot_of); \
+    }
+
+// Pushes a frame for "func" whose arguments already sit at "args", the argument count is checked
+// by the caller
+#define ENTER_FUNCTION(func, args, arg_count) do { \
+    if (vm->frame_count == MAX_RECURSION_DEPTH) { \
+        me_set_error(me_error_generic, "Maximum recursion depth of %d exceeded.", MAX_RECURSION_DEPTH); \
+        goto error; \
+    } \
+    \
+    MECodeObject* callee = (func)->co; \
+    /* Locals, the dummy slot and the operands of the callee have to fit above the arguments */ \
+    size_t args_offset = (args) - vm->stack; \
+    size_t needed = args_offset + callee->co_nlocals + 1 + callee->co_stacksize; \
+    if (needed > vm->stack_capacity) { \
+        me_vm_grow_stack(vm, needed); \
+        (args) = vm->stack + args_offset; \
+    } \
+    \
+    if (vm->frame_count == vm->frame_capacity) { \
+        vm->frame_capacity *= 2; \
+        vm->frames = realloc(vm->frames, sizeof(MEFrame) * vm->frame_capacity); \
+    } \
+    \
+    frame = &vm->frames[vm->frame_count - 1]; \
+    frame->ip = ip; \
+    frame->sp = (args) - 1; /* The function object slot, the result replaces it */ \
+    \
+    frame = &vm->frames[vm->frame_count++]; \
+    frame->co = callee; \
+    frame->base = (args); /* Arguments are already in parameter order, they become the first locals */ \
+    \
+    for (uint32_t i = (arg_count); i < callee->co_nlocals; i++) { \
+        (args)[i] = me_none; \
+        ME_INCREF(me_none); \
+    } \
+    \
+    ip = callee->co_instrs; \
+    LOAD_FRAME(); \
+    sp = bottom; \
+    frame->sp = sp; /* Only meaningful once it calls out, but keeps the stack growth rebase sane */ \
+    tos = NULL; \
+    DISPATCH(); \
+} while (0)
+
+// Calls a builtin whose arguments sit at "args", its result replaces the function object on top
+#define INVOKE_BUILTIN(func_obj, args, arg_count) do { \
+    MEObject* result = ((MEBuiltinFnObject*)(func_obj))->fn((func_obj), (args), (arg_count)); \
+    \
+    for (int i = 0; i < (arg_count); i++) \
+        ME_DECREF((args)[i]); \
+    ME_DECREF(func_obj); \
+    \
+    sp = (args) - 1; \
+    tos = result; \
+    if (!result) /* In case of NULL error must be set by the function itself */ \
+        goto error; \
+} while (0)
+
+// Pops the running frame and hands "value" to the caller. Statements never leave anything behind,
+// so only the locals are left to release.
+#define LEAVE_FRAME(value) do { \
+    MEObject* return_value = (value); \
+    for (MEObject** p = locals; p < bottom; p++) \
+        ME_DECREF(*p); \
+    \
+    if (vm->frame_count == 1) { \
+        ME_XDECREF(return_value); \
+        vm->frame_count = 0; \
+        return MEVM_EXIT_OK; \
+    } \
+    \
+    frame = &vm->frames[--vm->frame_count - 1]; \
+    sp = frame->sp; \
+    ME_DECREF(*sp); /* Function object */ \
+    tos = return_value; \
+    ip = frame->ip; \
+    LOAD_FRAME(); \
+    DISPATCH(); \
+} while (0)
+
+// Stores an int into a slot, a boxed long only the slot refers to is reused instead of reallocated
+static inline void me_vm_store_long(MEObject** slot, long value) {
+    MEObject* old = *slot;
+    if (value >= ME_TAGGED_INT_MIN && value <= ME_TAGGED_INT_MAX) {
+        *slot = ME_TAGGED_INT_FROM(value);
+    } else if (old && !ME_IS_TAGGED_INT(old) && old->ob_type == &me_type_long && old->ob_refcount == 1) {
+        ((MELongObject*)old)->ob_value = value;
+        return;
+    } else {
+        *slot = me_long_from_long(value);
+    }
+
+    ME_XDECREF(old);
+}
+
+// "slot = slot op rhs" of the in-place opcodes, 0 with the error set if the op fails. Int arithmetic
+// that can not overflow is done here, anything else goes through the type slots.
+static int me_vm_inplace(MEObject** slot, MEObject* rhs, uint8_t op) {
+    MEObject* lhs = *slot;
+    if (lhs && ME_TYPE(lhs) == &me_type_long && ME_TYPE(rhs) == &me_type_long) {
+        long l = me_long_value(lhs), r = me_long_value(rhs), value;
+        int ok = 0;
+        switch (op) {
+            case BIN_ADD: ok = !__builtin_add_overflow(l, r, &value); break;
+            case BIN_SUB: ok = !__builtin_sub_overflow(l, r, &value); break;
+            case BIN_MUL: ok = !__builtin_mul_overflow(l, r, &value); break;
+            default: break;
+        }
+
+        if (ok) {
+            me_vm_store_long(slot, value);
+            return 1;
+        }
+    }
+
+    MEObject* result = me_binary_op(lhs, rhs, op);
+    if (!result)
+        return 0;
+
+    ME_XDECREF(lhs);
+    *slot = result;
+    return 1;
+}
+
+// Specialized form of an adaptive binary op for the operands at hand, 0 if there is none
+static uint8_t me_vm_quicken_binary(uint8_t op, MEObject* lhs, MEObject* rhs) {
+    static const uint8_t quicken_long[CO_OP_COUNT] = {
+        [CO_OP_BINARY_ADD] = CO_OP_BINARY_ADD_LONG,
+        [CO_OP_BINARY_SUB] = CO_OP_BINARY_SUB_LONG,
+        [CO_OP_BINARY_MUL] = CO_OP_BINARY_MUL_LONG,
+        [CO_OP_BINARY_DIV] = CO_OP_BINARY_DIV_LONG,
+        [CO_OP_BINARY_MOD] = CO_OP_BINARY_MOD_LONG,
+        [CO_OP_COMPARE_EQ] = CO_OP_COMPARE_EQ_LONG,
+        [CO_OP_COMPARE_NEQ] = CO_OP_COMPARE_NEQ_LONG,
+        [CO_OP_COMPARE_LT] = CO_OP_COMPARE_LT_LONG,
+        [CO_OP_COMPARE_LTE] = CO_OP_COMPARE_LTE_LONG,
+        [CO_OP_COMPARE_GT] = CO_OP_COMPARE_GT_LONG,
+        [CO_OP_COMPARE_GTE] = CO_OP_COMPARE_GTE_LONG,
+    };
+
+    static const uint8_t quicken_float[CO_OP_COUNT] = {
+        [CO_OP_BINARY_ADD] = CO_OP_BINARY_ADD_FLOAT,
+        [CO_OP_BINARY_SUB] = CO_OP_BINARY_SUB_FLOAT,
+        [CO_OP_BINARY_MUL] = CO_OP_BINARY_MUL_FLOAT,
+        [CO_OP_BINARY_DIV] = CO_OP_BINARY_DIV_FLOAT,
+        [CO_OP_COMPARE_EQ] = CO_OP_COMPARE_EQ_FLOAT,
+        [CO_OP_COMPARE_NEQ] = CO_OP_COMPARE_NEQ_FLOAT,
+        [CO_OP_COMPARE_LT] = CO_OP_COMPARE_LT_FLOAT,
+        [CO_OP_COMPARE_LTE] = CO_OP_COMPARE_LTE_FLOAT,
+        [CO_OP_COMPARE_GT] = CO_OP_COMPARE_GT_FLOAT,
+        [CO_OP_COMPARE_GTE] = CO_OP_COMPARE_GTE_FLOAT,
+    };
+
+    if (BOTH_TAGGED(lhs, rhs))
+        return quicken_long[op];
+
+    if (BOTH_FLOAT(lhs, rhs))
+        return quicken_float[op];
+
+    return 0;
+}
 
 MEVM* me_vm_new(MECodeObject* co) {
     MEVM* vm = (MEVM*)malloc(sizeof(MEVM));
-    vm->parent = NULL;
     vm->co = co;
-    vm->stack = darray_new(MEObject*);
-    vm->ip = 0;
-    vm->sp = 0;
-    vm->depth = 0;
+
+    // The module frame needs its unused function slot and the dummy slot on top of its operands
+    vm->stack_capacity = ME_VM_STACK_INITIAL_CAPACITY;
+    if (vm->stack_capacity < co->co_stacksize + 2)
+        vm->stack_capacity = co->co_stacksize + 2;
+    vm->stack = malloc(sizeof(MEObject*) * vm->stack_capacity);
+
+    vm->frame_capacity = ME_VM_FRAMES_INITIAL_CAPACITY;
+    vm->frames = malloc(sizeof(MEFrame) * vm->frame_capacity);
+    vm->frame_count = 0;
+    vm->error_line = 0;
+    vm->dispatches = 0;
 
     return vm;
 }
 
+// Moves the value stack to a bigger slab and rebases every frame onto it. Happens rarely, only
+// when a call would not fit, so the copy is fine.
+static void me_vm_grow_stack(MEVM* vm, size_t needed) {
+    size_t capacity = vm->stack_capacity * 2;
+    while (capacity < needed)
+        capacity *= 2;
+
+    MEObject** stack = malloc(sizeof(MEObject*) * capacity);
+    memcpy(stack, vm->stack, sizeof(MEObject*) * vm->stack_capacity);
+
+    for (uint32_t i = 0; i < vm->frame_count; i++) {
+        vm->frames[i].base = stack + (vm->frames[i].base - vm->stack);
+        vm->frames[i].sp = stack + (vm->frames[i].sp - vm->stack);
+    }
+
+    free(vm->stack);
+    vm->stack = stack;
+    vm->stack_capacity = capacity;
+}
+
+// Releases everything still alive on the stack after an error, "sp" and "tos" are the state of the
+// innermost frame. Callers below it saved their sp on the function object, which is their top.
+static void me_vm_unwind(MEVM* vm, MEObject** sp, MEObject* tos) {
+    for (uint32_t i = vm->frame_count; i-- > 0;) {
+        MEFrame* frame = &vm->frames[i];
+        MEObject** bottom = frame->base + frame->co->co_nlocals;
+
+        if (sp > bottom) {
+            ME_XDECREF(tos);
+            for (MEObject** p = bottom + 1; p < sp; p++)
+                ME_XDECREF(*p);
+        }
+
+        for (MEObject** p = frame->base; p < bottom; p++)
+            ME_XDECREF(*p);
+
+        if (i > 0) {
+            sp = vm->frames[i - 1].sp;
+            tos = *sp;
+        }
+    }
+
+    vm->frame_count = 0;
+}
+
+// Length of the run of "super" starting at instrs[i], 0 if it does not match there. Only the head of a
+// run may be a jump target, nothing can enter it halfway.
+static uint32_t me_vm_fuse_match(MEInstr* instrs, uint32_t count, uint8_t* targets, uint32_t i, uint8_t super) {
+    const uint8_t* run = co_op_fuses[super];
+    uint32_t len = 0;
+    while (len < CO_FUSE_MAX && run[len] != CO_OP_NOP) {
+        if (i + len >= count || instrs[i + len].op != run[len] || (len > 0 && targets[i + len]))
+            return 0;
+        len++;
+    }
+
+    return len;
+}
+
+static const uint8_t me_vm_borrowed_load[CO_OP_COUNT] = {
+    [CO_OP_LOAD_CONST] = CO_OP_LOAD_CONST_BORROWED,
+    [CO_OP_LOAD_GLOBAL] = CO_OP_LOAD_GLOBAL_BORROWED,
+    [CO_OP_LOAD_VARIABLE] = CO_OP_LOAD_VARIABLE_BORROWED,
+};
+
+// Records some jump lands on, one entry per record plus the end of the code
+static uint8_t* me_vm_jump_targets(MEInstr* instrs, uint32_t count) {
+    uint8_t* targets = calloc(count + 1, 1);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t op = instrs[i].op;
+        if (op == CO_OP_JUMP_REL || op == CO_OP_JUMP_IF_FALSE || op == CO_OP_JUMP_IF_FALSE_OR_POP
+            || op == CO_OP_JUMP_IF_TRUE_OR_POP || op == CO_OP_COMPARE_JUMP_IF_FALSE)
+            targets[instrs[i].target - instrs] = 1;
+    }
+
+    return targets;
+}
+
+static int me_vm_is_load(uint8_t op) {
+    return op == CO_OP_LOAD_CONST || op == CO_OP_LOAD_GLOBAL || op == CO_OP_LOAD_VARIABLE;
+}
+
+// Values of consts, globals and locals pushed only to be looked at by the next instruction do not
+// need a reference, the slot they come from holds one until then. Only a load right in front of its
+// consumer (or the pair in front of a binary op) is borrowed: nothing in between can store to the
+// slot or fail and unwind a stack holding the value, and no jump comes in with another one.
+static void me_vm_borrow(MEInstr* instrs, uint32_t count, uint8_t* targets) {
+    for (uint32_t i = 1; i < count; i++) {
+        uint8_t op = instrs[i].op;
+        int pops;
+        if (op == CO_OP_BINARY_OP || (op >= CO_OP_BINARY_ADD && op <= CO_OP_COMPARE_GTE) || op == CO_OP_COMPARE_JUMP_IF_FALSE)
+            pops = 2;
+        else if (op == CO_OP_UNARY_OP || op == CO_OP_JUMP_IF_FALSE || op == CO_OP_POP)
+            pops = 1;
+        else
+            continue;
+
+        if (targets[i] || !me_vm_is_load(instrs[i - 1].op))
+            continue;
+
+        instrs[i - 1].borrowed = 1;
+        instrs[i].borrowed = 1;
+        if (pops == 2 && i >= 2 && !targets[i - 1] && me_vm_is_load(instrs[i - 2].op)) {
+            instrs[i - 2].borrowed = 1;
+            instrs[i].borrowed |= 2;
+        }
+    }
+}
+
+// Picks the superinstruction for the head of every run in co_op_fuses, runs may overlap as every
+// record keeps its operands. "cost" is the fewest dispatches from a record to the end of the code
+// going straight down, so a pair is not taken where the triple right after it saves more.
+static void me_vm_fuse(MEInstr* instrs, uint32_t count, uint8_t* targets, void* const* handlers) {
+    uint32_t* cost = malloc(sizeof(uint32_t) * (count + 1));
+    cost[count] = 0;
+    for (uint32_t i = count; i-- > 0;) {
+        uint8_t best = instrs[i].op;
+        cost[i] = 1 + cost[i + 1];
+        for (uint32_t super = 0; super < CO_OP_COUNT; super++) {
+            uint32_t len = co_op_fuses[super][0] != CO_OP_NOP ? me_vm_fuse_match(instrs, count, targets, i, super) : 0;
+            if (len && 1 + cost[i + len] < cost[i]) {
+                cost[i] = 1 + cost[i + len];
+                best = super;
+            }
+        }
+
+        if (best != instrs[i].op) {
+            instrs[i].op = best;
+            instrs[i].handler = handlers ? handlers[best] : NULL;
+        }
+    }
+
+    free(cost);
+}
+
+// Translates the bytecode of "co" and of every function in its consts into co_instrs, "handlers"
+// maps opcodes to the labels of the threaded dispatch (NULL for the switch loop). The code already
+// passed co_verify, so every operand is in range and every jump lands on an instruction.
+static void me_vm_decode(MECodeObject* co, MEObject** globals, void* const* handlers) {
+    if (co->co_instrs)
+        return;
+
+    uint8_t* code = co->co_bytecode;
+    uint32_t size = co->co_size;
+
+    // Record index of every instruction start, an EXTENDED_ARG prefix shares the record of its op
+    uint32_t* index = malloc(sizeof(uint32_t) * (size + 1));
+    uint32_t count = 0;
+    for (uint32_t pos = 0; pos < size;) {
+        index[pos] = count++;
+        uint32_t op_pos = code[pos] == CO_OP_EXTENDED_ARG ? pos + co_op_size[CO_OP_EXTENDED_ARG] : pos;
+        pos = op_pos + co_op_size[code[op_pos]];
+    }
+
+    MEInstr* instrs = calloc(count, sizeof(MEInstr));
+    for (uint32_t pos = 0; pos < size;) {
+        MEInstr* instr = &instrs[index[pos]];
+        uint16_t high = 0;
+        uint32_t op_pos = pos;
+        if (code[pos] == CO_OP_EXTENDED_ARG) {
+            high = co_read_u16(code + pos + 1);
+            op_pos += co_op_size[CO_OP_EXTENDED_ARG];
+        }
+
+        uint8_t op = code[op_pos];
+        uint8_t len = co_op_size[op];
+        uint32_t end = op_pos + len;
+
+        instr->handler = handlers ? handlers[op] : NULL;
+        instr->op = op;
+        instr->line = co_line_from_offset(co, op_pos);
+
+        // The u8 operand comes first, the u16 one is always last
+        if (len == 2 || len == 4)
+            instr->arg = code[op_pos + 1];
+
+        if (len >= 3) {
+            uint32_t arg = co_arg_value(op, high, co_read_u16(code + end - 2));
+            switch (op) {
+                case CO_OP_LOAD_CONST:
+                    instr->obj = co->co_consts[arg];
+                    break;
+                case CO_OP_LOAD_GLOBAL:
+                case CO_OP_STORE_GLOBAL:
+                case CO_OP_INC_GLOBAL:
+                case CO_OP_BINARY_OP_INPLACE_GLOBAL:
+                    instr->slot = &globals[arg];
+                    break;
+                case CO_OP_LOAD_VARIABLE:
+                case CO_OP_STORE_VARIABLE:
+                case CO_OP_INC_LOCAL:
+                case CO_OP_BINARY_OP_INPLACE_LOCAL:
+                    instr->index = arg;
+                    break;
+                case CO_OP_JUMP_REL:
+                case CO_OP_JUMP_IF_FALSE:
+                case CO_OP_JUMP_IF_FALSE_OR_POP:
+                case CO_OP_JUMP_IF_TRUE_OR_POP:
+                case CO_OP_COMPARE_JUMP_IF_FALSE:
+                    instr->target = &instrs[index[end + arg]]; // Wraps around for backward jumps
+                    break;
+                default: // Everything else with a u16 operand is quickenable
+                    instr->cache = &co->co_caches[arg];
+                    break;
+            }
+        }
+
+        pos = end;
+    }
+
+    free(index);
+
+    uint8_t* targets = me_vm_jump_targets(instrs, count);
+    me_vm_borrow(instrs, count, targets);
+    me_vm_fuse(instrs, count, targets, handlers);
+    free(targets);
+
+    // Borrowing loads that were not fused take their own handler, a head handles the mark itself
+    for (uint32_t i = 0; i < count; i++) {
+        if (instrs[i].borrowed && me_vm_is_load(instrs[i].op)) {
+            instrs[i].op = me_vm_borrowed_load[instrs[i].op];
+            instrs[i].handler = handlers ? handlers[instrs[i].op] : NULL;
+        }
+    }
+
+    co->co_instrs = instrs;
+    co->co_ninstrs = count;
+
+    for (size_t i = 0; i < darray_size(co->co_consts); i++) {
+        MEObject* obj = co->co_consts[i];
+        if (me_function_check(obj))
+            me_vm_decode(((MEFunctionObject*)obj)->co, globals, handlers);
+    }
+}
+
 MEVMExitCode me_vm_run(MEVM* vm) {
-    while (vm->ip < vm->co->co_size) {
-        MECodeOp op = vm->co->co_bytecode[vm->ip++];
-        switch (op) {
-            case CO_OP_NOP:
-                break;
-            case CO_OP_POP: {
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
-                }
+    if (vm->co->co_register)
+        return me_vm_run_registers(vm);
+
+#if ME_VM_COMPUTED_GOTO
+    static void* dispatch_table[256] = {
+        [0 ... 255] = &&TARGET_unknown,
+        [CO_OP_NOP] = &&TARGET_CO_OP_NOP,
+        [CO_OP_LOAD_CONST] = &&TARGET_CO_OP_LOAD_CONST,
+        [CO_OP_LOAD_GLOBAL] = &&TARGET_CO_OP_LOAD_GLOBAL,
+        [CO_OP_LOAD_VARIABLE] = &&TARGET_CO_OP_LOAD_VARIABLE,
+        [CO_OP_STORE_GLOBAL] = &&TARGET_CO_OP_STORE_GLOBAL,
+        [CO_OP_STORE_VARIABLE] = &&TARGET_CO_OP_STORE_VARIABLE,
+        [CO_OP_BINARY_OP] = &&TARGET_CO_OP_BINARY_OP,
+        [CO_OP_UNARY_OP] = &&TARGET_CO_OP_UNARY_OP,
+        [CO_OP_CALL_FUNCTION] = &&TARGET_CO_OP_CALL_FUNCTION,
+        [CO_OP_RETURN] = &&TARGET_CO_OP_RETURN,
+        [CO_OP_TAIL_CALL] = &&TARGET_CO_OP_TAIL_CALL,
+        [CO_OP_DUP] = &&TARGET_CO_OP_DUP,
+        [CO_OP_POP] = &&TARGET_CO_OP_POP,
+        [CO_OP_JUMP_REL] = &&TARGET_CO_OP_JUMP_REL,
+        [CO_OP_JUMP_IF_FALSE] = &&TARGET_CO_OP_JUMP_IF_FALSE,
+        [CO_OP_JUMP_IF_FALSE_OR_POP] = &&TARGET_CO_OP_JUMP_IF_FALSE_OR_POP,
+        [CO_OP_JUMP_IF_TRUE_OR_POP] = &&TARGET_CO_OP_JUMP_IF_TRUE_OR_POP,
+        [CO_OP_COMPARE_JUMP_IF_FALSE] = &&TARGET_CO_OP_COMPARE_JUMP_IF_FALSE,
+        [CO_OP_INC_LOCAL] = &&TARGET_CO_OP_INC_LOCAL,
+        [CO_OP_INC_GLOBAL] = &&TARGET_CO_OP_INC_GLOBAL,
+        [CO_OP_BINARY_OP_INPLACE_LOCAL] = &&TARGET_CO_OP_BINARY_OP_INPLACE_LOCAL,
+        [CO_OP_BINARY_OP_INPLACE_GLOBAL] = &&TARGET_CO_OP_BINARY_OP_INPLACE_GLOBAL,
+        [CO_OP_BINARY_ADD] = &&TARGET_CO_OP_BINARY_ADD,
+        [CO_OP_BINARY_SUB] = &&TARGET_CO_OP_BINARY_SUB,
+        [CO_OP_BINARY_MUL] = &&TARGET_CO_OP_BINARY_MUL,
+        [CO_OP_BINARY_DIV] = &&TARGET_CO_OP_BINARY_DIV,
+        [CO_OP_BINARY_MOD] = &&TARGET_CO_OP_BINARY_MOD,
+        [CO_OP_BINARY_BIT_AND] = &&TARGET_CO_OP_BINARY_BIT_AND,
+        [CO_OP_BINARY_BIT_OR] = &&TARGET_CO_OP_BINARY_BIT_OR,
+        [CO_OP_BINARY_BIT_XOR] = &&TARGET_CO_OP_BINARY_BIT_XOR,
+        [CO_OP_BINARY_LSHIFT] = &&TARGET_CO_OP_BINARY_LSHIFT,
+        [CO_OP_BINARY_RSHIFT] = &&TARGET_CO_OP_BINARY_RSHIFT,
+        [CO_OP_COMPARE_EQ] = &&TARGET_CO_OP_COMPARE_EQ,
+        [CO_OP_COMPARE_NEQ] = &&TARGET_CO_OP_COMPARE_NEQ,
+        [CO_OP_COMPARE_LT] = &&TARGET_CO_OP_COMPARE_LT,
+        [CO_OP_COMPARE_LTE] = &&TARGET_CO_OP_COMPARE_LTE,
+        [CO_OP_COMPARE_GT] = &&TARGET_CO_OP_COMPARE_GT,
+        [CO_OP_COMPARE_GTE] = &&TARGET_CO_OP_COMPARE_GTE,
+        [CO_OP_BINARY_ADD_LONG] = &&TARGET_CO_OP_BINARY_ADD_LONG,
+        [CO_OP_BINARY_SUB_LONG] = &&TARGET_CO_OP_BINARY_SUB_LONG,
+        [CO_OP_BINARY_MUL_LONG] = &&TARGET_CO_OP_BINARY_MUL_LONG,
+        [CO_OP_BINARY_DIV_LONG] = &&TARGET_CO_OP_BINARY_DIV_LONG,
+        [CO_OP_BINARY_MOD_LONG] = &&TARGET_CO_OP_BINARY_MOD_LONG,
+        [CO_OP_BINARY_ADD_FLOAT] = &&TARGET_CO_OP_BINARY_ADD_FLOAT,
+        [CO_OP_BINARY_SUB_FLOAT] = &&TARGET_CO_OP_BINARY_SUB_FLOAT,
+        [CO_OP_BINARY_MUL_FLOAT] = &&TARGET_CO_OP_BINARY_MUL_FLOAT,
+        [CO_OP_BINARY_DIV_FLOAT] = &&TARGET_CO_OP_BINARY_DIV_FLOAT,
+        [CO_OP_COMPARE_EQ_LONG] = &&TARGET_CO_OP_COMPARE_EQ_LONG,
+        [CO_OP_COMPARE_NEQ_LONG] = &&TARGET_CO_OP_COMPARE_NEQ_LONG,
+        [CO_OP_COMPARE_LT_LONG] = &&TARGET_CO_OP_COMPARE_LT_LONG,
+        [CO_OP_COMPARE_LTE_LONG] = &&TARGET_CO_OP_COMPARE_LTE_LONG,
+        [CO_OP_COMPARE_GT_LONG] = &&TARGET_CO_OP_COMPARE_GT_LONG,
+        [CO_OP_COMPARE_GTE_LONG] = &&TARGET_CO_OP_COMPARE_GTE_LONG,
+        [CO_OP_COMPARE_EQ_FLOAT] = &&TARGET_CO_OP_COMPARE_EQ_FLOAT,
+        [CO_OP_COMPARE_NEQ_FLOAT] = &&TARGET_CO_OP_COMPARE_NEQ_FLOAT,
+        [CO_OP_COMPARE_LT_FLOAT] = &&TARGET_CO_OP_COMPARE_LT_FLOAT,
+        [CO_OP_COMPARE_LTE_FLOAT] = &&TARGET_CO_OP_COMPARE_LTE_FLOAT,
+        [CO_OP_COMPARE_GT_FLOAT] = &&TARGET_CO_OP_COMPARE_GT_FLOAT,
+        [CO_OP_COMPARE_GTE_FLOAT] = &&TARGET_CO_OP_COMPARE_GTE_FLOAT,
+        [CO_OP_CALL_EXACT_ARGS] = &&TARGET_CO_OP_CALL_EXACT_ARGS,
+        [CO_OP_CALL_BUILTIN] = &&TARGET_CO_OP_CALL_BUILTIN,
+        [CO_OP_LOAD_VARIABLE_VARIABLE] = &&TARGET_CO_OP_LOAD_VARIABLE_VARIABLE,
+        [CO_OP_LOAD_GLOBAL_VARIABLE] = &&TARGET_CO_OP_LOAD_GLOBAL_VARIABLE,
+        [CO_OP_LOAD_GLOBAL_GLOBAL] = &&TARGET_CO_OP_LOAD_GLOBAL_GLOBAL,
+        [CO_OP_LOAD_VARIABLE_STORE_VARIABLE] = &&TARGET_CO_OP_LOAD_VARIABLE_STORE_VARIABLE,
+        [CO_OP_LOAD_GLOBAL_STORE_GLOBAL] = &&TARGET_CO_OP_LOAD_GLOBAL_STORE_GLOBAL,
+        [CO_OP_LOAD_VARIABLE_INPLACE_LOCAL] = &&TARGET_CO_OP_LOAD_VARIABLE_INPLACE_LOCAL,
+        [CO_OP_LOAD_GLOBAL_INPLACE_GLOBAL] = &&TARGET_CO_OP_LOAD_GLOBAL_INPLACE_GLOBAL,
+        [CO_OP_LOAD_VARIABLE_CONST_ADD] = &&TARGET_CO_OP_LOAD_VARIABLE_CONST_ADD,
+        [CO_OP_LOAD_VARIABLE_CONST_SUB] = &&TARGET_CO_OP_LOAD_VARIABLE_CONST_SUB,
+        [CO_OP_LOAD_VARIABLE_CONST_COMPARE_JUMP] = &&TARGET_CO_OP_LOAD_VARIABLE_CONST_COMPARE_JUMP,
+        [CO_OP_LOAD_GLOBAL_CONST_COMPARE_JUMP] = &&TARGET_CO_OP_LOAD_GLOBAL_CONST_COMPARE_JUMP,
+        [CO_OP_LOAD_CONST_BORROWED] = &&TARGET_CO_OP_LOAD_CONST_BORROWED,
+        [CO_OP_LOAD_GLOBAL_BORROWED] = &&TARGET_CO_OP_LOAD_GLOBAL_BORROWED,
+        [CO_OP_LOAD_VARIABLE_BORROWED] = &&TARGET_CO_OP_LOAD_VARIABLE_BORROWED,
+    };
+#endif
+
+#if ME_VM_COMPUTED_GOTO
+    me_vm_decode(vm->co, vm->co->co_globals, dispatch_table);
+#else
+    me_vm_decode(vm->co, vm->co->co_globals, NULL);
+#endif
+
+    // The module runs in the first frame, calls push more frames and never recurse in C
+    MEFrame* frame = &vm->frames[0];
+    vm->frame_count = 1;
+    frame->co = vm->co;
+    frame->ip = vm->co->co_instrs;
+    frame->base = vm->stack + 1;
+    frame->sp = frame->base;
+
+    // Hot state lives in locals for the duration of the loop
+    MEInstr* ip = frame->ip;
+    MEObject** locals;
+    MEObject** bottom;
+    LOAD_FRAME();
+    MEObject** sp = bottom;
+    MEObject* tos = NULL;
+
+    for (;;) {
+#if !ME_VM_COMPUTED_GOTO
+    dispatch:
+#endif
+        switch ((ip++)->op) {
+            TARGET(CO_OP_NOP) {
+                DISPATCH();
+            }
+            TARGET(CO_OP_POP) {
+                CHECK_STACK(1);
 
-                MEObject* o = POP(vm);
-                ME_DECREF(o);
-                break;
+                MEObject* o = POP();
+                RELEASE_OPERAND(o, 1);
+                DISPATCH();
             }
-            case CO_OP_DUP: {
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
-                }
+            TARGET(CO_OP_DUP) {
+                CHECK_STACK(1);
 
-                MEObject* o = TOP(vm);
-                PUSH(vm, o);
+                MEObject* o = TOP();
+                PUSH(o);
                 ME_INCREF(o);
-                break;
+                DISPATCH();
             }
-            case CO_OP_LOAD_CONST: {
-                uint16_t idx = *(uint16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
-
-                MEObject* o = vm->co->co_consts[idx];
-                PUSH(vm, o);
+            TARGET(CO_OP_LOAD_CONST) {
+                MEObject* o = ip[-1].obj;
+                PUSH(o);
                 ME_INCREF(o);
-                break;
-            }
-            case CO_OP_LOAD_GLOBAL: {
-                uint16_t idx = *(uint16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
-                
-                MEObject* o = vm->co->co_globals[idx];
-                PUSH(vm, o);
+                DISPATCH();
+            }
+            TARGET(CO_OP_LOAD_GLOBAL) {
+                MEObject* o = *ip[-1].slot;
+                PUSH(o);
                 ME_INCREF(o);
-                break;
+                DISPATCH();
             }
-            case CO_OP_LOAD_VARIABLE: {
-                uint16_t idx = *(uint16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
-
-                MEObject* o = vm->co->co_locals[idx];
-                PUSH(vm, o);
+            TARGET(CO_OP_LOAD_VARIABLE) {
+                MEObject* o = locals[ip[-1].index];
+                PUSH(o);
                 ME_INCREF(o);
-                break;
+                DISPATCH();
+            }
+            TARGET(CO_OP_LOAD_CONST_BORROWED) {
+                PUSH(ip[-1].obj);
+                DISPATCH();
+            }
+            TARGET(CO_OP_LOAD_GLOBAL_BORROWED) {
+                PUSH(*ip[-1].slot);
+                DISPATCH();
+            }
+            TARGET(CO_OP_LOAD_VARIABLE_BORROWED) {
+                PUSH(locals[ip[-1].index]);
+                DISPATCH();
+            }
+            TARGET(CO_OP_STORE_GLOBAL) {
+                MEObject** slot = ip[-1].slot;
+                CHECK_STACK(1);
+
+                MEObject* value = POP(); // The stack's reference moves into the slot
+                ME_XDECREF(*slot);
+                *slot = value;
+                DISPATCH();
             }
-            case CO_OP_STORE_GLOBAL: {
-                uint16_t idx = *(uint16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
+            TARGET(CO_OP_STORE_VARIABLE) {
+                uint32_t idx = ip[-1].index;
+                CHECK_STACK(1);
+
+                MEObject* value = POP();
+                ME_XDECREF(locals[idx]);
+                locals[idx] = value;
+                DISPATCH();
+            }
+            TARGET(CO_OP_BINARY_OP) {
+                CHECK_STACK(2);
+
+                MEObject* rhs = POP();
+                MEObject* lhs = TOP();
+
+                uint8_t op = ip[-1].arg;
+                MEObject* result = me_binary_op(lhs, rhs, op);
+
+                RELEASE_OPERAND(lhs, 2);
+                RELEASE_OPERAND(rhs, 1);
 
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+                if (!result) {
+                    tos = NULL; // Already released, keep the slot so the stack unwinds cleanly
+                    goto error;
                 }
 
-                MEObject* value = POP(vm);
-                ME_XDECREF(vm->co->co_globals[idx]);
-                vm->co->co_globals[idx] = value;
-                ME_INCREF(value);
-                break;
+                tos = result;
+                DISPATCH();
             }
-            case CO_OP_STORE_VARIABLE: {
-                uint16_t idx = *(uint16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
-
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+            // Tagged ints are at most 62 bits wide, sums and differences can not overflow a long
+            TARGET(CO_OP_BINARY_ADD) {
+                MECodeCache* cache = ip[-1].cache;
+                BINARY_OPERANDS();
+                ADAPT_BINARY(cache);
+                if (BOTH_TAGGED(lhs, rhs))
+                    result = me_vm_long(LONG_VALUE(lhs) + LONG_VALUE(rhs));
+                else if (BOTH_FLOAT(lhs, rhs))
+                    result = me_float_from_double(FLOAT_VALUE(lhs) + FLOAT_VALUE(rhs));
+                else
+                    result = me_binary_add(lhs, rhs);
+                BINARY_RESULT();
+            }
+            TARGET(CO_OP_BINARY_SUB) {
+                MECodeCache* cache = ip[-1].cache;
+                BINARY_OPERANDS();
+                ADAPT_BINARY(cache);
+                if (BOTH_TAGGED(lhs, rhs))
+                    result = me_vm_long(LONG_VALUE(lhs) - LONG_VALUE(rhs));
+                else if (BOTH_FLOAT(lhs, rhs))
+                    result = me_float_from_double(FLOAT_VALUE(lhs) - FLOAT_VALUE(rhs));
+                else
+                    result = me_binary_sub(lhs, rhs);
+                BINARY_RESULT();
+            }
+            TARGET(CO_OP_BINARY_MUL) {
+                MECodeCache* cache = ip[-1].cache;
+                BINARY_OPERANDS();
+                ADAPT_BINARY(cache);
+                long value;
+                if (BOTH_TAGGED(lhs, rhs) && !__builtin_mul_overflow(LONG_VALUE(lhs), LONG_VALUE(rhs), &value))
+                    result = me_vm_long(value);
+                else if (BOTH_FLOAT(lhs, rhs))
+                    result = me_float_from_double(FLOAT_VALUE(lhs) * FLOAT_VALUE(rhs));
+                else
+                    result = me_binary_mul(lhs, rhs);
+                BINARY_RESULT();
+            }
+            // Division by zero takes the slow path so the error is raised in one place
+            TARGET(CO_OP_BINARY_DIV) {
+                MECodeCache* cache = ip[-1].cache;
+                BINARY_OPERANDS();
+                ADAPT_BINARY(cache);
+                if (BOTH_TAGGED(lhs, rhs) && LONG_VALUE(rhs) != 0)
+                    result = me_vm_long(LONG_VALUE(lhs) / LONG_VALUE(rhs));
+                else if (BOTH_FLOAT(lhs, rhs) && FLOAT_VALUE(rhs) != 0.0)
+                    result = me_float_from_double(FLOAT_VALUE(lhs) / FLOAT_VALUE(rhs));
+                else
+                    result = me_binary_div(lhs, rhs);
+                BINARY_RESULT();
+            }
+            TARGET(CO_OP_BINARY_MOD) {
+                MECodeCache* cache = ip[-1].cache;
+                BINARY_OPERANDS();
+                ADAPT_BINARY(cache);
+                if (BOTH_TAGGED(lhs, rhs) && LONG_VALUE(rhs) != 0)
+                    result = me_vm_long(LONG_VALUE(lhs) % LONG_VALUE(rhs));
+                else
+                    result = me_binary_mod(lhs, rhs);
+                BINARY_RESULT();
+            }
+            BINARY_LONG_HANDLER(CO_OP_BINARY_BIT_AND, l & r, me_binary_bit_and)
+            BINARY_LONG_HANDLER(CO_OP_BINARY_BIT_OR, l | r, me_binary_bit_or)
+            BINARY_LONG_HANDLER(CO_OP_BINARY_BIT_XOR, l ^ r, me_binary_bit_xor)
+            BINARY_LONG_HANDLER(CO_OP_BINARY_LSHIFT, l << r, me_binary_lshift)
+            BINARY_LONG_HANDLER(CO_OP_BINARY_RSHIFT, l >> r, me_binary_rshift)
+            COMPARE_HANDLER(CO_OP_COMPARE_EQ, ==, BIN_EQ)
+            COMPARE_HANDLER(CO_OP_COMPARE_NEQ, !=, BIN_NEQ)
+            COMPARE_HANDLER(CO_OP_COMPARE_LT, <, BIN_LT)
+            COMPARE_HANDLER(CO_OP_COMPARE_LTE, <=, BIN_LTE)
+            COMPARE_HANDLER(CO_OP_COMPARE_GT, >, BIN_GT)
+            COMPARE_HANDLER(CO_OP_COMPARE_GTE, >=, BIN_GTE)
+            BINARY_LONG_QUICK(CO_OP_BINARY_ADD_LONG, 1, l + r, me_binary_add)
+            BINARY_LONG_QUICK(CO_OP_BINARY_SUB_LONG, 1, l - r, me_binary_sub)
+            BINARY_LONG_QUICK(CO_OP_BINARY_MUL_LONG, !__builtin_mul_overflow(l, r, &l), l, me_binary_mul)
+            BINARY_LONG_QUICK(CO_OP_BINARY_DIV_LONG, r != 0, l / r, me_binary_div)
+            BINARY_LONG_QUICK(CO_OP_BINARY_MOD_LONG, r != 0, l % r, me_binary_mod)
+            BINARY_FLOAT_QUICK(CO_OP_BINARY_ADD_FLOAT, 1, l + r, me_binary_add)
+            BINARY_FLOAT_QUICK(CO_OP_BINARY_SUB_FLOAT, 1, l - r, me_binary_sub)
+            BINARY_FLOAT_QUICK(CO_OP_BINARY_MUL_FLOAT, 1, l * r, me_binary_mul)
+            BINARY_FLOAT_QUICK(CO_OP_BINARY_DIV_FLOAT, r != 0.0, l / r, me_binary_div)
+            COMPARE_LONG_QUICK(CO_OP_COMPARE_EQ_LONG, ==, BIN_EQ)
+            COMPARE_LONG_QUICK(CO_OP_COMPARE_NEQ_LONG, !=, BIN_NEQ)
+            COMPARE_LONG_QUICK(CO_OP_COMPARE_LT_LONG, <, BIN_LT)
+            COMPARE_LONG_QUICK(CO_OP_COMPARE_LTE_LONG, <=, BIN_LTE)
+            COMPARE_LONG_QUICK(CO_OP_COMPARE_GT_LONG, >, BIN_GT)
+            COMPARE_LONG_QUICK(CO_OP_COMPARE_GTE_LONG, >=, BIN_GTE)
+            COMPARE_FLOAT_QUICK(CO_OP_COMPARE_EQ_FLOAT, ==, BIN_EQ)
+            COMPARE_FLOAT_QUICK(CO_OP_COMPARE_NEQ_FLOAT, !=, BIN_NEQ)
+            COMPARE_FLOAT_QUICK(CO_OP_COMPARE_LT_FLOAT, <, BIN_LT)
+            COMPARE_FLOAT_QUICK(CO_OP_COMPARE_LTE_FLOAT, <=, BIN_LTE)
+            COMPARE_FLOAT_QUICK(CO_OP_COMPARE_GT_FLOAT, >, BIN_GT)
+            COMPARE_FLOAT_QUICK(CO_OP_COMPARE_GTE_FLOAT, >=, BIN_GTE)
+            TARGET(CO_OP_UNARY_OP) {
+                CHECK_STACK(1);
+
+                MEObject* obj = TOP();
+                uint8_t op = ip[-1].arg;
+                MEObject* result = me_unary_op(obj, op);
+                RELEASE_OPERAND(obj, 1);
+                if (!result) {
+                    tos = NULL;
+                    goto error;
                 }
 
-                MEObject* value = POP(vm);
-                ME_XDECREF(vm->co->co_locals[idx]);
-                vm->co->co_locals[idx] = value;
-                ME_INCREF(value);
-                break;
+                tos = result;
+                DISPATCH();
             }
-            case CO_OP_BINARY_OP: {
-                if (vm->sp < 2) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+            TARGET(CO_OP_CALL_FUNCTION) {
+                uint8_t arg_count = ip[-1].arg;
+                MECodeCache* cache = ip[-1].cache;
+                CHECK_STACK(arg_count + 1);
+
+                // Spill the cached top so the function object and its arguments are all in the slab
+                *sp = tos;
+                MEObject** args = sp - arg_count + 1;
+                MEObject* func_obj = args[-1];
+
+                cache->generic++;
+                if (cache->counter == 0) {
+                    // Calls are specialized on the callee itself, the guard is a pointer compare
+                    if (me_function_check(func_obj) && ((MEFunctionObject*)func_obj)->nargs == arg_count)
+                        SET_OP(CO_OP_CALL_EXACT_ARGS);
+                    else if (me_builtinfn_check(func_obj))
+                        SET_OP(CO_OP_CALL_BUILTIN);
+
+                    if (ip[-1].op != CO_OP_CALL_FUNCTION) {
+                        ME_INCREF(func_obj);
+                        cache->cached = func_obj;
+                    } else {
+                        cache->counter = ME_VM_QUICKEN_BACKOFF;
+                    }
+                } else {
+                    cache->counter--;
                 }
 
-                MEObject* rhs = POP(vm);
-                MEObject* lhs = POP(vm);
+                if (me_function_check(func_obj)) {
+                    MEFunctionObject* func = (MEFunctionObject*)func_obj;
+                    if (arg_count != func->nargs) {
+                        me_set_error(me_error_generic, "Function \"%s\" expects %u arguments, got %u.", func->co->co_name, func->nargs, arg_count);
+                        goto error;
+                    }
 
+                    ENTER_FUNCTION(func, args, arg_count);
+                }
 
-                uint8_t op = vm->co->co_bytecode[vm->ip++];
-                MEObject* result = me_binary_op(lhs, rhs, op);
+                if (me_builtinfn_check(func_obj)) {
+                    INVOKE_BUILTIN(func_obj, args, arg_count);
+                    DISPATCH();
+                }
 
-                ME_XDECREF(lhs);
-                ME_XDECREF(rhs);
+                me_set_error(me_error_typemismatch, "Object is not callable: \"%s\".", ME_TYPE_NAME(func_obj));
+                goto error;
+            }
+            TARGET(CO_OP_CALL_EXACT_ARGS) {
+                uint8_t arg_count = ip[-1].arg;
+                MECodeCache* cache = ip[-1].cache;
+                CHECK_STACK(arg_count + 1);
+
+                *sp = tos;
+                MEObject** args = sp - arg_count + 1;
+                if (args[-1] == cache->cached) {
+                    cache->hits++;
+                    ENTER_FUNCTION((MEFunctionObject*)cache->cached, args, arg_count);
+                }
 
-                if (!result)
-                    return MEVM_EXIT_ERROR;
+                // A different callee, drop the cached one and redo the call in the adaptive form
+                DEOPT(cache);
+                ME_XDECREF(cache->cached);
+                cache->cached = NULL;
+                ip--;
+                DISPATCH();
+            }
+            TARGET(CO_OP_CALL_BUILTIN) {
+                uint8_t arg_count = ip[-1].arg;
+                MECodeCache* cache = ip[-1].cache;
+                CHECK_STACK(arg_count + 1);
+
+                *sp = tos;
+                MEObject** args = sp - arg_count + 1;
+                if (args[-1] == cache->cached) {
+                    cache->hits++;
+                    INVOKE_BUILTIN(cache->cached, args, arg_count);
+                    DISPATCH();
+                }
 
-                PUSH(vm, result);
-                ME_INCREF(result);
-                break;
+                DEOPT(cache);
+                ME_XDECREF(cache->cached);
+                cache->cached = NULL;
+                ip--;
+                DISPATCH();
             }
-            case CO_OP_UNARY_OP: {
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+            TARGET(CO_OP_RETURN) {
+                CHECK_STACK(1);
+                LEAVE_FRAME(POP());
+            }
+            TARGET(CO_OP_TAIL_CALL) {
+                uint8_t arg_count = ip[-1].arg;
+                CHECK_STACK(arg_count + 1);
+
+                *sp = tos;
+                MEObject** args = sp - arg_count + 1;
+                MEObject* func_obj = args[-1];
+
+                if (me_function_check(func_obj)) {
+                    MEFunctionObject* func = (MEFunctionObject*)func_obj;
+                    if (arg_count != func->nargs) {
+                        me_set_error(me_error_generic, "Function \"%s\" expects %u arguments, got %u.", func->co->co_name, func->nargs, arg_count);
+                        goto error;
+                    }
+
+                    for (MEObject** p = locals; p < bottom; p++)
+                        ME_DECREF(*p);
+
+                    MECodeObject* callee = func->co;
+                    size_t args_offset = args - vm->stack;
+                    size_t needed = (locals - vm->stack) + callee->co_nlocals + 1 + callee->co_stacksize;
+                    if (needed > vm->stack_capacity) {
+                        me_vm_grow_stack(vm, needed);
+                        args = vm->stack + args_offset;
+                        locals = frame->base;
+                    }
+
+                    // The callee takes over this frame, its function object replaces ours in the
+                    // caller's stack and the arguments move down to become its first locals
+                    MEObject* old = locals[-1];
+                    locals[-1] = func_obj;
+                    ME_DECREF(old);
+                    memmove(locals, args, sizeof(MEObject*) * arg_count);
+                    for (uint32_t i = arg_count; i < callee->co_nlocals; i++) {
+                        locals[i] = me_none;
+                        ME_INCREF(me_none);
+                    }
+
+                    frame->co = callee;
+                    ip = callee->co_instrs;
+                    LOAD_FRAME();
+                    sp = bottom;
+                    frame->sp = sp;
+                    tos = NULL;
+                    DISPATCH();
                 }
 
-                MEObject* obj = POP(vm);
-                uint8_t op = vm->co->co_bytecode[vm->ip++];
-                MEObject* result = me_unary_op(obj, op);
-                ME_XDECREF(obj);
-                if (!result)
-                    return MEVM_EXIT_ERROR;
-
-                PUSH(vm, result);
-                ME_INCREF(result);
-                break;
-            }
-            case CO_OP_CALL_FUNCTION: {
-                uint8_t arg_count = vm->co->co_bytecode[vm->ip++];
-                if (vm->sp < arg_count) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+                if (me_builtinfn_check(func_obj)) {
+                    INVOKE_BUILTIN(func_obj, args, arg_count);
+                    LEAVE_FRAME(POP());
                 }
 
-                MEObject** args = darray_new(MEObject*);
-                for (int i = 0; i < arg_count; i++)
-                    darray_pushd(args, POP(vm));
+                me_set_error(me_error_typemismatch, "Object is not callable: \"%s\".", ME_TYPE_NAME(func_obj));
+                goto error;
+            }
+            TARGET(CO_OP_JUMP_IF_FALSE) {
+                CHECK_STACK(1);
 
-                MEObject* func_obj = POP(vm);
-                ME_INCREF(func_obj);
-                MEVMExitCode result = me_function_call(vm, func_obj, args, arg_count);
+                MEObject* condition = POP();
+                int is_true = me_is_true(condition);
+                RELEASE_OPERAND(condition, 1);
 
-                darray_for(args) ME_XDECREF(args[__i]);
-                darray_free(args);
-                ME_XDECREF(func_obj);
+                if (!is_true)
+                    ip = ip[-1].target;
 
-                if (result != MEVM_EXIT_OK)
-                    return result;
+                DISPATCH();
+            }
+            TARGET(CO_OP_JUMP_IF_FALSE_OR_POP) {
+                CHECK_STACK(1);
 
-                break;
+                if (!me_is_true(TOP())) {
+                    ip = ip[-1].target;
+                } else {
+                    MEObject* value = POP();
+                    ME_XDECREF(value);
+                }
+
+                DISPATCH();
             }
-            case CO_OP_RETURN: {
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+            TARGET(CO_OP_JUMP_IF_TRUE_OR_POP) {
+                CHECK_STACK(1);
+
+                if (me_is_true(TOP())) {
+                    ip = ip[-1].target;
+                } else {
+                    MEObject* value = POP();
+                    ME_XDECREF(value);
                 }
 
-                MEObject* return_value = POP(vm);
-                if (vm->parent) {
-                    PUSH(vm->parent, return_value);
-                    ME_INCREF(return_value);  // We need to increment here because the parent VM now owns a reference
+                DISPATCH();
+            }
+            TARGET(CO_OP_COMPARE_JUMP_IF_FALSE) {
+                uint8_t cmp = ip[-1].arg;
+                CHECK_STACK(2);
+
+                MEObject* rhs = POP();
+                MEObject* lhs = POP();
+                int is_true;
+                if (BOTH_TAGGED(lhs, rhs)) {
+                    is_true = me_vm_compare_long(LONG_VALUE(lhs), LONG_VALUE(rhs), cmp);
                 } else {
-                    ME_XDECREF(return_value);
+                    MEObject* result = me_binary_cmp(lhs, rhs, cmp);
+                    RELEASE_OPERAND(lhs, 2);
+                    RELEASE_OPERAND(rhs, 1);
+                    if (!result)
+                        goto error;
+
+                    is_true = me_is_true(result);
+                    ME_DECREF(result);
                 }
 
-                vm->ip = vm->co->co_size;
-                return MEVM_EXIT_OK;
+                if (!is_true)
+                    ip = ip[-1].target;
+
+                DISPATCH();
             }
-            case CO_OP_JUMP_IF_FALSE: {
-                uint16_t jump_if_false_offset = *(uint16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
+            TARGET(CO_OP_INC_LOCAL) {
+                int8_t delta = (int8_t)ip[-1].arg;
+                uint32_t idx = ip[-1].index;
+
+                MEObject* o = locals[idx];
+                if (ME_IS_TAGGED_INT(o)) {
+                    locals[idx] = me_vm_long(LONG_VALUE(o) + delta);
+                    DISPATCH();
+                }
+
+                if (!me_vm_inplace(&locals[idx], ME_TAGGED_INT_FROM(delta < 0 ? -delta : delta), delta < 0 ? BIN_SUB : BIN_ADD))
+                    goto error;
 
-                if (vm->sp == 0) {
-                    me_set_error(me_error_generic, "Stack underflow.");
-                    return MEVM_EXIT_ERROR;
+                DISPATCH();
+            }
+            TARGET(CO_OP_INC_GLOBAL) {
+                int8_t delta = (int8_t)ip[-1].arg;
+                MEObject** slot = ip[-1].slot;
+
+                MEObject* o = *slot;
+                if (ME_IS_TAGGED_INT(o)) {
+                    *slot = me_vm_long(LONG_VALUE(o) + delta);
+                    DISPATCH();
                 }
 
-                
-                MEObject* condition = POP(vm);
-                int is_true = me_is_true(condition);
-                ME_XDECREF(condition);
-                
-                if (!is_true)
-                    vm->ip += jump_if_false_offset;
+                if (!me_vm_inplace(slot, ME_TAGGED_INT_FROM(delta < 0 ? -delta : delta), delta < 0 ? BIN_SUB : BIN_ADD))
+                    goto error;
+
+                DISPATCH();
+            }
+            TARGET(CO_OP_BINARY_OP_INPLACE_LOCAL) {
+                uint8_t binop = ip[-1].arg;
+                CHECK_STACK(1);
 
-                break;
+                MEObject* rhs = POP();
+                int ok = me_vm_inplace(&locals[ip[-1].index], rhs, binop);
+                ME_XDECREF(rhs);
+                if (!ok)
+                    goto error;
+
+                DISPATCH();
             }
-            case CO_OP_JUMP_REL: {
-                int16_t jump_offset = *(int16_t*)(vm->co->co_bytecode + vm->ip);
-                vm->ip += 2;
+            TARGET(CO_OP_BINARY_OP_INPLACE_GLOBAL) {
+                uint8_t binop = ip[-1].arg;
+                CHECK_STACK(1);
+
+                MEObject* rhs = POP();
+                int ok = me_vm_inplace(ip[-1].slot, rhs, binop);
+                ME_XDECREF(rhs);
+                if (!ok)
+                    goto error;
 
-                vm->ip += jump_offset;
-                break;
+                DISPATCH();
+            }
+            TARGET(CO_OP_JUMP_REL) {
+                ip = ip[-1].target;
+                DISPATCH();
             }
+            LOAD_PAIR_HANDLER(CO_OP_LOAD_VARIABLE_VARIABLE, LOCAL_SLOT, LOCAL_SLOT)
+            LOAD_PAIR_HANDLER(CO_OP_LOAD_GLOBAL_VARIABLE, GLOBAL_SLOT, LOCAL_SLOT)
+            LOAD_PAIR_HANDLER(CO_OP_LOAD_GLOBAL_GLOBAL, GLOBAL_SLOT, GLOBAL_SLOT)
+            MOVE_HANDLER(CO_OP_LOAD_VARIABLE_STORE_VARIABLE, LOCAL_SLOT)
+            MOVE_HANDLER(CO_OP_LOAD_GLOBAL_STORE_GLOBAL, GLOBAL_SLOT)
+            LOAD_INPLACE_HANDLER(CO_OP_LOAD_VARIABLE_INPLACE_LOCAL, LOCAL_SLOT)
+            LOAD_INPLACE_HANDLER(CO_OP_LOAD_GLOBAL_INPLACE_GLOBAL, GLOBAL_SLOT)
+            LOAD_CONST_BINARY_HANDLER(CO_OP_LOAD_VARIABLE_CONST_ADD, LOCAL_SLOT, +)
+            LOAD_CONST_BINARY_HANDLER(CO_OP_LOAD_VARIABLE_CONST_SUB, LOCAL_SLOT, -)
+            LOAD_CONST_COMPARE_JUMP_HANDLER(CO_OP_LOAD_VARIABLE_CONST_COMPARE_JUMP, LOCAL_SLOT)
+            LOAD_CONST_COMPARE_JUMP_HANDLER(CO_OP_LOAD_GLOBAL_CONST_COMPARE_JUMP, GLOBAL_SLOT)
             default:
+#if ME_VM_COMPUTED_GOTO
+            TARGET_unknown:
+#endif
                 me_set_error(me_error_generic, "Unknown opcode.");
-                return MEVM_EXIT_ERROR;
+                goto error;
         }
     }
 
-    return MEVM_EXIT_OK;
+error:
+    // ip is right past the failing instruction
+    vm->error_line = ip[-1].line;
+    me_vm_unwind(vm, sp, tos);
+    return MEVM_EXIT_ERROR;
 }
 
 void me_vm_free(MEVM* vm) {
-    darray_for(vm->stack) ME_XDECREF(vm->stack[__i]);
-    darray_free(vm->stack);
-    if (!vm->parent)
-        co_free(vm->co);
+    free(vm->stack);
+    free(vm->frames);
+    co_free(vm->co);
     free(vm);
 }
 
 MEObject* me_binary_op(MEObject* lhs, MEObject* rhs, BinaryOp op) {
     switch (op) {
         case BIN_ASSIGN:
+            ME_INCREF(rhs); // Results are always new references
             return rhs;
         case BIN_ADD:
             return me_binary_add(lhs, rhs);
@@ -481,9 +1557,19 @@ MEObject* me_binary_cmp(MEObject* lhs, MEObject* rhs, BinaryOp op) {
         return NULL;
     }
 
+    // Swapped operands need the mirrored comparison, a < b is b > a
+    static const MECmpOp reflected[] = {
+        [ME_CMP_EQ] = ME_CMP_EQ,
+        [ME_CMP_NEQ] = ME_CMP_NEQ,
+        [ME_CMP_LT] = ME_CMP_GT,
+        [ME_CMP_LTE] = ME_CMP_GTE,
+        [ME_CMP_GT] = ME_CMP_LT,
+        [ME_CMP_GTE] = ME_CMP_LTE,
+    };
+
     MEObject* result = ME_TYPE(lhs)->tp_cmp(lhs, rhs, lut_binop_to_cmpop[op]);
     if (result == me_error_notimplemented)
-        result = ME_TYPE(rhs)->tp_cmp(rhs, lhs, lut_binop_to_cmpop[op]);
+        result = ME_TYPE(rhs)->tp_cmp(rhs, lhs, reflected[lut_binop_to_cmpop[op]]);
 
     if (result == me_error_notimplemented) {
         me_set_error(me_error_notimplemented, "Binary comparison not implemented for \"%s\" and \"%s\".", ME_TYPE_NAME(lhs), ME_TYPE_NAME(rhs));
@@ -539,47 +1625,4 @@ MEObject* me_unary_op(MEObject* obj, UnaryOp op) {
             return NULL;
 
     }
-}
-
-MEVMExitCode me_function_call(MEVM* vm, MEObject* func_obj, MEObject** args, uint8_t arg_count) {
-    if (me_function_check(func_obj)) {
-        MEFunctionObject* func = (MEFunctionObject*)func_obj;
-        if (arg_count != func->nargs) {
-            me_set_error(me_error_generic, "Function \"%s\" expects %u arguments, got %u.", func->co->co_name, func->nargs, arg_count);
-            return MEVM_EXIT_ERROR;
-        }
-    
-        MEVM* func_vm = me_vm_new(func->co);
-        func_vm->co->co_globals = vm->co->co_globals;
-        func_vm->parent = vm;
-        func_vm->depth = vm->depth + 1;
-
-        for (int i = 0; i < arg_count; i++) {
-            // MEObject* arg = args[arg_count - 1 - i];
-            MEObject* arg = args[i];
-            ME_INCREF(arg);
-            func_vm->co->co_locals[i] = arg;
-        }
-
-        MEVMExitCode exit = me_vm_run(func_vm);
-
-        // if (func_vm->co->co_globals == vm->co->co_globals)
-        //     func_vm->co->co_globals = NULL;
-
-        me_vm_free(func_vm);
-        return exit;
-    } else if (me_builtinfn_check(func_obj)) {
-        MEObject* result = ((MEBuiltinFnObject*)func_obj)->fn(func_obj, args);
-        if (!result) // In case of NULL error must be set by the function itself
-            return MEVM_EXIT_ERROR;
-
-        PUSH(vm, result);
-        ME_INCREF(result);
-
-        return MEVM_EXIT_OK;
-    }
-
-    me_set_error(me_error_typemismatch, "Object is not callable: \"%s\".", ME_TYPE_NAME(func_obj));
-    return MEVM_EXIT_ERROR;
-}
-
+}
\ No newline at end of file
@@ -4,14 +4,33 @@
 #include "object.h"
 #include "co.h"
 
+#include "objects/longobject.h"
+
+// Frames alive at once, the module's included. They live on the heap, the limit only turns runaway
+// recursion into a runtime error before it takes all the memory. Tail calls reuse their frame.
+#define MAX_RECURSION_DEPTH (1 << 18)
+
+// A call frame, its window in the value stack looks like:
+// [function object] [locals...] [dummy] [operands...]
+// base points at the first local, for the module frame the function slot is unused
+typedef struct {
+    MECodeObject* co;
+    MEInstr* ip;       // Where to continue once the callee returns
+    MEObject** base;
+    MEObject** sp;     // Stack pointer saved while a callee runs, the result lands here
+} MEFrame;
+
 typedef struct _MEVM {
-    struct _MEVM* parent;
     MECodeObject* co;
-    MEObject** stack;
+    MEObject** stack; // One slab shared by every frame, grows on calls when needed
+    size_t stack_capacity;
+
+    MEFrame* frames;
+    uint32_t frame_count;
+    uint32_t frame_capacity;
 
-    uint32_t ip;
-    uint32_t sp;
-    uint32_t depth;
+    uint32_t error_line; // Source line of the failing instruction once me_vm_run returned MEVM_EXIT_ERROR
+    uint64_t dispatches; // Instructions run, only counted with ME_VM_COUNT_DISPATCHES
 } MEVM;
 
 typedef enum {
@@ -23,4 +42,41 @@ MEVM* me_vm_new(MECodeObject* co);
 MEVMExitCode me_vm_run(MEVM* vm);
 void me_vm_free(MEVM* vm);
 
+// Generic operators through the type slots, the compiler folds constants with them too
+MEObject* me_binary_op(MEObject* lhs, MEObject* rhs, BinaryOp op);
+MEObject* me_unary_op(MEObject* obj, UnaryOp op);
+
+// The typed slow paths behind the specialized opcodes, shared by both interpreter loops
+MEObject* me_binary_add(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_sub(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_mul(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_div(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_mod(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_bit_and(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_bit_or(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_bit_xor(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_lshift(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_rshift(MEObject* lhs, MEObject* rhs);
+MEObject* me_binary_cmp(MEObject* lhs, MEObject* rhs, BinaryOp op);
+
+// Same as me_long_from_long but inlined, the VM produces most of its ints here
+static inline MEObject* me_vm_long(long value) {
+    if (value >= ME_TAGGED_INT_MIN && value <= ME_TAGGED_INT_MAX)
+        return ME_TAGGED_INT_FROM(value);
+
+    return me_long_from_long(value);
+}
+
+// Long/long path of CO_OP_COMPARE_JUMP_IF_FALSE, "cmp" is the comparison BinaryOp
+static inline int me_vm_compare_long(long l, long r, uint8_t cmp) {
+    switch (cmp) {
+        case BIN_EQ: return l == r;
+        case BIN_NEQ: return l != r;
+        case BIN_LT: return l < r;
+        case BIN_LTE: return l <= r;
+        case BIN_GT: return l > r;
+        default: return l >= r;
+    }
+}
+
 #endif
\ No newline at end of file